@@ -0,0 +1,38 @@
+# qbinarizer_generate(<target> <schema.json>
+#                     [TYPE <name>] [NAMESPACE <name>] [OUTPUT <header>])
+#
+# Runs qbinarizer-gen on the schema at build time and adds the generated
+# header to target. The header is written to
+# ${CMAKE_CURRENT_BINARY_DIR}/qbinarizer_gen/<schema name>.h unless OUTPUT is
+# set, and its directory is added to the include path of target.
+function(qbinarizer_generate target schema)
+    cmake_parse_arguments(ARG "" "TYPE;NAMESPACE;OUTPUT" "" ${ARGN})
+
+    get_filename_component(schema_path ${schema} ABSOLUTE)
+    get_filename_component(schema_name ${schema} NAME_WE)
+
+    if (NOT ARG_OUTPUT)
+        set(ARG_OUTPUT ${CMAKE_CURRENT_BINARY_DIR}/qbinarizer_gen/${schema_name}.h)
+    endif()
+    get_filename_component(output_dir ${ARG_OUTPUT} DIRECTORY)
+
+    set(gen_args ${schema_path} -o ${ARG_OUTPUT})
+    if (ARG_TYPE)
+        list(APPEND gen_args -t ${ARG_TYPE})
+    endif()
+    if (ARG_NAMESPACE)
+        list(APPEND gen_args -n ${ARG_NAMESPACE})
+    endif()
+
+    add_custom_command(
+        OUTPUT ${ARG_OUTPUT}
+        COMMAND ${CMAKE_COMMAND} -E make_directory ${output_dir}
+        COMMAND qbinarizer-gen ${gen_args}
+        DEPENDS ${schema_path} qbinarizer-gen
+        COMMENT "Generating ${schema_name}.h from ${schema}"
+        VERBATIM)
+
+    set_source_files_properties(${ARG_OUTPUT} PROPERTIES SKIP_AUTOMOC ON)
+    target_sources(${target} PRIVATE ${ARG_OUTPUT})
+    target_include_directories(${target} PRIVATE ${output_dir})
+endfunction()
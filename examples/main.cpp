@@ -52,6 +52,15 @@ int main(int argc, char *argv[]) {
       qbinarizer::StructReflector::getValuesString<MyStructParent>(&parent);
   qDebug() << "MyStructParent: " << str;
 
+  const QByteArray data =
+      qbinarizer::StructReflector::encodeGadget<MyStructParent>(parent);
+  qDebug() << "encoded: " << data.toHex();
+
+  MyStructParent decoded;
+  qbinarizer::StructReflector::decodeGadget(data, decoded);
+  qDebug() << "decoded: "
+           << qbinarizer::StructReflector::getValuesString(&decoded);
+
   // return propertyList;
 
   //  const QString descriptionStr =
@@ -0,0 +1,141 @@
+#ifndef BATCHDECODER_H
+#define BATCHDECODER_H
+
+#include <QByteArray>
+#include <QHash>
+#include <QStringList>
+#include <QVector>
+
+#include <vector>
+
+#include "qbinarizer/export/qbinarizer_export.h"
+#include "qbinarizer/internal/compiledschema.h"
+#include "qbinarizer/internal/decodesink.h"
+#include "qbinarizer/internal/structdecoder.h"
+
+namespace qbinarizer {
+
+/**
+ * @brief The BatchColumn struct Values of one field across all decoded rows.
+ * Only the vector matching type is filled. Rows where the field is absent
+ * hold a zero value and a cleared validity bit. Fields under a count are list
+ * columns: row i owns values [offsets[i], offsets[i + 1])
+ */
+struct QBINARIZER_EXPORT BatchColumn {
+  enum class Type { Int32, Int64, UInt64, Double, Bytes };
+
+  QString path;
+  int fieldId;
+  Type type;
+  bool isList;
+
+  std::vector<qint32> int32Values;
+  std::vector<qint64> int64Values;
+  std::vector<quint64> uint64Values;
+  std::vector<double> doubleValues;
+
+  // Bytes columns: value j is bytes[byteOffsets[j], byteOffsets[j + 1])
+  std::vector<qint32> byteOffsets;
+  QByteArray bytes;
+
+  std::vector<qint32> offsets;
+  std::vector<quint8> validity;
+  qsizetype rowCount;
+
+  BatchColumn()
+      : fieldId(-1), type(Type::Int64), isList(false), byteOffsets(1, 0),
+        offsets(1, 0), rowCount(0) {}
+
+  bool isValid(qsizetype row) const {
+    return (validity[row >> 3] & (1 << (row & 7))) != 0;
+  }
+
+  qsizetype valueCount() const;
+
+  void clear();
+};
+
+/**
+ * @brief The FrameSpan struct Frame memory owned by the caller
+ */
+struct FrameSpan {
+  const char *data;
+  qsizetype size;
+};
+
+/**
+ * @brief The BatchDecoder class Decodes many frames of one schema into
+ * struct-of-arrays columns keyed by field path ("struct.field"). A name
+ * declared again in the same scope is keyed "name#2", "name#3"...
+ */
+class QBINARIZER_EXPORT BatchDecoder : protected DecodeSink {
+public:
+  explicit BatchDecoder(const CompiledSchema &schema);
+
+  void decode(const char *data, qsizetype size);
+
+  void decode(const QByteArray &frame);
+
+  void decode(const QVector<QByteArray> &frames);
+
+  qsizetype rowCount() const;
+
+  QStringList columnNames() const;
+
+  const BatchColumn *column(const QString &path) const;
+
+  const QVector<BatchColumn> &columns() const;
+
+  /**
+   * @brief decodeBatch Decode frames on all cores with one StructDecoder per
+   * worker, result order follows frame order
+   */
+  static QVector<QVariantList> decodeBatch(const CompiledSchema &schema,
+                                           const QVector<QByteArray> &frames);
+
+  static QVector<QVariantList> decodeBatch(const CompiledSchema &schema,
+                                           const QVector<FrameSpan> &frames);
+
+  /**
+   * @brief clear Drop decoded rows, columns stay allocated
+   */
+  void clear();
+
+protected:
+  void createColumns();
+
+  void append(int fieldId, qint64 value);
+
+  void beginMessage(const CompiledSchema &schema) override;
+
+  void endMessage() override;
+
+  void beginArray(int fieldId, int count) override;
+
+  /**
+   * @brief onArray Append the whole array to its column in one step
+   */
+  void onArray(int fieldId, const PrimitiveArray &array) override;
+
+  void onValue(int fieldId, qint64 value) override;
+
+  void onUnsigned(int fieldId, quint64 value) override;
+
+  void onDouble(int fieldId, double value) override;
+
+  void onBytes(int fieldId, const char *data, qsizetype size) override;
+
+private:
+  CompiledSchema m_schema;
+  StructDecoder m_decoder;
+
+  QVector<BatchColumn> m_columns;
+  QHash<QString, int> m_columnByPath;
+  QVector<int> m_columnIndex;
+  QVector<bool> m_present;
+  qsizetype m_rowCount;
+};
+
+} // namespace qbinarizer
+
+#endif // BATCHDECODER_H
@@ -0,0 +1,92 @@
+#ifndef BATCHENCODER_H
+#define BATCHENCODER_H
+
+#include <QByteArray>
+#include <QVariantList>
+
+#include <vector>
+
+#include "qbinarizer/export/qbinarizer_export.h"
+#include "qbinarizer/internal/compiledschema.h"
+#include "qbinarizer/internal/encodevalues.h"
+#include "qbinarizer/internal/structencoder.h"
+
+namespace qbinarizer {
+
+/**
+ * @brief The BatchEncoder class Encodes many messages back to back into one
+ * buffer. Each message may be framed by a sync word and a length prefix
+ * holding the encoded size. Message i owns bytes [offsets[i], offsets[i + 1])
+ * including its framing
+ */
+class QBINARIZER_EXPORT BatchEncoder {
+public:
+  enum class LengthPrefix { None, UInt8, UInt16, UInt32 };
+
+  BatchEncoder();
+
+  QByteArray syncWord() const;
+
+  void setSyncWord(const QByteArray &syncWord);
+
+  LengthPrefix lengthPrefix() const;
+
+  void setLengthPrefix(LengthPrefix lengthPrefix, bool bigEndian = true);
+
+  /**
+   * @brief headerSize Bytes of framing in front of every message
+   */
+  qsizetype headerSize() const;
+
+  void reserve(qsizetype size);
+
+  /**
+   * @brief append Encode one message after the previous ones, returns its
+   * size including framing. A message too long for the length prefix is
+   * dropped and -1 is returned
+   */
+  qsizetype append(const CompiledSchema &schema,
+                   const QVariantList &valueList = QVariantList());
+
+  qsizetype append(const CompiledSchema &schema, const EncodeValues &values);
+
+  qsizetype messageCount() const;
+
+  const QByteArray &data() const;
+
+  const std::vector<qsizetype> &offsets() const;
+
+  /**
+   * @brief message Encoded data of message index without framing
+   */
+  QByteArray message(qsizetype index) const;
+
+  /**
+   * @brief take Return the batch and start a new one
+   */
+  QByteArray take();
+
+  /**
+   * @brief clear Drop encoded messages, the buffer stays allocated
+   */
+  void clear();
+
+protected:
+  void beginMessage();
+
+  qsizetype endMessage(qsizetype size);
+
+private:
+  StructEncoder m_encoder;
+
+  QByteArray m_syncWord;
+  LengthPrefix m_lengthPrefix;
+  bool m_bigEndian;
+
+  QByteArray m_data;
+  std::vector<qsizetype> m_offsets;
+};
+
+} // namespace qbinarizer
+
+#endif // BATCHENCODER_H
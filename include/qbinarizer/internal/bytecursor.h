@@ -0,0 +1,429 @@
+#ifndef BYTECURSOR_H
+#define BYTECURSOR_H
+
+#include <QByteArray>
+#include <QtEndian>
+#include <QtGlobal>
+
+#include <climits>
+#include <cstring>
+
+namespace qbinarizer {
+
+template <int Size> struct UIntOfSize;
+template <> struct UIntOfSize<1> { using Type = quint8; };
+template <> struct UIntOfSize<2> { using Type = quint16; };
+template <> struct UIntOfSize<4> { using Type = quint32; };
+template <> struct UIntOfSize<8> { using Type = quint64; };
+
+/**
+ * @brief loadValue Unaligned endian-aware load, also usable for float/double
+ */
+template <typename T> inline T loadValue(const char *src, bool bigEndian) {
+  using U = typename UIntOfSize<sizeof(T)>::Type;
+
+  U raw;
+  std::memcpy(&raw, src, sizeof(U));
+  raw = bigEndian ? qFromBigEndian(raw) : qFromLittleEndian(raw);
+
+  T value;
+  std::memcpy(&value, &raw, sizeof(T));
+
+  return value;
+}
+
+template <typename T>
+inline void storeValue(char *dest, const T value, bool bigEndian) {
+  using U = typename UIntOfSize<sizeof(T)>::Type;
+
+  U raw;
+  std::memcpy(&raw, &value, sizeof(T));
+  raw = bigEndian ? qToBigEndian(raw) : qToLittleEndian(raw);
+
+  std::memcpy(dest, &raw, sizeof(U));
+}
+
+inline quint32 loadUInt24(const char *src, bool bigEndian) {
+  const auto *p = reinterpret_cast<const uchar *>(src);
+  if (bigEndian) {
+    return (quint32(p[0]) << 16) | (quint32(p[1]) << 8) | quint32(p[2]);
+  }
+
+  return quint32(p[0]) | (quint32(p[1]) << 8) | (quint32(p[2]) << 16);
+}
+
+inline void storeUInt24(char *dest, const quint32 value, bool bigEndian) {
+  auto *p = reinterpret_cast<uchar *>(dest);
+  for (int i = 0; i < 3; i++) {
+    const int shift = bigEndian ? (2 - i) * 8 : i * 8;
+
+    p[i] = (value >> shift) & 0xff;
+  }
+}
+
+inline quint64 reverseBits64(quint64 v) {
+  v = ((v >> 1) & 0x5555555555555555ull) | ((v & 0x5555555555555555ull) << 1);
+  v = ((v >> 2) & 0x3333333333333333ull) | ((v & 0x3333333333333333ull) << 2);
+  v = ((v >> 4) & 0x0f0f0f0f0f0f0f0full) | ((v & 0x0f0f0f0f0f0f0f0full) << 4);
+
+  return qbswap(v);
+}
+
+/**
+ * @brief extractBits size bits starting shift bits into src, first bit most
+ * significant. Reads 9 bytes from src, callers pad the buffer
+ */
+inline quint64 extractBits(const char *src, int shift, int size,
+                           bool reversed) {
+  if (size > 64) {
+    return 0;
+  }
+
+  quint64 raw;
+  std::memcpy(&raw, src, sizeof(raw));
+
+  quint64 word = qFromBigEndian(raw) << shift;
+  if (shift + size > 64) {
+    word |= static_cast<uchar>(src[sizeof(quint64)]) >> (CHAR_WIDTH - shift);
+  }
+
+  if (reversed) {
+    return reverseBits64(word) & (~0ull >> (64 - size));
+  }
+
+  return word >> (64 - size);
+}
+
+/**
+ * @brief insertBits Inverse of extractBits, overwrites size bits starting
+ * shift bits into dest with the low bits of value. Accesses 9 bytes of dest
+ */
+inline void insertBits(char *dest, int shift, int size, bool reversed,
+                       quint64 value) {
+  if ((size <= 0) || (size > 64)) {
+    return;
+  }
+
+  const quint64 mask = ~0ull << (64 - size);
+  const quint64 bits = reversed ? reverseBits64(value) & mask
+                                : value << (64 - size);
+
+  quint64 raw;
+  std::memcpy(&raw, dest, sizeof(raw));
+
+  const quint64 word =
+      (qFromBigEndian(raw) & ~(mask >> shift)) | (bits >> shift);
+  raw = qToBigEndian(word);
+  std::memcpy(dest, &raw, sizeof(raw));
+
+  if (shift + size > 64) {
+    auto *spill = reinterpret_cast<uchar *>(dest + sizeof(quint64));
+    const auto spillMask = static_cast<uchar>((mask << (64 - shift)) >> 56);
+    const auto spillBits = static_cast<uchar>((bits << (64 - shift)) >> 56);
+
+    *spill = (*spill & ~spillMask) | spillBits;
+  }
+}
+
+/**
+ * @brief The ByteReader class Read cursor over memory it does not own.
+ * Reads past the end return zero, move the cursor to the end and set the
+ * readPastEnd flag, like QDataStream::ReadPastEnd
+ */
+class ByteReader {
+public:
+  ByteReader() : m_data(nullptr), m_size(0), m_pos(0), m_readPastEnd(false) {}
+
+  ByteReader(const char *data, qsizetype size)
+      : m_data(data), m_size(size), m_pos(0), m_readPastEnd(false) {}
+
+  void reset(const char *data = nullptr, qsizetype size = 0) {
+    m_data = data;
+    m_size = size;
+    m_pos = 0;
+    m_readPastEnd = false;
+  }
+
+  const char *data() const { return m_data; }
+
+  const char *current() const { return m_data + m_pos; }
+
+  qsizetype size() const { return m_size; }
+
+  qsizetype pos() const { return m_pos; }
+
+  qsizetype remaining() const { return m_size - m_pos; }
+
+  bool atEnd() const { return m_pos >= m_size; }
+
+  bool readPastEnd() const { return m_readPastEnd; }
+
+  bool canRead(qsizetype count) const { return count <= m_size - m_pos; }
+
+  bool seek(qsizetype pos) {
+    if ((pos < 0) || (pos > m_size)) {
+      return false;
+    }
+
+    m_pos = pos;
+
+    return true;
+  }
+
+  bool skip(qsizetype count) {
+    if (!canRead(count)) {
+      return fail();
+    }
+
+    m_pos += count;
+
+    return true;
+  }
+
+  template <typename T> T read(bool bigEndian) {
+    if (!canRead(sizeof(T))) {
+      fail();
+
+      return T(0);
+    }
+
+    const T value = loadValue<T>(m_data + m_pos, bigEndian);
+    m_pos += sizeof(T);
+
+    return value;
+  }
+
+  quint32 readUInt24(bool bigEndian) {
+    if (!canRead(3)) {
+      fail();
+
+      return 0;
+    }
+
+    const quint32 value = loadUInt24(m_data + m_pos, bigEndian);
+    m_pos += 3;
+
+    return value;
+  }
+
+  /**
+   * @brief readRaw Copy up to count bytes, returns the number copied
+   */
+  qsizetype readRaw(char *dest, qsizetype count) {
+    const qsizetype available = qMin(count, remaining());
+    if (available > 0) {
+      std::memcpy(dest, m_data + m_pos, available);
+      m_pos += available;
+    }
+
+    if (available < count) {
+      m_readPastEnd = true;
+    }
+
+    return available;
+  }
+
+private:
+  bool fail() {
+    m_pos = m_size;
+    m_readPastEnd = true;
+
+    return false;
+  }
+
+  const char *m_data;
+  qsizetype m_size;
+  qsizetype m_pos;
+  bool m_readPastEnd;
+};
+
+/**
+ * @brief The ByteWriter class Write cursor appending to a QByteArray or
+ * filling a caller-supplied span. Seeking or skipping past the end fills the
+ * gap with zeros. A span that is too small sets the overflow flag and drops
+ * further writes. In counting mode only positions and size are tracked
+ */
+class ByteWriter {
+public:
+  ByteWriter()
+      : m_buffer(nullptr), m_base(0), m_span(nullptr), m_capacity(0),
+        m_pos(0), m_size(0), m_overflow(false), m_counting(false) {}
+
+  explicit ByteWriter(QByteArray *buffer) : ByteWriter() { reset(buffer); }
+
+  ByteWriter(char *data, qsizetype capacity) : ByteWriter() {
+    reset(data, capacity);
+  }
+
+  /**
+   * @brief reset Write after the current end of buffer
+   */
+  void reset(QByteArray *buffer) {
+    m_buffer = buffer;
+    m_base = buffer->size();
+    m_span = nullptr;
+    m_capacity = 0;
+    m_pos = 0;
+    m_size = 0;
+    m_overflow = false;
+    m_counting = false;
+  }
+
+  void reset(char *data, qsizetype capacity) {
+    m_buffer = nullptr;
+    m_base = 0;
+    m_span = data;
+    m_capacity = capacity;
+    m_pos = 0;
+    m_size = 0;
+    m_overflow = false;
+    m_counting = false;
+  }
+
+  void reset() { reset(nullptr, 0); }
+
+  /**
+   * @brief resetCounting Measure what would be written without storing it,
+   * data() is null in this mode
+   */
+  void resetCounting() {
+    reset();
+    m_counting = true;
+  }
+
+  bool isCounting() const { return m_counting; }
+
+  char *data() {
+    return (m_buffer != nullptr) ? m_buffer->data() + m_base : m_span;
+  }
+
+  const char *data() const {
+    return (m_buffer != nullptr) ? m_buffer->constData() + m_base : m_span;
+  }
+
+  qsizetype pos() const { return m_pos; }
+
+  /**
+   * @brief size Highest position written so far
+   */
+  qsizetype size() const { return m_size; }
+
+  bool overflow() const { return m_overflow; }
+
+  void reserve(qsizetype size) {
+    if (m_buffer != nullptr) {
+      m_buffer->reserve(m_base + size);
+    }
+  }
+
+  bool seek(qsizetype pos) {
+    if (pos < 0) {
+      return false;
+    }
+
+    if (pos > m_size) {
+      m_pos = m_size;
+
+      return skip(pos - m_size);
+    }
+
+    m_pos = pos;
+
+    return true;
+  }
+
+  bool skip(qsizetype count) {
+    char *dest = ensure(count);
+    if (m_overflow) {
+      return false;
+    }
+
+    if ((dest != nullptr) && (m_pos + count > m_size)) {
+      const qsizetype from = qMax(m_pos, m_size);
+      std::memset(data() + from, 0, m_pos + count - from);
+    }
+
+    advance(count);
+
+    return true;
+  }
+
+  template <typename T> void write(const T value, bool bigEndian) {
+    char *dest = ensure(sizeof(T));
+    if (dest != nullptr) {
+      storeValue<T>(dest, value, bigEndian);
+    }
+
+    advance(sizeof(T));
+  }
+
+  void writeUInt24(const quint32 value, bool bigEndian) {
+    char *dest = ensure(3);
+    if (dest != nullptr) {
+      storeUInt24(dest, value, bigEndian);
+    }
+
+    advance(3);
+  }
+
+  void writeRaw(const char *src, qsizetype count) {
+    if (count <= 0) {
+      return;
+    }
+
+    char *dest = ensure(count);
+    if (dest != nullptr) {
+      std::memcpy(dest, src, count);
+    }
+
+    advance(count);
+  }
+
+private:
+  char *ensure(qsizetype count) {
+    if (m_counting) {
+      return nullptr;
+    }
+
+    const qsizetype end = m_pos + count;
+
+    if (m_buffer != nullptr) {
+      if (m_base + end > m_buffer->size()) {
+        m_buffer->resize(m_base + end);
+      }
+
+      return m_buffer->data() + m_base + m_pos;
+    }
+
+    if ((m_span == nullptr) || (end > m_capacity)) {
+      m_overflow = true;
+
+      return nullptr;
+    }
+
+    return m_span + m_pos;
+  }
+
+  // Writes past the capacity of a span are dropped without moving
+  void advance(qsizetype count) {
+    if (m_overflow) {
+      return;
+    }
+
+    m_pos += count;
+    m_size = qMax(m_size, m_pos);
+  }
+
+  QByteArray *m_buffer;
+  qsizetype m_base;
+  char *m_span;
+  qsizetype m_capacity;
+  qsizetype m_pos;
+  qsizetype m_size;
+  bool m_overflow;
+  bool m_counting;
+};
+
+} // namespace qbinarizer
+
+#endif // BYTECURSOR_H
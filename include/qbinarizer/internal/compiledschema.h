@@ -0,0 +1,242 @@
+#ifndef COMPILEDSCHEMA_H
+#define COMPILEDSCHEMA_H
+
+#include <QByteArray>
+#include <QHash>
+#include <QPair>
+#include <QString>
+#include <QVariantList>
+#include <QVector>
+
+#include "qbinarizer/export/qbinarizer_export.h"
+#include "qbinarizer/internal/expression.h"
+#include "qbinarizer/internal/fieldslot.h"
+
+namespace qbinarizer {
+
+/**
+ * @brief The CompiledSchema class Field description list translated once into
+ * a flat instruction vector, so decoding does not walk QVariantMaps again
+ */
+class QBINARIZER_EXPORT CompiledSchema {
+public:
+  enum class Opcode : quint8 {
+    None,
+    Int8,
+    UInt8,
+    Int16,
+    UInt16,
+    Int24,
+    UInt24,
+    Int32,
+    UInt32,
+    Int64,
+    UInt64,
+    Float,
+    Double,
+    Const,
+    Crc8,
+    Crc16,
+    Crc32,
+    Crc64,
+    Struct,
+    Custom,
+    Unixtime,
+    Raw,
+    Skip,
+    Bitfield,
+    BitfieldElement
+  };
+
+  /**
+   * @brief The Layout enum Fixed when every offset is known at compile time,
+   * FixedPrefix when only leading top-level fields are, Dynamic otherwise
+   */
+  enum class Layout { Fixed, FixedPrefix, Dynamic };
+
+  static constexpr int NoRef = -1;
+  static constexpr int UnresolvedRef = -2;
+
+  struct Instruction {
+    Opcode opcode;
+    QString name;
+    bool bigEndian;
+    bool isSigned;
+    bool reversed;
+    bool include;
+    // Some field takes its count from this one
+    bool countSource;
+    // Bytes for values, bits for bitfield elements
+    int size;
+    // Absolute seek position, bit position for bitfield elements
+    qint64 pos;
+    int count;
+    int countRef;
+    int dependRef;
+    int parentRef;
+    int toRef;
+    // Field declared later whose encoded byte length this field holds
+    int lengthRef;
+    qint64 from;
+    QByteArray constData;
+    QVariant value;
+    QVariant choose;
+    int parent;
+    // One past the last instruction of the subtree
+    int end;
+    // Bitfield elements: byte of the big-endian 64-bit load and left shift
+    // that puts the first bit on top, reversal of the parent already folded
+    // in. bitOffset is -1 if the element does not fit the bitfield
+    int bitOffset;
+    int bitShift;
+    // Offset in the frame if it does not depend on data, -1 otherwise
+    qint64 offset;
+    // Bytes taken including all elements if they do not depend on data
+    qint64 fixedSize;
+    // Custom fields: branch lookup table, -1 if there are no branches
+    int chooseTable;
+    // Formulas computing count, raw and skip size, seek position and the
+    // encoded value of a null number, NoRef if there are none
+    int countExpr;
+    int sizeExpr;
+    int posExpr;
+    int valueExpr;
+
+    Instruction()
+        : opcode(Opcode::None), bigEndian(false), isSigned(false),
+          reversed(false), include(false), countSource(false), size(0),
+          pos(-1), count(1), countRef(NoRef), dependRef(NoRef),
+          parentRef(NoRef), toRef(NoRef), lengthRef(NoRef), from(0),
+          parent(-1), end(0), bitOffset(-1), bitShift(0), offset(-1),
+          fixedSize(-1), chooseTable(-1), countExpr(NoRef), sizeExpr(NoRef),
+          posExpr(NoRef), valueExpr(NoRef) {}
+  };
+
+  CompiledSchema();
+
+  explicit CompiledSchema(const QVariantList &datafieldList);
+
+  static CompiledSchema compile(const QString &datafieldListStr);
+
+  bool isEmpty() const;
+
+  int size() const;
+
+  const Instruction &at(int index) const;
+
+  const QVector<Instruction> &instructions() const;
+
+  /**
+   * @brief crcFields Indices of crc instructions in schema order
+   */
+  const QVector<int> &crcFields() const;
+
+  /**
+   * @brief indexOf Index of the last instruction declared with name, -1 if
+   * there is none
+   */
+  int indexOf(const QString &name) const;
+
+  Layout layout() const;
+
+  /**
+   * @brief minSize Fewest bytes a frame is read from
+   */
+  qint64 minSize() const;
+
+  /**
+   * @brief maxSize Most bytes a frame is read from, -1 if unbounded
+   */
+  qint64 maxSize() const;
+
+  /**
+   * @brief fixedPrefixEnd First top-level instruction whose offset depends on
+   * data, size() for fixed layouts
+   */
+  int fixedPrefixEnd() const;
+
+  qint64 fixedPrefixSize() const;
+
+  /**
+   * @brief offsetOf Offset known at compile time, -1 if it depends on data or
+   * the field is nested in a counted struct
+   */
+  qint64 offsetOf(int index) const;
+
+  /**
+   * @brief chooseBranch Branch of custom field index selected by the depend
+   * value, -1 if no choose value matches. Integer choose values are found
+   * in one lookup, others are compared in choose order
+   */
+  int chooseBranch(int index, const FieldSlot &depend) const;
+
+  /**
+   * @brief expression Formula referenced by the countExpr, sizeExpr, posExpr
+   * or valueExpr of an instruction. Its names are bound to instruction
+   * indices, so it is evaluated over the slots of a decoder or encoder
+   */
+  const Expression &expression(int index) const;
+
+  static Opcode opcodeFromType(const QString &type);
+
+  static int valueSize(Opcode opcode);
+
+protected:
+  void compileList(const QVariantList &fieldList, int parent);
+
+  void compileField(const QString &name, const QVariantMap &description,
+                    int parent);
+
+  void compileBitfield(int index, const QVariantMap &description);
+
+  void compileCustom(int index, const QVariantMap &description);
+
+  void compileStruct(int index, const QVariantMap &description);
+
+  void compileChooseTable(int index);
+
+  int resolveRef(const QVariant &name) const;
+
+  /**
+   * @brief compileFormula Index of the formula in value, NoRef if value is a
+   * plain number and UnresolvedRef with a warning if it does not compile
+   */
+  int compileFormula(const QString &name, const QVariant &value);
+
+  void linkRefs();
+
+  void analyzeLayout();
+
+  void measure(int index, qint64 &minSize, qint64 &maxSize);
+
+  void assignOffset(int index, qint64 offset);
+
+private:
+  // Integer choose values map to branches through a dense array starting at
+  // base when they are close together and through a hash otherwise
+  struct ChooseTable {
+    qint64 base;
+    QVector<int> dense;
+    QHash<qint64, int> sparse;
+    QVector<int> other;
+
+    ChooseTable() : base(0) {}
+  };
+
+  QVector<Instruction> m_instructions;
+  QHash<QString, int> m_nameIndex;
+  QVector<int> m_crcFields;
+  QVector<ChooseTable> m_chooseTables;
+  QVector<Expression> m_expressions;
+  // Length references name later fields, resolved once all are compiled
+  QVector<QPair<int, QString>> m_lengthNames;
+
+  qint64 m_minSize;
+  qint64 m_maxSize;
+  int m_fixedPrefixEnd;
+  qint64 m_fixedPrefixSize;
+};
+
+} // namespace qbinarizer
+
+#endif // COMPILEDSCHEMA_H
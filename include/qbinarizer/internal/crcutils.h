@@ -0,0 +1,39 @@
+#ifndef CRCUTILS_H
+#define CRCUTILS_H
+
+#include <QtGlobal>
+
+#include "qbinarizer/export/qbinarizer_export.h"
+
+namespace qbinarizer {
+
+/**
+ * @brief crc32 CRC-32 (IEEE 802.3), same result as libcrc crc_32
+ */
+QBINARIZER_EXPORT quint32 crc32(const char *data, qsizetype size);
+
+/**
+ * @brief crc64We CRC-64/WE, same result as libcrc crc_64_we
+ */
+QBINARIZER_EXPORT quint64 crc64We(const char *data, qsizetype size);
+
+/**
+ * @brief crc32Update Feed data into a CRC-32 register. Start from
+ * crc32Init and pass the final register to crc32Final
+ */
+QBINARIZER_EXPORT quint32 crc32Update(quint32 crc, const char *data,
+                                      qsizetype size);
+
+QBINARIZER_EXPORT quint64 crc64WeUpdate(quint64 crc, const char *data,
+                                        qsizetype size);
+
+constexpr quint32 crc32Init = 0xffffffffu;
+constexpr quint64 crc64WeInit = 0xffffffffffffffffull;
+
+inline quint32 crc32Final(quint32 crc) { return ~crc; }
+
+inline quint64 crc64WeFinal(quint64 crc) { return ~crc; }
+
+} // namespace qbinarizer
+
+#endif // CRCUTILS_H
@@ -0,0 +1,158 @@
+#ifndef DECODESINK_H
+#define DECODESINK_H
+
+#include <QVariantList>
+#include <QVector>
+
+#include <cstring>
+
+#include "qbinarizer/export/qbinarizer_export.h"
+#include "qbinarizer/internal/compiledschema.h"
+
+namespace qbinarizer {
+
+/**
+ * @brief The PrimitiveArray struct Elements of a counted int8..int64, float
+ * or double field in host byte order. data points into the frame or into a
+ * decoder buffer and is valid only during DecodeSink::onArray
+ */
+struct QBINARIZER_EXPORT PrimitiveArray {
+  CompiledSchema::Opcode type;
+  const char *data;
+  int count;
+
+  static bool supports(CompiledSchema::Opcode type);
+
+  int elementSize() const { return CompiledSchema::valueSize(type); }
+
+  template <typename T> T at(int index) const {
+    T value;
+    std::memcpy(&value, data + index * sizeof(T), sizeof(T));
+
+    return value;
+  }
+
+  /**
+   * @brief toVector Copy into a typed container, T must match type
+   */
+  template <typename T> QVector<T> toVector() const {
+    Q_ASSERT(sizeof(T) == elementSize());
+
+    QVector<T> values(count);
+    std::memcpy(values.data(), data, count * sizeof(T));
+
+    return values;
+  }
+
+  /**
+   * @brief value Element as StructDecoder::decode reports it
+   */
+  QVariant value(int index) const;
+
+  QVariantList toVariantList() const;
+};
+
+/**
+ * @brief The DecodeSink class Receives decoded fields as StructDecoder walks
+ * the data. fieldId is the instruction index in the CompiledSchema, elements
+ * of counted fields are reported with the id of the field itself
+ */
+class QBINARIZER_EXPORT DecodeSink {
+public:
+  virtual ~DecodeSink();
+
+  virtual void beginMessage(const CompiledSchema &schema);
+
+  virtual void endMessage();
+
+  virtual void beginStruct(int fieldId);
+
+  virtual void endStruct(int fieldId);
+
+  virtual void beginArray(int fieldId, int count);
+
+  virtual void endArray(int fieldId);
+
+  /**
+   * @brief onArray Whole counted field of fixed-size numbers read in one go.
+   * Default implementation replays it as beginArray, per-element values and
+   * endArray
+   */
+  virtual void onArray(int fieldId, const PrimitiveArray &array);
+
+  /**
+   * @brief onValue Signed and narrow unsigned integers, unixtime in msecs,
+   * const fields with 1 if data matched and 0 otherwise
+   */
+  virtual void onValue(int fieldId, qint64 value);
+
+  /**
+   * @brief onUnsigned uint64, unsigned bitfield elements and computed crc
+   */
+  virtual void onUnsigned(int fieldId, quint64 value);
+
+  virtual void onDouble(int fieldId, double value);
+
+  /**
+   * @brief onBytes Raw fields, data points into the decoded frame
+   */
+  virtual void onBytes(int fieldId, const char *data, qsizetype size);
+
+  /**
+   * @brief onNull Skipped fields and bitfield elements out of range
+   */
+  virtual void onNull(int fieldId);
+};
+
+/**
+ * @brief The VariantListSink class Builds the QVariantList of single-key maps
+ * returned by StructDecoder::decode
+ */
+class QBINARIZER_EXPORT VariantListSink : public DecodeSink {
+public:
+  VariantListSink();
+
+  QVariantList result() const;
+
+  void beginMessage(const CompiledSchema &schema) override;
+
+  void beginStruct(int fieldId) override;
+
+  void endStruct(int fieldId) override;
+
+  void beginArray(int fieldId, int count) override;
+
+  void endArray(int fieldId) override;
+
+  void onArray(int fieldId, const PrimitiveArray &array) override;
+
+  void onValue(int fieldId, qint64 value) override;
+
+  void onUnsigned(int fieldId, quint64 value) override;
+
+  void onDouble(int fieldId, double value) override;
+
+  void onBytes(int fieldId, const char *data, qsizetype size) override;
+
+  void onNull(int fieldId) override;
+
+protected:
+  void deliver(int fieldId, const QVariant &value);
+
+private:
+  struct Frame {
+    bool isList;
+    QVariantMap map;
+    QVariantList list;
+
+    Frame() : isList(false) {}
+  };
+
+  const CompiledSchema *m_schema;
+  QVector<Frame> m_stack;
+  QVariantList m_resList;
+};
+
+} // namespace qbinarizer
+
+#endif // DECODESINK_H
@@ -0,0 +1,76 @@
+#ifndef ENCODEVALUES_H
+#define ENCODEVALUES_H
+
+#include <QVariant>
+#include <QVector>
+
+#include "qbinarizer/export/qbinarizer_export.h"
+#include "qbinarizer/internal/compiledschema.h"
+#include "qbinarizer/internal/fieldslot.h"
+
+namespace qbinarizer {
+
+/**
+ * @brief The EncodeValues class Input of StructEncoder keyed by field id, the
+ * instruction index in the CompiledSchema (see CompiledSchema::indexOf).
+ * Numbers are stored typed and written without QVariant conversion, strings,
+ * lists and maps are kept as QVariant. Nested fields take their own values
+ * instead of entries of the parent map
+ */
+class QBINARIZER_EXPORT EncodeValues {
+public:
+  EncodeValues();
+
+  explicit EncodeValues(const CompiledSchema &schema);
+
+  /**
+   * @brief reset Unset all values and size the table for schema
+   */
+  void reset(const CompiledSchema &schema);
+
+  int size() const;
+
+  /**
+   * @brief clear Unset all values, keeping the size
+   */
+  void clear();
+
+  void setInt(int fieldId, qint64 value);
+
+  void setUInt(int fieldId, quint64 value);
+
+  void setDouble(int fieldId, double value);
+
+  /**
+   * @brief setValue Raw (hex string), unixtime (ISO string), counted fields
+   * (list) or any other value as StructEncoder::encode takes it
+   */
+  void setValue(int fieldId, const QVariant &value);
+
+  void unset(int fieldId);
+
+  bool contains(int fieldId) const;
+
+  /**
+   * @brief slot Typed number of the field, null if it was not set by number
+   */
+  const FieldSlot &slot(int fieldId) const;
+
+  /**
+   * @brief value Value set by setValue, null for numbers
+   */
+  const QVariant &value(int fieldId) const;
+
+  /**
+   * @brief toVariant Value of the field whichever way it was set
+   */
+  QVariant toVariant(int fieldId) const;
+
+private:
+  QVector<FieldSlot> m_slots;
+  QVector<QVariant> m_values;
+};
+
+} // namespace qbinarizer
+
+#endif // ENCODEVALUES_H
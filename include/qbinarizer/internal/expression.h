@@ -0,0 +1,108 @@
+#ifndef EXPRESSION_H
+#define EXPRESSION_H
+
+#include <QString>
+#include <QVector>
+
+#include <functional>
+
+#include "qbinarizer/export/qbinarizer_export.h"
+#include "qbinarizer/internal/fieldslot.h"
+
+namespace qbinarizer {
+
+/**
+ * @brief The Expression class Arithmetic formula compiled once into stack
+ * bytecode. Names are bound to slot indices at compile time, so evaluation
+ * reads slots directly without string lookups
+ */
+class QBINARIZER_EXPORT Expression {
+public:
+  enum class Op : quint8 {
+    Const,
+    Slot,
+    Neg,
+    Add,
+    Sub,
+    Mul,
+    Div,
+    Mod,
+    Pow,
+    Abs,
+    Ceil,
+    Floor,
+    Round,
+    Sqrt,
+    Min,
+    Max
+  };
+
+  struct Instruction {
+    Op op;
+    int slot;
+    double value;
+  };
+
+  // Evaluation stack size, deeper formulas do not compile
+  static constexpr int MaxDepth = 32;
+
+  /**
+   * @brief Resolver Slot index of a name, negative if there is none
+   */
+  using Resolver = std::function<int(const QString &name)>;
+
+  Expression();
+
+  /**
+   * @brief compile Supports + - * / % ^, unary minus, parentheses, numbers
+   * and abs, ceil, floor, round, sqrt, min, max, pow calls. Returns an
+   * invalid expression and sets error if text does not parse or a name is
+   * not resolved
+   */
+  static Expression compile(const QString &text, const Resolver &resolver,
+                            QString *error = nullptr);
+
+  bool isValid() const;
+
+  /**
+   * @brief isConstant The formula reads no slots
+   */
+  bool isConstant() const;
+
+  QString text() const;
+
+  const QVector<Instruction> &code() const;
+
+  /**
+   * @brief slotRefs Distinct slot indices the formula reads
+   */
+  const QVector<int> &slotRefs() const;
+
+  /**
+   * @brief eval False if the expression is invalid or a slot it reads is not
+   * visited or null
+   */
+  bool eval(const FieldSlot *slots, double &value) const;
+
+  /**
+   * @brief evalInt Integer part of the value, false if it is not finite or
+   * out of the qint64 range
+   */
+  bool evalInt(const FieldSlot *slots, qint64 &value) const;
+
+  static double apply(Op op, double value);
+
+  static double apply(Op op, double left, double right);
+
+private:
+  friend class ExpressionParser;
+
+  QString m_text;
+  QVector<Instruction> m_code;
+  QVector<int> m_slotRefs;
+  bool m_valid;
+};
+
+} // namespace qbinarizer
+
+#endif // EXPRESSION_H
@@ -0,0 +1,127 @@
+#ifndef FIELDSLOT_H
+#define FIELDSLOT_H
+
+#include <QVariant>
+#include <QtGlobal>
+
+namespace qbinarizer {
+
+/**
+ * @brief The FieldSlot struct Last value of a field kept by instruction index,
+ * so count, depend, parent and to references are array lookups. from is the
+ * offset the field starts at, -1 until the field is visited
+ */
+struct FieldSlot {
+  enum class Type : quint8 { Null, Int, UInt, Double };
+
+  qint64 from;
+  Type type;
+  union {
+    qint64 i;
+    quint64 u;
+    double d;
+  };
+
+  FieldSlot() : from(-1), type(Type::Null), i(0) {}
+
+  static FieldSlot fromVariant(const QVariant &value) {
+    FieldSlot slot;
+
+    switch (value.userType()) {
+    case QMetaType::UnknownType:
+      break;
+    case QMetaType::ULongLong:
+      slot.setUInt(value.toULongLong());
+      break;
+    case QMetaType::Double:
+    case QMetaType::Float:
+      slot.setDouble(value.toDouble());
+      break;
+    default:
+      slot.setInt(value.toLongLong());
+      break;
+    }
+
+    return slot;
+  }
+
+  bool isVisited() const { return from >= 0; }
+
+  bool isNull() const { return type == Type::Null; }
+
+  void setNull() {
+    type = Type::Null;
+    i = 0;
+  }
+
+  void setInt(qint64 value) {
+    type = Type::Int;
+    i = value;
+  }
+
+  void setUInt(quint64 value) {
+    type = Type::UInt;
+    u = value;
+  }
+
+  void setDouble(double value) {
+    type = Type::Double;
+    d = value;
+  }
+
+  qint64 toInt() const {
+    switch (type) {
+    case Type::Int:
+      return i;
+    case Type::UInt:
+      return static_cast<qint64>(u);
+    case Type::Double:
+      return qRound64(d);
+    default:
+      return 0;
+    }
+  }
+
+  quint64 toUInt() const {
+    switch (type) {
+    case Type::Int:
+      return static_cast<quint64>(i);
+    case Type::UInt:
+      return u;
+    case Type::Double:
+      return static_cast<quint64>(qRound64(d));
+    default:
+      return 0;
+    }
+  }
+
+  double toDouble() const {
+    switch (type) {
+    case Type::Int:
+      return static_cast<double>(i);
+    case Type::UInt:
+      return static_cast<double>(u);
+    case Type::Double:
+      return d;
+    default:
+      return 0.0;
+    }
+  }
+
+  QVariant toVariant() const {
+    switch (type) {
+    case Type::Int:
+      return i;
+    case Type::UInt:
+      return u;
+    case Type::Double:
+      return d;
+    default:
+      return QVariant();
+    }
+  }
+};
+
+} // namespace qbinarizer
+
+#endif // FIELDSLOT_H
@@ -0,0 +1,117 @@
+#ifndef MESSAGEVIEW_H
+#define MESSAGEVIEW_H
+
+#include <QByteArray>
+#include <QVariant>
+#include <QVector>
+
+#include "qbinarizer/export/qbinarizer_export.h"
+#include "qbinarizer/internal/compiledschema.h"
+
+namespace qbinarizer {
+
+/**
+ * @brief The MessageView class Random access to single fields of a frame.
+ * Offsets are found on first access by stepping over the top-level fields in
+ * front of the requested one, only count and depend fields are decoded on
+ * the way. The frame memory is not copied and must outlive the view
+ */
+class QBINARIZER_EXPORT MessageView {
+public:
+  MessageView(const CompiledSchema &schema, const char *data, qsizetype size);
+
+  MessageView(const CompiledSchema &schema, const QByteArray &data);
+
+  const CompiledSchema &schema() const;
+
+  /**
+   * @brief contains True if the field is present in this frame, fields of a
+   * custom branch that was not chosen or with an unresolved count are not
+   */
+  bool contains(int fieldId);
+
+  bool contains(const QString &name);
+
+  /**
+   * @brief offset Byte offset of the first element, -1 if not present.
+   * Fields nested in a counted struct report their last element
+   */
+  qsizetype offset(int fieldId);
+
+  qsizetype offset(const QString &name);
+
+  /**
+   * @brief count Number of elements, 0 if not present
+   */
+  int count(int fieldId);
+
+  int count(const QString &name);
+
+  /**
+   * @brief value Element of a number, unixtime (msecs), const (1 if data
+   * matched), crc (as stored), raw or bitfield element field. Elements past
+   * the first are available for fixed-size fields only
+   */
+  QVariant value(int fieldId, int element = 0);
+
+  QVariant value(const QString &name, int element = 0);
+
+  qint64 toInt(int fieldId, int element = 0);
+
+  qint64 toInt(const QString &name, int element = 0);
+
+  quint64 toUInt(int fieldId, int element = 0);
+
+  quint64 toUInt(const QString &name, int element = 0);
+
+  double toDouble(int fieldId, int element = 0);
+
+  double toDouble(const QString &name, int element = 0);
+
+  /**
+   * @brief toBytes Bytes of the element without copying them
+   */
+  QByteArray toBytes(int fieldId, int element = 0);
+
+  QByteArray toBytes(const QString &name, int element = 0);
+
+protected:
+  void ensure(int fieldId);
+
+  void measureField(int index);
+
+  void measureElement(int index);
+
+  void advance(qsizetype size);
+
+  int elementSize(int index) const;
+
+  FieldSlot slotValue(int index);
+
+  /**
+   * @brief evalFormula Integer part of a schema formula, operands are read
+   * from the frame. False if one of them is not present
+   */
+  bool evalFormula(int expr, qint64 &value);
+
+  QVariant read(int index, int element);
+
+private:
+  CompiledSchema m_schema;
+  const char *m_data;
+  qsizetype m_size;
+
+  qsizetype m_pos;
+  int m_next;
+  QVector<qsizetype> m_offsets;
+  QVector<int> m_counts;
+  // Allocated on the first formula only: operand values and element sizes
+  // of raw and skip fields sized by a formula
+  QVector<FieldSlot> m_slots;
+  QVector<int> m_sizes;
+  QByteArray m_scratch;
+};
+
+} // namespace qbinarizer
+
+#endif // MESSAGEVIEW_H
@@ -0,0 +1,59 @@
+#ifndef SCHEMACACHE_H
+#define SCHEMACACHE_H
+
+#include <QCache>
+#include <QMutex>
+#include <QString>
+#include <QVariantList>
+
+#include "qbinarizer/export/qbinarizer_export.h"
+#include "qbinarizer/internal/compiledschema.h"
+
+namespace qbinarizer {
+
+/**
+ * @brief The SchemaCache class Thread-safe LRU cache of parsed and compiled
+ * schemas keyed by schema text, used by the QString overloads of
+ * StructDecoder::decode and StructEncoder::encode
+ */
+class QBINARIZER_EXPORT SchemaCache {
+public:
+  explicit SchemaCache(int capacity = 64);
+
+  static SchemaCache &globalInstance();
+
+  QVariantList parsed(const QString &datafieldListStr);
+
+  CompiledSchema compiled(const QString &datafieldListStr);
+
+  int capacity() const;
+
+  void setCapacity(int capacity);
+
+  quint64 hits() const;
+
+  quint64 misses() const;
+
+  /**
+   * @brief clear Drop all entries and reset counters
+   */
+  void clear();
+
+protected:
+  struct Entry {
+    QVariantList parsed;
+    CompiledSchema compiled;
+  };
+
+  Entry lookup(const QString &datafieldListStr);
+
+private:
+  mutable QMutex m_mutex;
+  QCache<QString, Entry> m_cache;
+  quint64 m_hits;
+  quint64 m_misses;
+};
+
+} // namespace qbinarizer
+
+#endif // SCHEMACACHE_H
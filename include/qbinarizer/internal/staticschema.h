@@ -0,0 +1,629 @@
+#ifndef STATICSCHEMA_H
+#define STATICSCHEMA_H
+
+#include <QByteArray>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QVariantList>
+#include <QVariantMap>
+
+#include <array>
+#include <cstring>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+#include "qbinarizer/internal/bytecursor.h"
+#include "qbinarizer/internal/crcutils.h"
+
+/**
+ * @brief QBINARIZER_NAME Declares the field name used as a template argument,
+ * QBINARIZER_NAME(trk) makes trk usable as Field<trk, quint16>
+ */
+#define QBINARIZER_NAME(name) inline constexpr char name[] = #name
+
+namespace qbinarizer {
+
+// Wire layouts declared in C++ and resolved by templates. Every field has a
+// size known at compile time, so a Struct encodes and decodes with constant
+// offsets and no type dispatch. Type names and value semantics are those of
+// StructEncoder/StructDecoder, and Struct::description() gives the equivalent
+// field description for CompiledSchema
+
+struct LittleEndian {
+  static constexpr bool bigEndian = false;
+};
+
+struct BigEndian {
+  static constexpr bool bigEndian = true;
+};
+
+/** @brief Int24 Field type of a signed 24-bit value held in qint32 */
+struct Int24 {};
+
+/** @brief UInt24 Field type of an unsigned 24-bit value held in quint32 */
+struct UInt24 {};
+
+/** @brief Unixtime Field type of milliseconds since the epoch in qint64 */
+struct Unixtime {};
+
+/** @brief NoValue Value of fields carrying no data */
+struct NoValue {
+  bool operator==(const NoValue &) const { return true; }
+  bool operator!=(const NoValue &) const { return false; }
+};
+
+/**
+ * @brief The WireType struct Load/store and description of a value type.
+ * Specialized for numbers, anything else is taken as a nested Struct
+ */
+template <typename T> struct WireType {
+  using Value = typename T::Value;
+
+  static constexpr qsizetype size = T::size;
+
+  static void encodeAt(char *frame, qsizetype pos, const Value &value, bool) {
+    T::encodeAt(frame, pos, value);
+  }
+
+  static void decodeAt(const char *frame, qsizetype pos, Value &value, bool) {
+    T::decodeAt(frame, pos, value);
+  }
+
+  static QVariantMap description(bool) { return T::typeDescription(); }
+};
+
+template <typename T, const char *TypeName> struct NumberWireType {
+  using Value = T;
+
+  static constexpr qsizetype size = sizeof(T);
+
+  static void encodeAt(char *frame, qsizetype pos, const Value &value,
+                       bool bigEndian) {
+    storeValue<T>(frame + pos, value, bigEndian);
+  }
+
+  static void decodeAt(const char *frame, qsizetype pos, Value &value,
+                       bool bigEndian) {
+    value = loadValue<T>(frame + pos, bigEndian);
+  }
+
+  static QVariantMap description(bool bigEndian) {
+    QVariantMap description{{"type", TypeName}};
+    if (bigEndian) {
+      description["endian"] = "big";
+    }
+
+    return description;
+  }
+};
+
+namespace typenames {
+inline constexpr char int8[] = "int8";
+inline constexpr char uint8[] = "uint8";
+inline constexpr char int16[] = "int16";
+inline constexpr char uint16[] = "uint16";
+inline constexpr char int32[] = "int32";
+inline constexpr char uint32[] = "uint32";
+inline constexpr char int64[] = "int64";
+inline constexpr char uint64[] = "uint64";
+inline constexpr char float32[] = "float";
+inline constexpr char float64[] = "double";
+inline constexpr char unixtime[] = "unixtime";
+} // namespace typenames
+
+template <>
+struct WireType<qint8> : NumberWireType<qint8, typenames::int8> {};
+template <>
+struct WireType<quint8> : NumberWireType<quint8, typenames::uint8> {};
+template <>
+struct WireType<qint16> : NumberWireType<qint16, typenames::int16> {};
+template <>
+struct WireType<quint16> : NumberWireType<quint16, typenames::uint16> {};
+template <>
+struct WireType<qint32> : NumberWireType<qint32, typenames::int32> {};
+template <>
+struct WireType<quint32> : NumberWireType<quint32, typenames::uint32> {};
+template <>
+struct WireType<qint64> : NumberWireType<qint64, typenames::int64> {};
+template <>
+struct WireType<quint64> : NumberWireType<quint64, typenames::uint64> {};
+template <>
+struct WireType<float> : NumberWireType<float, typenames::float32> {};
+template <>
+struct WireType<double> : NumberWireType<double, typenames::float64> {};
+template <>
+struct WireType<Unixtime> : NumberWireType<qint64, typenames::unixtime> {};
+
+template <> struct WireType<Int24> {
+  using Value = qint32;
+
+  static constexpr qsizetype size = 3;
+
+  static void encodeAt(char *frame, qsizetype pos, const Value &value,
+                       bool bigEndian) {
+    storeUInt24(frame + pos, static_cast<quint32>(value), bigEndian);
+  }
+
+  static void decodeAt(const char *frame, qsizetype pos, Value &value,
+                       bool bigEndian) {
+    value = static_cast<qint32>(loadUInt24(frame + pos, bigEndian) << 8) >> 8;
+  }
+
+  static QVariantMap description(bool bigEndian) {
+    QVariantMap description{{"type", "int24"}};
+    if (bigEndian) {
+      description["endian"] = "big";
+    }
+
+    return description;
+  }
+};
+
+template <> struct WireType<UInt24> {
+  using Value = quint32;
+
+  static constexpr qsizetype size = 3;
+
+  static void encodeAt(char *frame, qsizetype pos, const Value &value,
+                       bool bigEndian) {
+    storeUInt24(frame + pos, value, bigEndian);
+  }
+
+  static void decodeAt(const char *frame, qsizetype pos, Value &value,
+                       bool bigEndian) {
+    value = loadUInt24(frame + pos, bigEndian);
+  }
+
+  static QVariantMap description(bool bigEndian) {
+    QVariantMap description{{"type", "uint24"}};
+    if (bigEndian) {
+      description["endian"] = "big";
+    }
+
+    return description;
+  }
+};
+
+/**
+ * @brief The Field struct Single value: a number, Int24, UInt24, Unixtime or
+ * a nested Struct
+ */
+template <const char *Name, typename T, typename Endian = LittleEndian>
+struct Field {
+  using Value = typename WireType<T>::Value;
+
+  static constexpr const char *name = Name;
+  static constexpr qsizetype size = WireType<T>::size;
+
+  static void encodeAt(char *frame, qsizetype pos, const Value &value) {
+    WireType<T>::encodeAt(frame, pos, value, Endian::bigEndian);
+  }
+
+  static void decodeAt(const char *frame, qsizetype pos, Value &value) {
+    WireType<T>::decodeAt(frame, pos, value, Endian::bigEndian);
+  }
+
+  static QVariantMap description() {
+    return WireType<T>::description(Endian::bigEndian);
+  }
+};
+
+/**
+ * @brief The Array struct Count values of the same type back to back
+ */
+template <const char *Name, typename T, int Count,
+          typename Endian = LittleEndian>
+struct Array {
+  static_assert(Count > 0, "Array needs at least one element");
+
+  using Value = std::array<typename WireType<T>::Value, Count>;
+
+  static constexpr const char *name = Name;
+  static constexpr qsizetype size = WireType<T>::size * Count;
+
+  static void encodeAt(char *frame, qsizetype pos, const Value &value) {
+    for (int i = 0; i < Count; i++) {
+      WireType<T>::encodeAt(frame, pos + i * WireType<T>::size, value[i],
+                            Endian::bigEndian);
+    }
+  }
+
+  static void decodeAt(const char *frame, qsizetype pos, Value &value) {
+    for (int i = 0; i < Count; i++) {
+      WireType<T>::decodeAt(frame, pos + i * WireType<T>::size, value[i],
+                            Endian::bigEndian);
+    }
+  }
+
+  static QVariantMap description() {
+    QVariantMap description = WireType<T>::description(Endian::bigEndian);
+    if (Count > 1) {
+      description["count"] = Count;
+    }
+
+    return description;
+  }
+};
+
+/**
+ * @brief The Const struct Fixed bytes, written on encode. Decoding gives
+ * whether the bytes matched, like StructDecoder
+ */
+template <const char *Name, uchar... Bytes> struct Const {
+  static_assert(sizeof...(Bytes) > 0, "Const needs at least one byte");
+
+  using Value = bool;
+
+  static constexpr const char *name = Name;
+  static constexpr qsizetype size = sizeof...(Bytes);
+
+  static void encodeAt(char *frame, qsizetype pos, const Value &) {
+    std::memcpy(frame + pos, bytes, size);
+  }
+
+  static void decodeAt(const char *frame, qsizetype pos, Value &value) {
+    value = (std::memcmp(frame + pos, bytes, size) == 0);
+  }
+
+  static QVariantMap description() {
+    const QByteArray data(bytes, size);
+
+    return {{"type", "const"},
+            {"size", static_cast<int>(size)},
+            {"value", QString::fromLatin1(data.toHex())}};
+  }
+
+private:
+  static constexpr char bytes[] = {static_cast<char>(Bytes)...};
+};
+
+/**
+ * @brief The Raw struct Size bytes taken as they are
+ */
+template <const char *Name, int Size> struct Raw {
+  using Value = std::array<quint8, Size>;
+
+  static constexpr const char *name = Name;
+  static constexpr qsizetype size = Size;
+
+  static void encodeAt(char *frame, qsizetype pos, const Value &value) {
+    std::memcpy(frame + pos, value.data(), size);
+  }
+
+  static void decodeAt(const char *frame, qsizetype pos, Value &value) {
+    std::memcpy(value.data(), frame + pos, size);
+  }
+
+  static QVariantMap description() {
+    return {{"type", "raw"}, {"size", Size}};
+  }
+};
+
+/**
+ * @brief The Skip struct Size zero bytes on encode, ignored on decode
+ */
+template <const char *Name, int Size> struct Skip {
+  using Value = NoValue;
+
+  static constexpr const char *name = Name;
+  static constexpr qsizetype size = Size;
+
+  static void encodeAt(char *frame, qsizetype pos, const Value &) {
+    std::memset(frame + pos, 0, size);
+  }
+
+  static void decodeAt(const char *, qsizetype, Value &) {}
+
+  static QVariantMap description() {
+    return {{"type", "skip"}, {"size", Size}};
+  }
+};
+
+/**
+ * @brief The Bits struct Bitfield element of Size bits starting at bit Pos
+ */
+template <const char *Name, int Pos, int Size, bool Signed = false>
+struct Bits {
+  static_assert((Size > 0) && (Size <= 64), "Bits size must be 1..64");
+
+  using Value = std::conditional_t<Signed, qint64, quint64>;
+
+  static constexpr const char *name = Name;
+  static constexpr int pos = Pos;
+  static constexpr int size = Size;
+  static constexpr quint64 mask = (Size >= 64) ? ~0ull : (1ull << Size) - 1;
+
+  // bits is padded by 9 bytes as extractBits/insertBits expect
+  template <int BitCount, bool Reversed>
+  static void encodeAt(char *bits, const Value &value) {
+    constexpr int first = Reversed ? BitCount - Pos - Size : Pos;
+
+    // Like StructEncoder, unsigned values wider than the element are not
+    // written
+    if (!Signed && (static_cast<quint64>(value) > mask)) {
+      return;
+    }
+
+    insertBits(bits + first / CHAR_WIDTH, first % CHAR_WIDTH, Size, Reversed,
+               static_cast<quint64>(value) & mask);
+  }
+
+  template <int BitCount, bool Reversed>
+  static void decodeAt(const char *bits, Value &value) {
+    constexpr int first = Reversed ? BitCount - Pos - Size : Pos;
+
+    const quint64 valueU =
+        extractBits(bits + first / CHAR_WIDTH, first % CHAR_WIDTH, Size,
+                    Reversed);
+    if (!Signed || (Size >= 64)) {
+      value = static_cast<Value>(valueU);
+
+      return;
+    }
+
+    constexpr int unused = 64 - Size;
+    value = static_cast<Value>(static_cast<qint64>(valueU << unused) >> unused);
+  }
+
+  static QVariantMap description() {
+    QVariantMap description{{"pos", Pos}, {"size", Size}};
+    if (Signed) {
+      description["signed"] = true;
+    }
+
+    return description;
+  }
+};
+
+/**
+ * @brief The BitfieldBase struct Size bytes split into Bits elements, bit 0
+ * is the most significant bit of the first byte unless Reversed
+ */
+template <const char *Name, int Size, bool Reversed, typename... Elements>
+struct BitfieldBase {
+  static_assert(sizeof...(Elements) > 0, "Bitfield needs elements");
+  static_assert(((Elements::pos + Elements::size <= Size * CHAR_WIDTH) &&
+                 ...),
+                "Bits do not fit the bitfield");
+
+  using Value = std::tuple<typename Elements::Value...>;
+
+  static constexpr const char *name = Name;
+  static constexpr qsizetype size = Size;
+
+  static void encodeAt(char *frame, qsizetype pos, const Value &value) {
+    char bits[Size + sizeof(quint64) + 1] = {};
+    encodeElements(bits, value, std::index_sequence_for<Elements...>());
+    std::memcpy(frame + pos, bits, Size);
+  }
+
+  static void decodeAt(const char *frame, qsizetype pos, Value &value) {
+    char bits[Size + sizeof(quint64) + 1] = {};
+    std::memcpy(bits, frame + pos, Size);
+    decodeElements(bits, value, std::index_sequence_for<Elements...>());
+  }
+
+  static QVariantMap description() {
+    QVariantMap spec;
+    ((spec[Elements::name] = Elements::description()), ...);
+
+    QVariantMap description{{"type", "bitfield"}, {"size", Size}};
+    if (Reversed) {
+      description["reversed"] = true;
+    }
+    description["spec"] = spec;
+
+    return description;
+  }
+
+private:
+  template <std::size_t... I>
+  static void encodeElements(char *bits, const Value &value,
+                             std::index_sequence<I...>) {
+    (Elements::template encodeAt<Size * CHAR_WIDTH, Reversed>(
+         bits, std::get<I>(value)),
+     ...);
+  }
+
+  template <std::size_t... I>
+  static void decodeElements(const char *bits, Value &value,
+                             std::index_sequence<I...>) {
+    (Elements::template decodeAt<Size * CHAR_WIDTH, Reversed>(
+         bits, std::get<I>(value)),
+     ...);
+  }
+};
+
+template <const char *Name, int Size, typename... Elements>
+using Bitfield = BitfieldBase<Name, Size, false, Elements...>;
+
+template <const char *Name, int Size, typename... Elements>
+using ReversedBitfield = BitfieldBase<Name, Size, true, Elements...>;
+
+/**
+ * @brief The CrcBase struct Checksum of the frame bytes from From up to the
+ * field. Decoding gives the checksum computed over the data, like
+ * StructDecoder, not the stored one
+ */
+template <const char *Name, typename T, typename Endian, qint64 From,
+          T (*Checksum)(const char *, qsizetype), const char *TypeName>
+struct CrcBase {
+  using Value = T;
+
+  static constexpr const char *name = Name;
+  static constexpr qsizetype size = sizeof(T);
+
+  static void encodeAt(char *frame, qsizetype pos, const Value &) {
+    storeValue<T>(frame + pos, checksum(frame, pos), Endian::bigEndian);
+  }
+
+  static void decodeAt(const char *frame, qsizetype pos, Value &value) {
+    value = checksum(frame, pos);
+  }
+
+  static QVariantMap description() {
+    QVariantMap description{{"type", TypeName}};
+    if (Endian::bigEndian) {
+      description["endian"] = "big";
+    }
+    if (From != 0) {
+      description["from"] = From;
+    }
+
+    return description;
+  }
+
+private:
+  static T checksum(const char *frame, qsizetype pos) {
+    return (From < pos) ? Checksum(frame + From, pos - From) : T(0);
+  }
+};
+
+namespace typenames {
+inline constexpr char crc32[] = "crc32";
+inline constexpr char crc64[] = "crc64";
+} // namespace typenames
+
+template <const char *Name, typename Endian = LittleEndian, qint64 From = 0>
+using Crc32 = CrcBase<Name, quint32, Endian, From, qbinarizer::crc32,
+                      typenames::crc32>;
+
+template <const char *Name, typename Endian = LittleEndian, qint64 From = 0>
+using Crc64 =
+    CrcBase<Name, quint64, Endian, From, crc64We, typenames::crc64>;
+
+/**
+ * @brief The Struct class Fields one after another. Value is a tuple of the
+ * field values, also reachable by name with get<name>()
+ */
+template <typename... Fields> class Struct {
+public:
+  struct Value : std::tuple<typename Fields::Value...> {
+    template <const char *Name> auto &get() {
+      static_assert(indexOf<Name>() < sizeof...(Fields), "No such field");
+
+      return std::get<indexOf<Name>()>(*this);
+    }
+
+    template <const char *Name> const auto &get() const {
+      static_assert(indexOf<Name>() < sizeof...(Fields), "No such field");
+
+      return std::get<indexOf<Name>()>(*this);
+    }
+  };
+
+  static constexpr qsizetype size = (Fields::size + ... + 0);
+
+  /**
+   * @brief indexOf Position of the field declared with name
+   */
+  template <const char *Name> static constexpr std::size_t indexOf() {
+    // Compared as template arguments, pointer equality of distinct names is
+    // not a constant expression for every compiler
+    constexpr bool matches[] = {
+        std::is_same_v<std::integral_constant<const char *, Fields::name>,
+                       std::integral_constant<const char *, Name>>...,
+        false};
+
+    std::size_t index = 0;
+    while ((index < sizeof...(Fields)) && !matches[index]) {
+      index++;
+    }
+
+    return index;
+  }
+
+  /**
+   * @brief encode Writes size bytes to data, returns size or -1 if capacity is
+   * too small
+   */
+  static qsizetype encode(const Value &value, char *data, qsizetype capacity) {
+    if (capacity < size) {
+      return -1;
+    }
+
+    encodeAt(data, 0, value);
+
+    return size;
+  }
+
+  static QByteArray encode(const Value &value) {
+    QByteArray data(size, Qt::Uninitialized);
+    encodeAt(data.data(), 0, value);
+
+    return data;
+  }
+
+  /**
+   * @brief decode Reads size bytes from data, returns size or -1 if there are
+   * fewer
+   */
+  static qsizetype decode(const char *data, qsizetype dataSize, Value &value) {
+    if (dataSize < size) {
+      return -1;
+    }
+
+    decodeAt(data, 0, value);
+
+    return size;
+  }
+
+  static qsizetype decode(const QByteArray &data, Value &value) {
+    return decode(data.constData(), data.size(), value);
+  }
+
+  /**
+   * @brief description Equivalent field description for CompiledSchema,
+   * StructEncoder and StructDecoder
+   */
+  static QVariantList description() {
+    return {QVariantMap{{Fields::name, Fields::description()}}...};
+  }
+
+  static QByteArray toJson() {
+    return QJsonDocument(QJsonArray::fromVariantList(description()))
+        .toJson(QJsonDocument::Compact);
+  }
+
+  // Used when the Struct is nested, pos is the offset in the whole frame
+  static void encodeAt(char *frame, qsizetype pos, const Value &value) {
+    encodeFields(frame, pos, value, std::index_sequence_for<Fields...>());
+  }
+
+  static void decodeAt(const char *frame, qsizetype pos, Value &value) {
+    decodeFields(frame, pos, value, std::index_sequence_for<Fields...>());
+  }
+
+  static QVariantMap typeDescription() {
+    return {{"type", "struct"}, {"spec", description()}};
+  }
+
+private:
+  template <std::size_t Index> static constexpr qsizetype offsetOf() {
+    constexpr qsizetype sizes[] = {Fields::size..., 0};
+
+    qsizetype offset = 0;
+    for (std::size_t i = 0; i < Index; i++) {
+      offset += sizes[i];
+    }
+
+    return offset;
+  }
+
+  template <std::size_t... I>
+  static void encodeFields(char *frame, qsizetype pos, const Value &value,
+                           std::index_sequence<I...>) {
+    (Fields::encodeAt(frame, pos + offsetOf<I>(), std::get<I>(value)), ...);
+  }
+
+  template <std::size_t... I>
+  static void decodeFields(const char *frame, qsizetype pos, Value &value,
+                           std::index_sequence<I...>) {
+    (Fields::decodeAt(frame, pos + offsetOf<I>(), std::get<I>(value)), ...);
+  }
+};
+
+} // namespace qbinarizer
+
+#endif // STATICSCHEMA_H
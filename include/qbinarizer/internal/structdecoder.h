@@ -1,13 +1,15 @@
 #ifndef STRUCTDECODER_H
 #define STRUCTDECODER_H
 
-#include <QBuffer>
 #include <QByteArray>
-#include <QDataStream>
 #include <QObject>
 #include <QVariantMap>
 
 #include "qbinarizer/export/qbinarizer_export.h"
+#include "qbinarizer/internal/bytecursor.h"
+#include "qbinarizer/internal/compiledschema.h"
+#include "qbinarizer/internal/decodesink.h"
+#include "qbinarizer/internal/fieldslot.h"
 
 namespace qbinarizer {
 
@@ -21,6 +23,30 @@ public:
   QVariantList decode(const QVariantList &datafieldList,
                       const QByteArray &data);
 
+  /**
+   * @brief decode Decode data in place, it must stay valid during the call
+   */
+  QVariantList decode(const QVariantList &datafieldList, const char *data,
+                      qsizetype size);
+
+  /**
+   * @brief decode Execute precompiled schema, description maps are not touched
+   */
+  QVariantList decode(const CompiledSchema &schema, const QByteArray &data);
+
+  QVariantList decode(const CompiledSchema &schema, const char *data,
+                      qsizetype size);
+
+  /**
+   * @brief decode Report decoded fields to sink without building a
+   * QVariantList
+   */
+  void decode(const CompiledSchema &schema, const QByteArray &data,
+              DecodeSink &sink);
+
+  void decode(const CompiledSchema &schema, const char *data, qsizetype size,
+              DecodeSink &sink);
+
   /**
    * @brief clear Clear internal state of object
    */
@@ -29,53 +55,62 @@ public:
   static QVariantList extractValues(const QVariant &value);
 
 protected:
-  void decode();
+  void execList(int first, int end);
+
+  void execFixed(int first, int end);
 
-  QVariant parse(const QVariant &datafield);
+  bool execFixedValue(int index);
 
-  QVariantMap decodeMap(const QVariantMap &field);
+  void execField(int index);
 
-  QVariantList decodeList(const QVariantList &fieldList);
+  void execElement(int index);
 
-  QVariantMap decodeBitfield(const QVariantMap &field);
+  bool execArray(int index, int count);
 
-  QVariant decodeBitfieldElement(const QVariantMap &field,
-                                 const QByteArray &data);
+  qsizetype elementSize(int index) const;
 
-  QVariantMap decodeStruct(const QVariantMap &field);
+  void execValue(int index);
 
-  QVariantMap decodeCustom(const QVariantMap &field);
+  void execBitfield(int index);
 
-  QVariantMap decodeRaw(const QVariantMap &field);
+  void execCustom(int index);
 
-  QVariantMap decodeSkip(const QVariantMap &field);
+  void execStruct(int index);
 
-  QVariantMap decodeValue(const QVariantMap &field);
+  void execCrc(int index);
 
-  QVariantMap decodeCrc(const QVariantMap &field);
+  void openCrcRegions();
 
-  QVariantMap decodeUnixtime(const QVariantMap &field);
+  void advanceCrcRegions();
 
-  QVariantMap decodeConst(const QVariantMap &field);
+  bool takeCrcRegion(int index, qint64 from, qint64 to, quint64 &crc);
 
-  void updateEncodedTo(const QString &name);
+  void setValue(int index, qint64 value);
 
-  QVariant getDecodedValue(const QString &name) const;
+  void setUnsigned(int index, quint64 value);
 
-  QVariant generateDecodedValue(const QString &name, const QVariant &value);
+  void setDouble(int index, double value);
 
-  void setDecodedValue(const QString &name, const QVariant &value);
+  void setSlot(int index, const PrimitiveArray &array);
 
 private:
-  QString m_name;
-  QVariantList m_datafieldList;
-  int m_pos;
-
-  QBuffer m_buf;
-  QDataStream m_ds;
-  QByteArray m_data;
-  QVariantList m_resList;
-  QVariantMap m_decodedFields;
+  // Running crc32/crc64 register over [from, covered) of a crc field that is
+  // not reached yet, from is -1 until the parent field starts
+  struct CrcRegion {
+    int index;
+    qint64 from;
+    qint64 covered;
+    quint64 state;
+  };
+
+  CompiledSchema m_schema;
+  DecodeSink *m_sink;
+
+  ByteReader m_reader;
+  QByteArray m_scratch;
+  QByteArray m_arrayBuffer;
+  QVector<FieldSlot> m_slots;
+  QVector<CrcRegion> m_crcRegions;
 };
 
 } // namespace qbinarizer
@@ -1,13 +1,15 @@
 #ifndef STRUCTENCODER_H
 #define STRUCTENCODER_H
 
-#include <QBuffer>
 #include <QByteArray>
-#include <QDataStream>
 #include <QObject>
 #include <QVariantList>
 
 #include "qbinarizer/export/qbinarizer_export.h"
+#include "qbinarizer/internal/bytecursor.h"
+#include "qbinarizer/internal/compiledschema.h"
+#include "qbinarizer/internal/encodevalues.h"
+#include "qbinarizer/internal/fieldslot.h"
 
 namespace qbinarizer {
 
@@ -24,53 +26,202 @@ public:
   encode(const QVariantList &datafieldList,
          const QVariantList &valueList = QVariantList());
 
+  /**
+   * @brief encode Execute precompiled schema, description maps are not
+   * touched. Values listed in schema order are matched in one pass, others
+   * through a name index built on the first miss
+   */
+  std::tuple<QByteArray, QVariantList>
+  encode(const CompiledSchema &schema,
+         const QVariantList &valueList = QVariantList());
+
+  /**
+   * @brief encode Take values by field id, no names are compared
+   */
+  std::tuple<QByteArray, QVariantList> encode(const CompiledSchema &schema,
+                                              const EncodeValues &values);
+
+  /**
+   * @brief encodeInto Append encoded data to out, returns the appended size
+   */
+  qsizetype encodeInto(QByteArray &out, const QVariantList &datafieldList,
+                       const QVariantList &valueList = QVariantList());
+
+  qsizetype encodeInto(QByteArray &out, const CompiledSchema &schema,
+                       const QVariantList &valueList = QVariantList());
+
+  qsizetype encodeInto(QByteArray &out, const CompiledSchema &schema,
+                       const EncodeValues &values);
+
+  /**
+   * @brief encodeInto Encode into a caller-supplied span, returns the encoded
+   * size or -1 if capacity is not enough. The span must hold encodedCapacity
+   * bytes, which is more than the encoded size if a field seeks back
+   */
+  qsizetype encodeInto(char *data, qsizetype capacity,
+                       const QVariantList &datafieldList,
+                       const QVariantList &valueList = QVariantList());
+
+  qsizetype encodeInto(char *data, qsizetype capacity,
+                       const CompiledSchema &schema,
+                       const QVariantList &valueList = QVariantList());
+
+  qsizetype encodeInto(char *data, qsizetype capacity,
+                       const CompiledSchema &schema,
+                       const EncodeValues &values);
+
+  /**
+   * @brief encodedSize Exact size encode would produce for these values.
+   * Runs the schema without storing data or computing checksums. A span
+   * given to encodeInto needs encodedCapacity bytes instead
+   */
+  qsizetype encodedSize(const QVariantList &datafieldList,
+                        const QVariantList &valueList = QVariantList());
+
+  qsizetype encodedSize(const CompiledSchema &schema,
+                        const QVariantList &valueList = QVariantList());
+
+  qsizetype encodedSize(const CompiledSchema &schema,
+                        const EncodeValues &values);
+
+  /**
+   * @brief encodedCapacity Span size encodeInto needs for these values: the
+   * furthest byte written, past encodedSize if a "pos" seeks back from it
+   */
+  qsizetype encodedCapacity(const QVariantList &datafieldList,
+                            const QVariantList &valueList = QVariantList());
+
+  qsizetype encodedCapacity(const CompiledSchema &schema,
+                            const QVariantList &valueList = QVariantList());
+
+  qsizetype encodedCapacity(const CompiledSchema &schema,
+                            const EncodeValues &values);
+
+  /**
+   * @brief exactSize If set, encode measures the frame first and allocates
+   * the returned QByteArray once at its final size
+   */
+  bool exactSize() const;
+
+  void setExactSize(bool exactSize);
+
   void clear();
 
 protected:
+  /**
+   * @brief The Fixup struct Placeholder patched once the frame is encoded: a
+   * checksum over [from, to], or a length or count given no value
+   */
+  struct Fixup {
+    enum class Kind { Value, Crc };
+
+    Kind kind;
+    int index;
+    qint64 pos;
+    qint64 from;
+    qint64 to;
+    // Entry of the result list for top-level fields, -1 otherwise
+    int listPos;
+    FieldSlot value;
+  };
+
+  // Register of the last crc32/crc64 computed over [from, to]
+  struct CrcStream {
+    CompiledSchema::Opcode opcode;
+    qint64 from;
+    qint64 to;
+    quint64 crc;
+
+    CrcStream()
+        : opcode(CompiledSchema::Opcode::None), from(-1), to(-1), crc(0) {}
+  };
+
+  std::tuple<QByteArray, QVariantList> encodeFrame();
+
+  qsizetype writeInto(QByteArray &out);
+
+  qsizetype writeInto(char *data, qsizetype capacity);
+
+  /**
+   * @brief measure Size of the frame, capacity is set to the furthest byte
+   * written on the way
+   */
+  qsizetype measure(qsizetype *capacity = nullptr);
+
   void encode();
 
-  QVariantList encodeList(const QVariantList &datafieldList,
-                          const QVariantList &valueList);
+  bool encodeField(int index, const QVariant &value, QVariant &res);
+
+  bool encodeElements(int index, const QVariant &valueData, QVariant &res);
+
+  bool encodeElement(int index, const QVariant &valueData, QVariant &res);
 
-  QVariantMap encodeMap(const QVariantMap &datafield, const QVariantMap &value);
+  /**
+   * @brief encodeDerived Encode a number given no value as its expr formula,
+   * false if an operand has no value yet
+   */
+  bool encodeDerived(int index, QVariant &res);
 
-  QVariantMap encodeValue(const QVariantMap &field, const QVariant &valueData);
+  qint64 skipSize(int index) const;
 
-  QVariantMap encodeBitfield(const QVariantMap &field,
-                             const QVariant &valueData);
+  void encodeValue(int index, const FieldSlot &value);
 
-  QVariantMap encodeBitfieldElement(const QVariantMap &field,
-                                    const QVariant &value, QByteArray &data);
+  bool encodeBitfield(int index, const QVariant &valueData);
 
-  QVariantMap encodeСrc(const QVariantMap &field);
+  void encodeBitfieldElement(int index, const QVariant &value, char *data);
 
-  QVariantMap encodeRaw(const QVariantMap &field, const QVariant &valueData);
+  bool encodeCrc(int index);
 
-  QVariantMap encodeSkip(const QVariantMap &field);
+  void writeCrc(int index, quint64 crc);
 
-  QVariantMap encodeCustom(const QVariantMap &field, const QVariant &valueData);
+  void deferValue(int index);
 
-  QVariantMap encodeStruct(const QVariantMap &field, const QVariant &valueData);
+  void addFixup(Fixup::Kind kind, int index, qint64 from, qint64 to);
 
-  QVariantMap encodeUnixtime(const QVariantMap &field,
-                             const QVariant &valueData);
+  void setFixupValue(int index, const FieldSlot &value);
 
-  QVariantMap encodeConst(const QVariantMap &field, const QVariant &valueData);
+  /**
+   * @brief closeLength Fill in lengths waiting for field index, which
+   * started at from
+   */
+  void closeLength(int index, qint64 from);
 
-  void updateEncodedTo(const QString &name);
+  /**
+   * @brief resolveFixups Patch all placeholders in one pass over the frame
+   */
+  void resolveFixups();
 
-  QVariant getEncodedValue(const QString &name) const;
+  quint64 checksum(const Fixup &fixup, CrcStream &stream) const;
 
-  QVariant generateEncodedValue(const QString &name, const QVariant &value);
+  bool encodeCustom(int index, const QVariant &valueData);
+
+  void encodeStruct(int index, const QVariant &valueData);
+
+  QVariant topValue(const QString &name);
+
+  QVariant childValue(int index, const QVariantMap &valueMap) const;
+
+  static FieldSlot typedValue(CompiledSchema::Opcode opcode,
+                              const QVariant &value);
+
+  static bool isNumber(CompiledSchema::Opcode opcode);
 
 private:
-  QVariantMap m_encodedFields;
-  QVariantList m_datafieldList;
+  CompiledSchema m_schema;
   QVariantList m_valueList;
+  const EncodeValues *m_input;
+  int m_valueCursor;
+  QHash<QString, int> m_valueIndex;
+  bool m_valueIndexed;
   QVariantList m_encodeList;
-
-  QBuffer m_buf;
-  QDataStream m_ds;
+  QVector<FieldSlot> m_slots;
+  QVector<Fixup> m_fixups;
+  int m_pendingLengths;
+
+  ByteWriter m_writer;
+  QByteArray m_scratch;
+  qsizetype m_sizeHint;
+  bool m_exactSize;
 };
 
 } // namespace qbinarizer
@@ -5,8 +5,13 @@
 #include <QJsonObject>
 #include <QMetaProperty>
 #include <QObject>
+#include <QVector>
+
+#include <cstring>
+#include <type_traits>
 
 #include "qbinarizer/export/qbinarizer_export.h"
+#include "qbinarizer/internal/bytecursor.h"
 
 namespace qbinarizer {
 
@@ -27,6 +32,217 @@ public:
     return createFieldSpecStr(T::staticMetaObject);
   }
 
+  struct GadgetPlan;
+
+  /**
+   * @brief The FieldPlan struct One property of a gadget as it goes on the
+   * wire
+   */
+  struct FieldPlan {
+    using EncodeFunction = void (*)(const FieldPlan &field, const void *gadget,
+                                    ByteWriter &writer);
+    using DecodeFunction = void (*)(const FieldPlan &field, void *gadget,
+                                    ByteReader &reader);
+
+    enum class Kind : quint8 {
+      Bool,
+      Int,
+      UInt,
+      Int64,
+      UInt64,
+      Float,
+      Double,
+      DateTime,
+      Bytes,
+      Gadget
+    };
+
+    QString name;
+    Kind kind;
+    int metaType;
+    // Absolute index for QMetaObject::property
+    int propertyIndex;
+    // Field description type, "struct" for gadgets
+    QString type;
+    // Wire bytes. Raw fields are described without a size, so they decode
+    // one byte and encode the whole value
+    int size;
+    const GadgetPlan *nested;
+    QMetaProperty property;
+    // Property access without QVariant on Qt 5, null otherwise. The index is
+    // relative to the class declaring the property
+    QMetaObject::StaticMetacallFunction metacall;
+    int metacallIndex;
+    EncodeFunction encode;
+    DecodeFunction decode;
+
+    FieldPlan()
+        : kind(Kind::Int), metaType(0), propertyIndex(-1), size(0),
+          nested(nullptr), metacall(nullptr), metacallIndex(-1),
+          encode(nullptr), decode(nullptr) {}
+  };
+
+  /**
+   * @brief The GadgetPlan struct Properties of a gadget type resolved once,
+   * with the matching field description
+   */
+  struct GadgetPlan {
+    const QMetaObject *metaObject;
+    QVector<FieldPlan> fields;
+    // Wire bytes of all fields including nested gadgets
+    int size;
+    QVariantList fieldSpecList;
+    QString fieldSpecStr;
+    // Every field, nested ones included, is a number other than bool, so the
+    // encoded bytes may equal the memory of the gadget
+    bool plainNumbers;
+
+    GadgetPlan() : metaObject(nullptr), size(0), plainNumbers(false) {}
+  };
+
+  /**
+   * @brief plan Plan of a gadget type, built on first use and kept for the
+   * lifetime of the process. Thread-safe
+   */
+  static const GadgetPlan &plan(const QMetaObject *object);
+
+  /**
+   * @brief hasWireLayout Whether T in memory is exactly its encoding, so it
+   * is copied with memcpy. Checked once per type
+   */
+  template <typename T> static bool hasWireLayout() {
+    if constexpr (!std::is_trivially_copyable<T>::value ||
+                  (Q_BYTE_ORDER != Q_LITTLE_ENDIAN)) {
+      return false;
+    } else {
+      static const bool wireLayout = [] {
+        T probe;
+
+        return hasWireLayout(T::staticMetaObject, &probe, sizeof(T));
+      }();
+
+      return wireLayout;
+    }
+  }
+
+  /**
+   * @brief encodeGadget Writes the gadget as its createFieldSpecList
+   * description encodes, without QVariant where the Qt version allows
+   */
+  template <typename T> static QByteArray encodeGadget(const T &gadget) {
+    const QMetaObject &metaObject = T::staticMetaObject;
+
+    if (hasWireLayout<T>()) {
+      return QByteArray(reinterpret_cast<const char *>(&gadget), sizeof(T));
+    }
+
+    QByteArray data;
+    data.reserve(plan(&metaObject).size);
+
+    ByteWriter writer(&data);
+    encodeGadget(metaObject, &gadget, writer);
+
+    return data;
+  }
+
+  /**
+   * @brief decodeGadget Fills the gadget from data, returns the number of
+   * bytes read or -1 if data is too short, in which case gadget is untouched
+   */
+  template <typename T>
+  static qsizetype decodeGadget(const char *data, qsizetype size, T &gadget) {
+    if (hasWireLayout<T>()) {
+      if (size < static_cast<qsizetype>(sizeof(T))) {
+        return -1;
+      }
+
+      std::memcpy(&gadget, data, sizeof(T));
+
+      return sizeof(T);
+    }
+
+    ByteReader reader(data, size);
+    if (!decodeGadget(T::staticMetaObject, &gadget, reader)) {
+      return -1;
+    }
+
+    return reader.pos();
+  }
+
+  template <typename T>
+  static qsizetype decodeGadget(const QByteArray &data, T &gadget) {
+    return decodeGadget(data.constData(), data.size(), gadget);
+  }
+
+  /**
+   * @brief encodeGadgets Encodes count gadgets back to back, with a single
+   * copy if T has the wire layout
+   */
+  template <typename T>
+  static QByteArray encodeGadgets(const T *gadgets, qsizetype count) {
+    if (hasWireLayout<T>()) {
+      return QByteArray(reinterpret_cast<const char *>(gadgets),
+                        count * sizeof(T));
+    }
+
+    const QMetaObject &metaObject = T::staticMetaObject;
+
+    QByteArray data;
+    data.reserve(count * plan(&metaObject).size);
+
+    ByteWriter writer(&data);
+    for (qsizetype i = 0; i < count; i++) {
+      encodeGadget(metaObject, &gadgets[i], writer);
+    }
+
+    return data;
+  }
+
+  /**
+   * @brief decodeGadgets Fills count gadgets, returns the number of bytes
+   * read or -1 if data is too short for all of them
+   */
+  template <typename T>
+  static qsizetype decodeGadgets(const char *data, qsizetype size,
+                                 T *gadgets, qsizetype count) {
+    const QMetaObject &metaObject = T::staticMetaObject;
+
+    if (hasWireLayout<T>()) {
+      const qsizetype total = count * sizeof(T);
+      if (size < total) {
+        return -1;
+      }
+
+      std::memcpy(gadgets, data, total);
+
+      return total;
+    }
+
+    ByteReader reader(data, size);
+    if (!reader.canRead(count * plan(&metaObject).size)) {
+      return -1;
+    }
+
+    for (qsizetype i = 0; i < count; i++) {
+      decodeGadget(metaObject, &gadgets[i], reader);
+    }
+
+    return reader.pos();
+  }
+
+  /**
+   * @brief hasWireLayout Whether the gadget at probe, size bytes in memory,
+   * stores its fields in encoding order without padding. Overwrites probe
+   */
+  static bool hasWireLayout(const QMetaObject &metaObject, void *probe,
+                            int size);
+
+  static void encodeGadget(const QMetaObject &metaObject, const void *gadget,
+                           ByteWriter &writer);
+
+  static bool decodeGadget(const QMetaObject &metaObject, void *gadget,
+                           ByteReader &reader);
+
   static QList<QMetaProperty> getPropertyList(const QMetaObject *object);
 
   static QVariantList createFieldSpecList(const QMetaObject *object);
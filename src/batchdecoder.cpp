@@ -0,0 +1,430 @@
+#include "internal/batchdecoder.h"
+
+#include "workstealingpool.h"
+
+#include <QSet>
+
+#include <cstring>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+namespace qbinarizer {
+
+namespace {
+
+bool columnType(const CompiledSchema::Instruction &instr,
+                BatchColumn::Type &type) {
+  using Opcode = CompiledSchema::Opcode;
+
+  switch (instr.opcode) {
+  case Opcode::Int8:
+  case Opcode::UInt8:
+  case Opcode::Int16:
+  case Opcode::UInt16:
+  case Opcode::Int24:
+  case Opcode::UInt24:
+  case Opcode::Int32:
+    type = BatchColumn::Type::Int32;
+    break;
+  case Opcode::UInt32:
+  case Opcode::Int64:
+  case Opcode::Unixtime:
+    type = BatchColumn::Type::Int64;
+    break;
+  case Opcode::UInt64:
+    type = BatchColumn::Type::UInt64;
+    break;
+  case Opcode::Float:
+  case Opcode::Double:
+    type = BatchColumn::Type::Double;
+    break;
+  case Opcode::Raw:
+    type = BatchColumn::Type::Bytes;
+    break;
+  case Opcode::BitfieldElement:
+    type = instr.isSigned ? BatchColumn::Type::Int64
+                          : BatchColumn::Type::UInt64;
+    break;
+  default:
+    return false;
+  }
+
+  return true;
+}
+
+template <typename T, typename V>
+void appendArray(std::vector<V> &values, const PrimitiveArray &array) {
+  const size_t first = values.size();
+  values.resize(first + array.count);
+
+  if constexpr (std::is_same<T, V>::value) {
+    std::memcpy(values.data() + first, array.data, array.count * sizeof(T));
+  } else {
+    for (int i = 0; i < array.count; i++) {
+      values[first + i] = static_cast<V>(array.at<T>(i));
+    }
+  }
+}
+
+template <typename T>
+void appendArray(BatchColumn &column, const PrimitiveArray &array) {
+  switch (column.type) {
+  case BatchColumn::Type::Int32:
+    appendArray<T>(column.int32Values, array);
+    break;
+  case BatchColumn::Type::Int64:
+    appendArray<T>(column.int64Values, array);
+    break;
+  case BatchColumn::Type::UInt64:
+    appendArray<T>(column.uint64Values, array);
+    break;
+  case BatchColumn::Type::Double:
+    appendArray<T>(column.doubleValues, array);
+    break;
+  case BatchColumn::Type::Bytes:
+    break;
+  }
+}
+
+} // namespace
+
+qsizetype BatchColumn::valueCount() const {
+  switch (type) {
+  case Type::Int32:
+    return int32Values.size();
+  case Type::Int64:
+    return int64Values.size();
+  case Type::UInt64:
+    return uint64Values.size();
+  case Type::Double:
+    return doubleValues.size();
+  case Type::Bytes:
+    return byteOffsets.size() - 1;
+  }
+
+  return 0;
+}
+
+void BatchColumn::clear() {
+  int32Values.clear();
+  int64Values.clear();
+  uint64Values.clear();
+  doubleValues.clear();
+  byteOffsets.assign(1, 0);
+  bytes.clear();
+  offsets.assign(1, 0);
+  validity.clear();
+  rowCount = 0;
+}
+
+BatchDecoder::BatchDecoder(const CompiledSchema &schema)
+    : m_schema(schema), m_rowCount(0) {
+  createColumns();
+}
+
+void BatchDecoder::decode(const char *data, qsizetype size) {
+  m_decoder.decode(m_schema, data, size, *this);
+  m_rowCount++;
+}
+
+void BatchDecoder::decode(const QByteArray &frame) {
+  decode(frame.constData(), frame.size());
+}
+
+void BatchDecoder::decode(const QVector<QByteArray> &frames) {
+  for (const auto &frame : frames) {
+    decode(frame.constData(), frame.size());
+  }
+}
+
+qsizetype BatchDecoder::rowCount() const { return m_rowCount; }
+
+QStringList BatchDecoder::columnNames() const {
+  QStringList names;
+  for (const auto &column : m_columns) {
+    names.push_back(column.path);
+  }
+
+  return names;
+}
+
+const BatchColumn *BatchDecoder::column(const QString &path) const {
+  const int index = m_columnByPath.value(path, -1);
+  if (index < 0) {
+    return nullptr;
+  }
+
+  return &m_columns[index];
+}
+
+const QVector<BatchColumn> &BatchDecoder::columns() const {
+  return m_columns;
+}
+
+QVector<QVariantList>
+BatchDecoder::decodeBatch(const CompiledSchema &schema,
+                          const QVector<QByteArray> &frames) {
+  QVector<FrameSpan> spans;
+  spans.reserve(frames.size());
+  for (const auto &frame : frames) {
+    spans.push_back({frame.constData(), frame.size()});
+  }
+
+  return decodeBatch(schema, spans);
+}
+
+QVector<QVariantList>
+BatchDecoder::decodeBatch(const CompiledSchema &schema,
+                          const QVector<FrameSpan> &frames) {
+  WorkStealingPool &pool = WorkStealingPool::globalInstance();
+
+  std::vector<std::unique_ptr<StructDecoder>> decoders;
+  for (int i = 0; i < pool.threadCount(); i++) {
+    decoders.emplace_back(new StructDecoder);
+  }
+
+  QVector<QVariantList> resList(frames.size());
+  QVariantList *res = resList.data();
+  const FrameSpan *spans = frames.constData();
+
+  pool.run(frames.size(), [&](int worker, qsizetype index) {
+    const FrameSpan &frame = spans[index];
+
+    res[index] = decoders[worker]->decode(schema, frame.data, frame.size);
+  });
+
+  return resList;
+}
+
+void BatchDecoder::clear() {
+  for (auto &column : m_columns) {
+    column.clear();
+  }
+
+  m_rowCount = 0;
+}
+
+void BatchDecoder::createColumns() {
+  QVector<QString> paths(m_schema.size());
+  QSet<QString> usedPaths;
+  m_columnIndex.fill(-1, m_schema.size());
+
+  for (int i = 0; i < m_schema.size(); i++) {
+    const CompiledSchema::Instruction &instr = m_schema.at(i);
+
+    QString path = instr.name;
+    if (instr.parent >= 0) {
+      path = paths[instr.parent] + QLatin1Char('.') + instr.name;
+    }
+
+    // A name declared again in one scope gets its own path "name#2"
+    paths[i] = path;
+    for (int n = 2; usedPaths.contains(paths[i]); n++) {
+      paths[i] = path + QLatin1Char('#') + QString::number(n);
+    }
+    usedPaths.insert(paths[i]);
+
+    BatchColumn::Type type;
+    if (!columnType(instr, type)) {
+      continue;
+    }
+
+    BatchColumn column;
+    column.path = paths[i];
+    column.fieldId = i;
+    column.type = type;
+
+    for (int j = i; j >= 0; j = m_schema.at(j).parent) {
+      const CompiledSchema::Instruction &scope = m_schema.at(j);
+      if ((scope.countRef != CompiledSchema::NoRef) ||
+          (scope.countExpr != CompiledSchema::NoRef) || (scope.count > 1)) {
+        column.isList = true;
+        break;
+      }
+    }
+
+    m_columnIndex[i] = m_columns.size();
+    m_columnByPath[column.path] = m_columns.size();
+    m_columns.push_back(column);
+  }
+
+  m_present.fill(false, m_columns.size());
+}
+
+void BatchDecoder::append(int fieldId, qint64 value) {
+  const int index = m_columnIndex[fieldId];
+  if (index < 0) {
+    return;
+  }
+
+  BatchColumn &column = m_columns[index];
+  switch (column.type) {
+  case BatchColumn::Type::Int32:
+    column.int32Values.push_back(static_cast<qint32>(value));
+    break;
+  case BatchColumn::Type::Int64:
+    column.int64Values.push_back(value);
+    break;
+  case BatchColumn::Type::UInt64:
+    column.uint64Values.push_back(static_cast<quint64>(value));
+    break;
+  case BatchColumn::Type::Double:
+    column.doubleValues.push_back(static_cast<double>(value));
+    break;
+  case BatchColumn::Type::Bytes:
+    return;
+  }
+
+  m_present[index] = true;
+}
+
+void BatchDecoder::beginMessage(const CompiledSchema &schema) {
+  Q_UNUSED(schema);
+
+  m_present.fill(false);
+}
+
+void BatchDecoder::endMessage() {
+  for (int i = 0; i < m_columns.size(); i++) {
+    BatchColumn &column = m_columns[i];
+    const qsizetype row = column.rowCount;
+
+    if ((row & 7) == 0) {
+      column.validity.push_back(0);
+    }
+
+    if (m_present[i]) {
+      column.validity.back() |= (1 << (row & 7));
+    }
+
+    if (column.isList) {
+      column.offsets.push_back(column.valueCount());
+    } else if (!m_present[i]) {
+      switch (column.type) {
+      case BatchColumn::Type::Int32:
+        column.int32Values.push_back(0);
+        break;
+      case BatchColumn::Type::Int64:
+        column.int64Values.push_back(0);
+        break;
+      case BatchColumn::Type::UInt64:
+        column.uint64Values.push_back(0);
+        break;
+      case BatchColumn::Type::Double:
+        column.doubleValues.push_back(0.0);
+        break;
+      case BatchColumn::Type::Bytes:
+        column.byteOffsets.push_back(column.bytes.size());
+        break;
+      }
+    }
+
+    column.rowCount++;
+  }
+}
+
+void BatchDecoder::beginArray(int fieldId, int count) {
+  Q_UNUSED(count);
+
+  const int index = m_columnIndex[fieldId];
+  if (index >= 0) {
+    m_present[index] = true;
+  }
+}
+
+void BatchDecoder::onArray(int fieldId, const PrimitiveArray &array) {
+  using Opcode = CompiledSchema::Opcode;
+
+  const int index = m_columnIndex[fieldId];
+  if (index < 0) {
+    return;
+  }
+
+  BatchColumn &column = m_columns[index];
+  if (column.type == BatchColumn::Type::Bytes) {
+    return;
+  }
+
+  m_present[index] = true;
+
+  switch (array.type) {
+  case Opcode::Int8:
+    appendArray<qint8>(column, array);
+    break;
+  case Opcode::UInt8:
+    appendArray<quint8>(column, array);
+    break;
+  case Opcode::Int16:
+    appendArray<qint16>(column, array);
+    break;
+  case Opcode::UInt16:
+    appendArray<quint16>(column, array);
+    break;
+  case Opcode::Int32:
+    appendArray<qint32>(column, array);
+    break;
+  case Opcode::UInt32:
+    appendArray<quint32>(column, array);
+    break;
+  case Opcode::Int64:
+    appendArray<qint64>(column, array);
+    break;
+  case Opcode::UInt64:
+    appendArray<quint64>(column, array);
+    break;
+  case Opcode::Float:
+    appendArray<float>(column, array);
+    break;
+  case Opcode::Double:
+    appendArray<double>(column, array);
+    break;
+  default:
+    break;
+  }
+}
+
+void BatchDecoder::onValue(int fieldId, qint64 value) {
+  append(fieldId, value);
+}
+
+void BatchDecoder::onUnsigned(int fieldId, quint64 value) {
+  const int index = m_columnIndex[fieldId];
+  if ((index >= 0) &&
+      (m_columns[index].type == BatchColumn::Type::Double)) {
+    m_columns[index].doubleValues.push_back(static_cast<double>(value));
+    m_present[index] = true;
+
+    return;
+  }
+
+  append(fieldId, static_cast<qint64>(value));
+}
+
+void BatchDecoder::onDouble(int fieldId, double value) {
+  const int index = m_columnIndex[fieldId];
+  if ((index >= 0) &&
+      (m_columns[index].type == BatchColumn::Type::Double)) {
+    m_columns[index].doubleValues.push_back(value);
+    m_present[index] = true;
+
+    return;
+  }
+
+  append(fieldId, static_cast<qint64>(value));
+}
+
+void BatchDecoder::onBytes(int fieldId, const char *data, qsizetype size) {
+  const int index = m_columnIndex[fieldId];
+  if ((index < 0) || (m_columns[index].type != BatchColumn::Type::Bytes)) {
+    return;
+  }
+
+  BatchColumn &column = m_columns[index];
+  column.bytes.append(data, size);
+  column.byteOffsets.push_back(column.bytes.size());
+
+  m_present[index] = true;
+}
+
+} // namespace qbinarizer
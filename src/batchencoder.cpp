@@ -0,0 +1,152 @@
+#include "internal/batchencoder.h"
+
+#include "internal/bytecursor.h"
+
+#include <limits>
+
+namespace qbinarizer {
+
+namespace {
+
+int prefixSize(BatchEncoder::LengthPrefix lengthPrefix) {
+  switch (lengthPrefix) {
+  case BatchEncoder::LengthPrefix::UInt8:
+    return 1;
+  case BatchEncoder::LengthPrefix::UInt16:
+    return 2;
+  case BatchEncoder::LengthPrefix::UInt32:
+    return 4;
+  default:
+    return 0;
+  }
+}
+
+quint64 prefixMax(BatchEncoder::LengthPrefix lengthPrefix) {
+  switch (lengthPrefix) {
+  case BatchEncoder::LengthPrefix::UInt8:
+    return std::numeric_limits<quint8>::max();
+  case BatchEncoder::LengthPrefix::UInt16:
+    return std::numeric_limits<quint16>::max();
+  case BatchEncoder::LengthPrefix::UInt32:
+    return std::numeric_limits<quint32>::max();
+  default:
+    return std::numeric_limits<quint64>::max();
+  }
+}
+
+} // namespace
+
+BatchEncoder::BatchEncoder()
+    : m_lengthPrefix(LengthPrefix::None), m_bigEndian(true), m_offsets(1, 0) {
+}
+
+QByteArray BatchEncoder::syncWord() const { return m_syncWord; }
+
+void BatchEncoder::setSyncWord(const QByteArray &syncWord) {
+  m_syncWord = syncWord;
+}
+
+BatchEncoder::LengthPrefix BatchEncoder::lengthPrefix() const {
+  return m_lengthPrefix;
+}
+
+void BatchEncoder::setLengthPrefix(LengthPrefix lengthPrefix,
+                                   bool bigEndian) {
+  m_lengthPrefix = lengthPrefix;
+  m_bigEndian = bigEndian;
+}
+
+qsizetype BatchEncoder::headerSize() const {
+  return m_syncWord.size() + prefixSize(m_lengthPrefix);
+}
+
+void BatchEncoder::reserve(qsizetype size) { m_data.reserve(size); }
+
+qsizetype BatchEncoder::append(const CompiledSchema &schema,
+                               const QVariantList &valueList) {
+  beginMessage();
+
+  return endMessage(m_encoder.encodeInto(m_data, schema, valueList));
+}
+
+qsizetype BatchEncoder::append(const CompiledSchema &schema,
+                               const EncodeValues &values) {
+  beginMessage();
+
+  return endMessage(m_encoder.encodeInto(m_data, schema, values));
+}
+
+qsizetype BatchEncoder::messageCount() const {
+  return static_cast<qsizetype>(m_offsets.size()) - 1;
+}
+
+const QByteArray &BatchEncoder::data() const { return m_data; }
+
+const std::vector<qsizetype> &BatchEncoder::offsets() const {
+  return m_offsets;
+}
+
+QByteArray BatchEncoder::message(qsizetype index) const {
+  if ((index < 0) || (index >= messageCount())) {
+    return QByteArray();
+  }
+
+  const qsizetype from = m_offsets[index] + headerSize();
+
+  return m_data.mid(from, m_offsets[index + 1] - from);
+}
+
+QByteArray BatchEncoder::take() {
+  QByteArray data = m_data;
+
+  m_data = QByteArray();
+  m_offsets.assign(1, 0);
+
+  return data;
+}
+
+void BatchEncoder::clear() {
+  // Keeps Qt 5 from releasing the block on resize(0)
+  m_data.reserve(m_data.capacity());
+  m_data.resize(0);
+  m_offsets.assign(1, 0);
+}
+
+void BatchEncoder::beginMessage() {
+  m_data.append(m_syncWord);
+
+  // The length is patched in once the message is encoded
+  m_data.append(prefixSize(m_lengthPrefix), '\0');
+}
+
+qsizetype BatchEncoder::endMessage(qsizetype size) {
+  const qsizetype from = m_offsets.back();
+
+  if (static_cast<quint64>(size) > prefixMax(m_lengthPrefix)) {
+    m_data.resize(from);
+
+    return -1;
+  }
+
+  char *prefix = m_data.data() + from + m_syncWord.size();
+
+  switch (m_lengthPrefix) {
+  case LengthPrefix::UInt8:
+    storeValue<quint8>(prefix, static_cast<quint8>(size), m_bigEndian);
+    break;
+  case LengthPrefix::UInt16:
+    storeValue<quint16>(prefix, static_cast<quint16>(size), m_bigEndian);
+    break;
+  case LengthPrefix::UInt32:
+    storeValue<quint32>(prefix, static_cast<quint32>(size), m_bigEndian);
+    break;
+  default:
+    break;
+  }
+
+  m_offsets.push_back(m_data.size());
+
+  return m_data.size() - from;
+}
+
+} // namespace qbinarizer
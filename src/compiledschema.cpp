@@ -0,0 +1,680 @@
+#include "internal/compiledschema.h"
+
+#include "jsonutils.h"
+
+#include <QtDebug>
+
+#include <cmath>
+#include <limits>
+
+namespace qbinarizer {
+
+namespace {
+
+// Choose values spanning less than twice their count plus this go into the
+// dense array
+constexpr qint64 DenseSlack = 64;
+
+bool integralKey(double value, qint64 &key) {
+  // 2^63 is the first double past the qint64 range
+  if (!(value >= -9223372036854775808.0) ||
+      !(value < 9223372036854775808.0) || (std::trunc(value) != value)) {
+    return false;
+  }
+
+  key = static_cast<qint64>(value);
+
+  return true;
+}
+
+// A plain field name as opposed to a formula
+bool isIdentifier(const QString &text) {
+  if (text.isEmpty() || text.at(0).isDigit()) {
+    return false;
+  }
+
+  for (const QChar c : text) {
+    if (!c.isLetterOrNumber() && (c != QLatin1Char('_'))) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+bool integralKey(const QVariant &value, qint64 &key) {
+  switch (value.type()) {
+  case QVariant::Int:
+  case QVariant::UInt:
+  case QVariant::LongLong:
+    key = value.toLongLong();
+    return true;
+  case QVariant::ULongLong:
+    key = static_cast<qint64>(value.toULongLong());
+    return key >= 0;
+  case QVariant::Double:
+    return integralKey(value.toDouble(), key);
+  default:
+    return false;
+  }
+}
+
+bool integralKey(const FieldSlot &slot, qint64 &key) {
+  switch (slot.type) {
+  case FieldSlot::Type::Int:
+    key = slot.i;
+    return true;
+  case FieldSlot::Type::UInt:
+    key = static_cast<qint64>(slot.u);
+    return key >= 0;
+  case FieldSlot::Type::Double:
+    return integralKey(slot.d, key);
+  default:
+    return false;
+  }
+}
+
+} // namespace
+
+CompiledSchema::CompiledSchema()
+    : m_minSize(0), m_maxSize(0), m_fixedPrefixEnd(0), m_fixedPrefixSize(0) {}
+
+CompiledSchema::CompiledSchema(const QVariantList &datafieldList)
+    : CompiledSchema() {
+  compileList(datafieldList, -1);
+  linkRefs();
+  analyzeLayout();
+}
+
+CompiledSchema CompiledSchema::compile(const QString &datafieldListStr) {
+  const QVariantList datafieldList = parseJson(datafieldListStr);
+
+  return CompiledSchema(datafieldList);
+}
+
+bool CompiledSchema::isEmpty() const { return m_instructions.isEmpty(); }
+
+int CompiledSchema::size() const { return m_instructions.size(); }
+
+const CompiledSchema::Instruction &CompiledSchema::at(int index) const {
+  return m_instructions.at(index);
+}
+
+const QVector<CompiledSchema::Instruction> &
+CompiledSchema::instructions() const {
+  return m_instructions;
+}
+
+const QVector<int> &CompiledSchema::crcFields() const { return m_crcFields; }
+
+const Expression &CompiledSchema::expression(int index) const {
+  return m_expressions.at(index);
+}
+
+int CompiledSchema::indexOf(const QString &name) const {
+  return m_nameIndex.value(name, -1);
+}
+
+CompiledSchema::Layout CompiledSchema::layout() const {
+  if (m_fixedPrefixEnd == m_instructions.size()) {
+    return Layout::Fixed;
+  }
+
+  return (m_fixedPrefixEnd > 0) ? Layout::FixedPrefix : Layout::Dynamic;
+}
+
+qint64 CompiledSchema::minSize() const { return m_minSize; }
+
+qint64 CompiledSchema::maxSize() const { return m_maxSize; }
+
+int CompiledSchema::fixedPrefixEnd() const { return m_fixedPrefixEnd; }
+
+qint64 CompiledSchema::fixedPrefixSize() const { return m_fixedPrefixSize; }
+
+qint64 CompiledSchema::offsetOf(int index) const {
+  return m_instructions.at(index).offset;
+}
+
+int CompiledSchema::chooseBranch(int index, const FieldSlot &depend) const {
+  const Instruction &instr = m_instructions.at(index);
+  if ((instr.chooseTable < 0) || depend.isNull()) {
+    return -1;
+  }
+
+  const ChooseTable &table = m_chooseTables.at(instr.chooseTable);
+
+  qint64 key = 0;
+  if (integralKey(depend, key)) {
+    int branch = -1;
+    if (!table.dense.isEmpty()) {
+      const quint64 offset = quint64(key) - quint64(table.base);
+      if ((key >= table.base) && (offset < quint64(table.dense.size()))) {
+        branch = table.dense.at(offset);
+      }
+    } else {
+      branch = table.sparse.value(key, -1);
+    }
+
+    if (branch >= 0) {
+      return branch;
+    }
+  }
+
+  if (table.other.isEmpty()) {
+    return -1;
+  }
+
+  const QVariant dependValue = depend.toVariant();
+  for (const int branch : table.other) {
+    if (m_instructions.at(branch).choose == dependValue) {
+      return branch;
+    }
+  }
+
+  return -1;
+}
+
+CompiledSchema::Opcode CompiledSchema::opcodeFromType(const QString &type) {
+  static const QHash<QString, Opcode> opcodeMap = {
+      {QStringLiteral("int8"), Opcode::Int8},
+      {QStringLiteral("char"), Opcode::Int8},
+      {QStringLiteral("uint8"), Opcode::UInt8},
+      {QStringLiteral("int16"), Opcode::Int16},
+      {QStringLiteral("uint16"), Opcode::UInt16},
+      {QStringLiteral("int24"), Opcode::Int24},
+      {QStringLiteral("uint24"), Opcode::UInt24},
+      {QStringLiteral("int32"), Opcode::Int32},
+      {QStringLiteral("uint32"), Opcode::UInt32},
+      {QStringLiteral("int64"), Opcode::Int64},
+      {QStringLiteral("uint64"), Opcode::UInt64},
+      {QStringLiteral("float"), Opcode::Float},
+      {QStringLiteral("double"), Opcode::Double},
+      {QStringLiteral("const"), Opcode::Const},
+      {QStringLiteral("crc8"), Opcode::Crc8},
+      {QStringLiteral("crc16"), Opcode::Crc16},
+      {QStringLiteral("crc32"), Opcode::Crc32},
+      {QStringLiteral("crc64"), Opcode::Crc64},
+      {QStringLiteral("struct"), Opcode::Struct},
+      {QStringLiteral("custom"), Opcode::Custom},
+      {QStringLiteral("unixtime"), Opcode::Unixtime},
+      {QStringLiteral("raw"), Opcode::Raw},
+      {QStringLiteral("skip"), Opcode::Skip},
+      {QStringLiteral("bitfield"), Opcode::Bitfield},
+  };
+
+  return opcodeMap.value(type, Opcode::None);
+}
+
+int CompiledSchema::valueSize(Opcode opcode) {
+  switch (opcode) {
+  case Opcode::Int8:
+  case Opcode::UInt8:
+  case Opcode::Crc8:
+    return 1;
+  case Opcode::Int16:
+  case Opcode::UInt16:
+  case Opcode::Crc16:
+    return 2;
+  case Opcode::Int24:
+  case Opcode::UInt24:
+    return 3;
+  case Opcode::Int32:
+  case Opcode::UInt32:
+  case Opcode::Float:
+  case Opcode::Crc32:
+    return 4;
+  case Opcode::Int64:
+  case Opcode::UInt64:
+  case Opcode::Double:
+  case Opcode::Crc64:
+  case Opcode::Unixtime:
+    return 8;
+  default:
+    return 0;
+  }
+}
+
+void CompiledSchema::compileList(const QVariantList &fieldList, int parent) {
+  for (const auto &field : fieldList) {
+    if (field.type() == QVariant::List) {
+      compileList(field.toList(), parent);
+    } else if (field.type() == QVariant::Map) {
+      const QVariantMap fieldMap = field.toMap();
+      if (fieldMap.isEmpty()) {
+        continue;
+      }
+
+      const QString &fieldName = fieldMap.firstKey();
+      compileField(fieldName, fieldMap[fieldName].toMap(), parent);
+    }
+  }
+}
+
+void CompiledSchema::compileField(const QString &name,
+                                  const QVariantMap &description,
+                                  int parent) {
+  QString type = description["type"].toString();
+  if (type == "array") {
+    type = description["subtype"].toString();
+  }
+
+  Instruction instr;
+  instr.opcode = opcodeFromType(type);
+  instr.name = name;
+  instr.parent = parent;
+  instr.bigEndian = (description["endian"].toString().toLower() == "big");
+  instr.size = valueSize(instr.opcode);
+  instr.value = description["value"];
+
+  if (description.contains("pos")) {
+    const QVariant &posValue = description["pos"];
+    instr.posExpr = compileFormula(name, posValue);
+    if ((instr.posExpr == NoRef) && posValue.canConvert<qint64>()) {
+      instr.pos = posValue.toLongLong();
+    }
+  }
+
+  if (description.contains("count")) {
+    const QVariant &countValue = description["count"];
+    if (isIdentifier(countValue.toString())) {
+      // Left unresolved like other references to fields not declared yet
+      instr.countRef = resolveRef(countValue);
+    } else {
+      instr.countExpr = compileFormula(name, countValue);
+    }
+
+    if ((instr.countRef == NoRef) && (instr.countExpr == NoRef)) {
+      instr.count = countValue.toInt();
+    }
+  }
+
+  switch (instr.opcode) {
+  case Opcode::Const: {
+    const quint32 size = description["size"].toUInt();
+    const QByteArray constData =
+        QByteArray::fromHex(description["value"].toString().toLatin1());
+    if ((description["value"].type() != QVariant::String) || (size == 0) ||
+        constData.isEmpty() || (size > (quint32)constData.size())) {
+      instr.opcode = Opcode::None;
+      break;
+    }
+
+    instr.size = size;
+    instr.constData = constData.mid(0, size);
+  } break;
+  case Opcode::Crc8:
+  case Opcode::Crc16:
+  case Opcode::Crc32:
+  case Opcode::Crc64:
+    instr.include = description["include"].toBool();
+    instr.from = description["from"].toLongLong();
+    if (description.contains("parent")) {
+      instr.parentRef = resolveRef(description["parent"]);
+    }
+    if (description["to"].type() == QVariant::String) {
+      instr.toRef = resolveRef(description["to"]);
+    }
+    break;
+  case Opcode::Raw:
+    instr.sizeExpr = compileFormula(name, description["size"]);
+    instr.size = description["size"].toUInt();
+    instr.size = (instr.size == 0) ? 1 : instr.size;
+    break;
+  case Opcode::Skip:
+    instr.sizeExpr = compileFormula(name, description["size"]);
+    instr.size = description["size"].toUInt();
+    if ((instr.size <= 0) && (instr.sizeExpr == NoRef)) {
+      instr.opcode = Opcode::None;
+    }
+    break;
+  case Opcode::Bitfield:
+    if (!description.contains("size")) {
+      instr.opcode = Opcode::None;
+      break;
+    }
+
+    instr.size = description["size"].toUInt();
+    instr.size = (instr.size <= 0) ? 1 : instr.size;
+    instr.reversed = description["reversed"].toBool();
+    break;
+  case Opcode::Custom:
+    if (description["depend"].type() != QVariant::String) {
+      instr.opcode = Opcode::None;
+      break;
+    }
+
+    instr.dependRef = resolveRef(description["depend"]);
+    break;
+  default:
+    break;
+  }
+
+  // Numbers given no value are encoded as the formula in expr
+  if ((instr.opcode >= Opcode::Int8) && (instr.opcode <= Opcode::Double) &&
+      description.contains("expr")) {
+    const int valueExpr = compileFormula(name, description["expr"]);
+    instr.valueExpr = (valueExpr >= 0) ? valueExpr : NoRef;
+  }
+
+  // A formula that does not compile drops the field like an unresolved name
+  if ((instr.posExpr == UnresolvedRef) || (instr.sizeExpr == UnresolvedRef) ||
+      (instr.countExpr == UnresolvedRef)) {
+    instr.opcode = Opcode::None;
+    instr.posExpr = NoRef;
+    instr.sizeExpr = NoRef;
+    instr.countExpr = NoRef;
+  }
+
+  const int index = m_instructions.size();
+  m_instructions.push_back(instr);
+  m_nameIndex[name] = index;
+
+  const QVariant &length = description["length"];
+  if (length.type() == QVariant::String) {
+    m_lengthNames.push_back(qMakePair(index, length.toString()));
+  }
+
+  if ((instr.opcode >= Opcode::Crc8) && (instr.opcode <= Opcode::Crc64)) {
+    m_crcFields.push_back(index);
+  }
+
+  if (instr.opcode == Opcode::Bitfield) {
+    compileBitfield(index, description);
+  } else if (instr.opcode == Opcode::Struct) {
+    compileStruct(index, description);
+  } else if (instr.opcode == Opcode::Custom) {
+    compileCustom(index, description);
+  }
+
+  m_instructions[index].end = m_instructions.size();
+}
+
+void CompiledSchema::compileBitfield(int index,
+                                     const QVariantMap &description) {
+  const int bitCount = m_instructions.at(index).size * CHAR_WIDTH;
+  const bool reversed = m_instructions.at(index).reversed;
+
+  const QVariantMap spec = description["spec"].toMap();
+  for (auto it = spec.constBegin(); it != spec.constEnd(); ++it) {
+    const QVariantMap specField = it.value().toMap();
+
+    Instruction element;
+    element.opcode = Opcode::BitfieldElement;
+    element.name = it.key();
+    element.parent = index;
+    element.size = specField["size"].toInt();
+    element.size = (element.size == 0) ? 1 : element.size;
+    element.pos = specField["pos"].toInt();
+    element.isSigned = specField["signed"].toBool();
+    element.value = specField["value"];
+    element.end = m_instructions.size() + 1;
+
+    // A reversed bitfield is the whole bit string mirrored, so the element
+    // is read mirrored from the other end of the raw bytes
+    if (element.pos + element.size <= bitCount) {
+      const qint64 first =
+          reversed ? bitCount - element.pos - element.size : element.pos;
+
+      element.reversed = reversed;
+      element.bitOffset = first / CHAR_WIDTH;
+      element.bitShift = first % CHAR_WIDTH;
+    }
+
+    m_nameIndex[element.name] = m_instructions.size();
+    m_instructions.push_back(element);
+  }
+}
+
+void CompiledSchema::compileCustom(int index, const QVariantMap &description) {
+  const QVariantMap choose = description["choose"].toMap();
+  const QVariantMap spec = description["spec"].toMap();
+
+  for (auto it = choose.constBegin(); it != choose.constEnd(); ++it) {
+    const int branchIndex = m_instructions.size();
+
+    if (spec.contains(it.key())) {
+      compileField(it.key(), spec[it.key()].toMap(), index);
+    } else {
+      Instruction branch;
+      branch.name = it.key();
+      branch.parent = index;
+      branch.end = branchIndex + 1;
+
+      m_instructions.push_back(branch);
+    }
+
+    m_instructions[branchIndex].choose = it.value();
+  }
+
+  compileChooseTable(index);
+}
+
+void CompiledSchema::compileStruct(int index, const QVariantMap &description) {
+  const QVariant &spec = description["spec"];
+  if (spec.type() == QVariant::List) {
+    compileList(spec.toList(), index);
+
+    return;
+  }
+
+  const QVariantMap specMap = spec.toMap();
+  if (specMap.isEmpty()) {
+    return;
+  }
+
+  const QString &specName = specMap.firstKey();
+  compileField(specName, specMap[specName].toMap(), index);
+}
+
+void CompiledSchema::compileChooseTable(int index) {
+  if (m_instructions.size() == index + 1) {
+    return;
+  }
+
+  ChooseTable table;
+  qint64 minKey = std::numeric_limits<qint64>::max();
+  qint64 maxKey = std::numeric_limits<qint64>::min();
+
+  // Branches follow the custom field up to the end of the instruction list,
+  // the first branch of a repeated choose value wins
+  for (int i = index + 1; i < m_instructions.size();
+       i = m_instructions.at(i).end) {
+    qint64 key = 0;
+    if (!integralKey(m_instructions.at(i).choose, key)) {
+      table.other.push_back(i);
+
+      continue;
+    }
+
+    if (!table.sparse.contains(key)) {
+      table.sparse.insert(key, i);
+      minKey = qMin(minKey, key);
+      maxKey = qMax(maxKey, key);
+    }
+  }
+
+  const qint64 count = table.sparse.size();
+  const quint64 span = quint64(maxKey) - quint64(minKey);
+  if ((count > 0) && (span < quint64(count * 2 + DenseSlack))) {
+    table.base = minKey;
+    table.dense.fill(-1, int(span) + 1);
+    for (auto it = table.sparse.constBegin(); it != table.sparse.constEnd();
+         ++it) {
+      table.dense[it.key() - minKey] = it.value();
+    }
+
+    table.sparse.clear();
+  }
+
+  m_instructions[index].chooseTable = m_chooseTables.size();
+  m_chooseTables.push_back(table);
+}
+
+int CompiledSchema::resolveRef(const QVariant &name) const {
+  return m_nameIndex.value(name.toString(), UnresolvedRef);
+}
+
+int CompiledSchema::compileFormula(const QString &name,
+                                   const QVariant &value) {
+  if (value.type() != QVariant::String) {
+    return NoRef;
+  }
+
+  bool numeric = false;
+  value.toString().toDouble(&numeric);
+  if (numeric) {
+    return NoRef;
+  }
+
+  // Like other references a formula only sees fields declared before it
+  QString error;
+  const Expression expr = Expression::compile(
+      value.toString(),
+      [this](const QString &ref) { return m_nameIndex.value(ref, -1); },
+      &error);
+  if (!expr.isValid()) {
+    qWarning() << "field" << name << "formula" << value.toString() << ":"
+               << error;
+
+    return UnresolvedRef;
+  }
+
+  m_expressions.push_back(expr);
+
+  return m_expressions.size() - 1;
+}
+
+void CompiledSchema::linkRefs() {
+  for (const auto &lengthName : qAsConst(m_lengthNames)) {
+    const int target = resolveRef(lengthName.second);
+    if (target > lengthName.first) {
+      m_instructions[lengthName.first].lengthRef = target;
+    }
+  }
+  m_lengthNames.clear();
+
+  for (int i = 0; i < m_instructions.size(); i++) {
+    const int countRef = m_instructions.at(i).countRef;
+    if (countRef >= 0) {
+      m_instructions[countRef].countSource = true;
+    }
+  }
+}
+
+void CompiledSchema::analyzeLayout() {
+  m_minSize = 0;
+  m_maxSize = 0;
+  m_fixedPrefixEnd = 0;
+  m_fixedPrefixSize = 0;
+
+  bool prefix = true;
+  for (int i = 0; i < m_instructions.size(); i = m_instructions.at(i).end) {
+    qint64 minSize = 0;
+    qint64 maxSize = 0;
+    measure(i, minSize, maxSize);
+
+    m_minSize += minSize;
+    m_maxSize = ((m_maxSize < 0) || (maxSize < 0)) ? -1 : m_maxSize + maxSize;
+
+    const Instruction &instr = m_instructions.at(i);
+    prefix = prefix && (instr.fixedSize >= 0);
+    if (prefix) {
+      assignOffset(i, m_fixedPrefixSize);
+
+      m_fixedPrefixSize += instr.fixedSize;
+      m_fixedPrefixEnd = instr.end;
+    }
+  }
+}
+
+void CompiledSchema::measure(int index, qint64 &minSize, qint64 &maxSize) {
+  Instruction &instr = m_instructions[index];
+
+  qint64 elementMin = 0;
+  qint64 elementMax = 0;
+
+  switch (instr.opcode) {
+  case Opcode::Struct:
+    for (int i = index + 1; i < instr.end; i = m_instructions.at(i).end) {
+      qint64 childMin = 0;
+      qint64 childMax = 0;
+      measure(i, childMin, childMax);
+
+      elementMin += childMin;
+      elementMax =
+          ((elementMax < 0) || (childMax < 0)) ? -1 : elementMax + childMax;
+    }
+    break;
+  case Opcode::Custom:
+    // No branch may match, so a custom field can take no bytes at all
+    for (int i = index + 1; i < instr.end; i = m_instructions.at(i).end) {
+      qint64 branchMin = 0;
+      qint64 branchMax = 0;
+      measure(i, branchMin, branchMax);
+
+      elementMax = ((elementMax < 0) || (branchMax < 0))
+                       ? -1
+                       : qMax(elementMax, branchMax);
+    }
+    break;
+  case Opcode::Bitfield:
+    for (int i = index + 1; i < instr.end; i++) {
+      m_instructions[i].fixedSize = 0;
+    }
+
+    elementMin = elementMax = instr.size;
+    break;
+  case Opcode::None:
+    break;
+  default:
+    elementMin = elementMax = instr.size;
+    break;
+  }
+
+  // Count and depend fields are read before the counted field, if they are
+  // missing the field is skipped, so a data dependent count may be empty
+  const qint64 count = qMax(instr.count, 1);
+  if ((instr.countRef != NoRef) || (instr.countExpr != NoRef) ||
+      (instr.sizeExpr != NoRef)) {
+    minSize = 0;
+    maxSize = -1;
+  } else {
+    minSize = elementMin * count;
+    maxSize = (elementMax < 0) ? -1 : elementMax * count;
+  }
+
+  // A seek can land anywhere in the frame
+  if ((instr.pos >= 0) || (instr.posExpr != NoRef)) {
+    minSize = 0;
+    maxSize = -1;
+  }
+
+  instr.fixedSize = (minSize == maxSize) ? minSize : -1;
+}
+
+void CompiledSchema::assignOffset(int index, qint64 offset) {
+  Instruction &instr = m_instructions[index];
+  instr.offset = offset;
+
+  if (instr.count > 1) {
+    return;
+  }
+
+  if (instr.opcode == Opcode::Bitfield) {
+    for (int i = index + 1; i < instr.end; i++) {
+      m_instructions[i].offset = offset;
+    }
+  }
+
+  if (instr.opcode != Opcode::Struct) {
+    return;
+  }
+
+  for (int i = index + 1; i < instr.end; i = m_instructions.at(i).end) {
+    assignOffset(i, offset);
+
+    offset += m_instructions.at(i).fixedSize;
+  }
+}
+
+} // namespace qbinarizer
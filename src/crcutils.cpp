@@ -0,0 +1,243 @@
+#include "internal/crcutils.h"
+
+#include <QtEndian>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define QBINARIZER_CRC_PCLMUL
+#include <emmintrin.h>
+#include <wmmintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define QBINARIZER_TARGET_PCLMUL
+#else
+#include <cpuid.h>
+#define QBINARIZER_TARGET_PCLMUL __attribute__((target("sse2,pclmul")))
+#endif
+#endif
+
+namespace qbinarizer {
+
+namespace {
+
+constexpr quint32 crc32Poly = 0xedb88320u;
+constexpr quint64 crc64WePoly = 0x42f0e1eba9ea3693ull;
+
+// table[k][b] is the register after byte b followed by k zero bytes
+struct Crc32Tables {
+  quint32 table[16][256];
+
+  constexpr Crc32Tables() : table() {
+    for (quint32 i = 0; i < 256; i++) {
+      quint32 crc = i;
+      for (int bit = 0; bit < 8; bit++) {
+        crc = (crc & 1) ? ((crc >> 1) ^ crc32Poly) : (crc >> 1);
+      }
+      table[0][i] = crc;
+    }
+
+    for (int k = 1; k < 16; k++) {
+      for (int i = 0; i < 256; i++) {
+        const quint32 prev = table[k - 1][i];
+        table[k][i] = (prev >> 8) ^ table[0][prev & 0xff];
+      }
+    }
+  }
+};
+
+struct Crc64Tables {
+  quint64 table[8][256];
+
+  constexpr Crc64Tables() : table() {
+    for (quint64 i = 0; i < 256; i++) {
+      quint64 crc = i << 56;
+      for (int bit = 0; bit < 8; bit++) {
+        crc = (crc & (1ull << 63)) ? ((crc << 1) ^ crc64WePoly) : (crc << 1);
+      }
+      table[0][i] = crc;
+    }
+
+    for (int k = 1; k < 8; k++) {
+      for (int i = 0; i < 256; i++) {
+        const quint64 prev = table[k - 1][i];
+        table[k][i] = (prev << 8) ^ table[0][prev >> 56];
+      }
+    }
+  }
+};
+
+constexpr Crc32Tables crc32Tables;
+constexpr Crc64Tables crc64Tables;
+
+quint32 crc32Slice16(quint32 crc, const uchar *data, qsizetype size) {
+  const auto &t = crc32Tables.table;
+
+  while (size >= 16) {
+    const quint32 one = qFromLittleEndian<quint32>(data) ^ crc;
+    const quint32 two = qFromLittleEndian<quint32>(data + 4);
+    const quint32 three = qFromLittleEndian<quint32>(data + 8);
+    const quint32 four = qFromLittleEndian<quint32>(data + 12);
+
+    crc = t[15][one & 0xff] ^ t[14][(one >> 8) & 0xff] ^
+          t[13][(one >> 16) & 0xff] ^ t[12][one >> 24] ^
+          t[11][two & 0xff] ^ t[10][(two >> 8) & 0xff] ^
+          t[9][(two >> 16) & 0xff] ^ t[8][two >> 24] ^ t[7][three & 0xff] ^
+          t[6][(three >> 8) & 0xff] ^ t[5][(three >> 16) & 0xff] ^
+          t[4][three >> 24] ^ t[3][four & 0xff] ^ t[2][(four >> 8) & 0xff] ^
+          t[1][(four >> 16) & 0xff] ^ t[0][four >> 24];
+
+    data += 16;
+    size -= 16;
+  }
+
+  while (size-- > 0) {
+    crc = (crc >> 8) ^ t[0][(crc ^ *data++) & 0xff];
+  }
+
+  return crc;
+}
+
+quint64 crc64Slice8(quint64 crc, const uchar *data, qsizetype size) {
+  const auto &t = crc64Tables.table;
+
+  while (size >= 8) {
+    const quint64 word = qFromBigEndian<quint64>(data) ^ crc;
+
+    crc = t[7][word >> 56] ^ t[6][(word >> 48) & 0xff] ^
+          t[5][(word >> 40) & 0xff] ^ t[4][(word >> 32) & 0xff] ^
+          t[3][(word >> 24) & 0xff] ^ t[2][(word >> 16) & 0xff] ^
+          t[1][(word >> 8) & 0xff] ^ t[0][word & 0xff];
+
+    data += 8;
+    size -= 8;
+  }
+
+  while (size-- > 0) {
+    crc = (crc << 8) ^ t[0][(crc >> 56) ^ *data++];
+  }
+
+  return crc;
+}
+
+#ifdef QBINARIZER_CRC_PCLMUL
+
+bool hasPclmul() {
+#if defined(_MSC_VER)
+  int info[4] = {};
+  __cpuid(info, 1);
+  const unsigned int ecx = info[2];
+#else
+  unsigned int eax = 0;
+  unsigned int ebx = 0;
+  unsigned int ecx = 0;
+  unsigned int edx = 0;
+  if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx)) {
+    return false;
+  }
+#endif
+
+  return (ecx & (1u << 1)) != 0;
+}
+
+QBINARIZER_TARGET_PCLMUL
+inline __m128i load(const uchar *src) {
+  return _mm_loadu_si128(reinterpret_cast<const __m128i *>(src));
+}
+
+QBINARIZER_TARGET_PCLMUL
+inline __m128i fold(__m128i x, __m128i k, __m128i next) {
+  const __m128i lo = _mm_clmulepi64_si128(x, k, 0x00);
+  const __m128i hi = _mm_clmulepi64_si128(x, k, 0x11);
+
+  return _mm_xor_si128(_mm_xor_si128(hi, lo), next);
+}
+
+// Folding by carry-less multiply, "Fast CRC Computation for Generic
+// Polynomials Using PCLMULQDQ Instruction" (Intel). Needs size >= 64
+QBINARIZER_TARGET_PCLMUL
+quint32 crc32Pclmul(quint32 crc, const uchar *data, qsizetype size) {
+  alignas(16) static const quint64 k1k2[] = {0x0154442bd4ull, 0x01c6e41596ull};
+  alignas(16) static const quint64 k3k4[] = {0x01751997d0ull, 0x00ccaa009eull};
+  alignas(16) static const quint64 k5k0[] = {0x0163cd6124ull, 0x0ull};
+  alignas(16) static const quint64 poly[] = {0x01db710641ull, 0x01f7011641ull};
+
+  __m128i x1 = _mm_xor_si128(load(data), _mm_cvtsi32_si128(crc));
+  __m128i x2 = load(data + 16);
+  __m128i x3 = load(data + 32);
+  __m128i x4 = load(data + 48);
+  data += 64;
+  size -= 64;
+
+  __m128i k = _mm_load_si128(reinterpret_cast<const __m128i *>(k1k2));
+  while (size >= 64) {
+    x1 = fold(x1, k, load(data));
+    x2 = fold(x2, k, load(data + 16));
+    x3 = fold(x3, k, load(data + 32));
+    x4 = fold(x4, k, load(data + 48));
+
+    data += 64;
+    size -= 64;
+  }
+
+  k = _mm_load_si128(reinterpret_cast<const __m128i *>(k3k4));
+  x1 = fold(x1, k, x2);
+  x1 = fold(x1, k, x3);
+  x1 = fold(x1, k, x4);
+
+  while (size >= 16) {
+    x1 = fold(x1, k, load(data));
+
+    data += 16;
+    size -= 16;
+  }
+
+  // 128 to 64 bits
+  const __m128i mask32 = _mm_setr_epi32(~0, 0, ~0, 0);
+  x2 = _mm_clmulepi64_si128(x1, k, 0x10);
+  x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), x2);
+
+  k = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(k5k0));
+  x2 = _mm_srli_si128(x1, 4);
+  x1 = _mm_clmulepi64_si128(_mm_and_si128(x1, mask32), k, 0x00);
+  x1 = _mm_xor_si128(x1, x2);
+
+  // Barrett reduction to 32 bits
+  k = _mm_load_si128(reinterpret_cast<const __m128i *>(poly));
+  x2 = _mm_clmulepi64_si128(_mm_and_si128(x1, mask32), k, 0x10);
+  x2 = _mm_clmulepi64_si128(_mm_and_si128(x2, mask32), k, 0x00);
+  x1 = _mm_xor_si128(x1, x2);
+
+  crc = static_cast<quint32>(_mm_cvtsi128_si32(_mm_srli_si128(x1, 4)));
+
+  return crc32Slice16(crc, data, size);
+}
+
+#endif
+
+} // namespace
+
+quint32 crc32(const char *data, qsizetype size) {
+  return crc32Final(crc32Update(crc32Init, data, size));
+}
+
+quint64 crc64We(const char *data, qsizetype size) {
+  return crc64WeFinal(crc64WeUpdate(crc64WeInit, data, size));
+}
+
+quint32 crc32Update(quint32 crc, const char *data, qsizetype size) {
+  const uchar *bytes = reinterpret_cast<const uchar *>(data);
+
+#ifdef QBINARIZER_CRC_PCLMUL
+  static const bool pclmul = hasPclmul();
+  if (pclmul && (size >= 64)) {
+    return crc32Pclmul(crc, bytes, size);
+  }
+#endif
+
+  return crc32Slice16(crc, bytes, size);
+}
+
+quint64 crc64WeUpdate(quint64 crc, const char *data, qsizetype size) {
+  return crc64Slice8(crc, reinterpret_cast<const uchar *>(data), size);
+}
+
+} // namespace qbinarizer
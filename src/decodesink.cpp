@@ -0,0 +1,290 @@
+#include "internal/decodesink.h"
+
+#include <QDateTime>
+
+namespace qbinarizer {
+
+bool PrimitiveArray::supports(CompiledSchema::Opcode type) {
+  using Opcode = CompiledSchema::Opcode;
+
+  switch (type) {
+  case Opcode::Int8:
+  case Opcode::UInt8:
+  case Opcode::Int16:
+  case Opcode::UInt16:
+  case Opcode::Int32:
+  case Opcode::UInt32:
+  case Opcode::Int64:
+  case Opcode::UInt64:
+  case Opcode::Float:
+  case Opcode::Double:
+    return true;
+  default:
+    return false;
+  }
+}
+
+QVariant PrimitiveArray::value(int index) const {
+  using Opcode = CompiledSchema::Opcode;
+
+  switch (type) {
+  case Opcode::Int8:
+    return static_cast<int>(at<qint8>(index));
+  case Opcode::UInt8:
+    return static_cast<int>(at<quint8>(index));
+  case Opcode::Int16:
+    return static_cast<int>(at<qint16>(index));
+  case Opcode::UInt16:
+    return static_cast<int>(at<quint16>(index));
+  case Opcode::Int32:
+    return at<qint32>(index);
+  case Opcode::UInt32:
+    return static_cast<uint>(at<quint32>(index));
+  case Opcode::Int64:
+    return at<qint64>(index);
+  case Opcode::UInt64:
+    return at<quint64>(index);
+  case Opcode::Float:
+    return at<float>(index);
+  case Opcode::Double:
+    return at<double>(index);
+  default:
+    return QVariant();
+  }
+}
+
+QVariantList PrimitiveArray::toVariantList() const {
+  QVariantList values;
+  values.reserve(count);
+  for (int i = 0; i < count; i++) {
+    values.push_back(value(i));
+  }
+
+  return values;
+}
+
+DecodeSink::~DecodeSink() {}
+
+void DecodeSink::beginMessage(const CompiledSchema &schema) {
+  Q_UNUSED(schema);
+}
+
+void DecodeSink::endMessage() {}
+
+void DecodeSink::beginStruct(int fieldId) { Q_UNUSED(fieldId); }
+
+void DecodeSink::endStruct(int fieldId) { Q_UNUSED(fieldId); }
+
+void DecodeSink::beginArray(int fieldId, int count) {
+  Q_UNUSED(fieldId);
+  Q_UNUSED(count);
+}
+
+void DecodeSink::endArray(int fieldId) { Q_UNUSED(fieldId); }
+
+void DecodeSink::onArray(int fieldId, const PrimitiveArray &array) {
+  using Opcode = CompiledSchema::Opcode;
+
+  const auto replay = [this, fieldId, &array](auto sample) {
+    using T = decltype(sample);
+
+    for (int i = 0; i < array.count; i++) {
+      onValue(fieldId, array.at<T>(i));
+    }
+  };
+
+  beginArray(fieldId, array.count);
+  switch (array.type) {
+  case Opcode::Int8:
+    replay(qint8());
+    break;
+  case Opcode::UInt8:
+    replay(quint8());
+    break;
+  case Opcode::Int16:
+    replay(qint16());
+    break;
+  case Opcode::UInt16:
+    replay(quint16());
+    break;
+  case Opcode::Int32:
+    replay(qint32());
+    break;
+  case Opcode::UInt32:
+    replay(quint32());
+    break;
+  case Opcode::Int64:
+    replay(qint64());
+    break;
+  case Opcode::UInt64:
+    for (int i = 0; i < array.count; i++) {
+      onUnsigned(fieldId, array.at<quint64>(i));
+    }
+    break;
+  case Opcode::Float:
+    for (int i = 0; i < array.count; i++) {
+      onDouble(fieldId, array.at<float>(i));
+    }
+    break;
+  case Opcode::Double:
+    for (int i = 0; i < array.count; i++) {
+      onDouble(fieldId, array.at<double>(i));
+    }
+    break;
+  default:
+    break;
+  }
+  endArray(fieldId);
+}
+
+void DecodeSink::onValue(int fieldId, qint64 value) {
+  Q_UNUSED(fieldId);
+  Q_UNUSED(value);
+}
+
+void DecodeSink::onUnsigned(int fieldId, quint64 value) {
+  Q_UNUSED(fieldId);
+  Q_UNUSED(value);
+}
+
+void DecodeSink::onDouble(int fieldId, double value) {
+  Q_UNUSED(fieldId);
+  Q_UNUSED(value);
+}
+
+void DecodeSink::onBytes(int fieldId, const char *data, qsizetype size) {
+  Q_UNUSED(fieldId);
+  Q_UNUSED(data);
+  Q_UNUSED(size);
+}
+
+void DecodeSink::onNull(int fieldId) { Q_UNUSED(fieldId); }
+
+VariantListSink::VariantListSink() : m_schema(nullptr) {}
+
+QVariantList VariantListSink::result() const { return m_resList; }
+
+void VariantListSink::beginMessage(const CompiledSchema &schema) {
+  m_schema = &schema;
+  m_stack.clear();
+  m_resList = QVariantList();
+}
+
+void VariantListSink::beginStruct(int fieldId) {
+  Q_UNUSED(fieldId);
+
+  m_stack.push_back(Frame());
+}
+
+void VariantListSink::endStruct(int fieldId) {
+  const QVariantMap map = m_stack.last().map;
+  m_stack.removeLast();
+
+  deliver(fieldId, map);
+}
+
+void VariantListSink::beginArray(int fieldId, int count) {
+  Q_UNUSED(fieldId);
+
+  Frame frame;
+  frame.isList = true;
+  frame.list.reserve(count);
+
+  m_stack.push_back(frame);
+}
+
+void VariantListSink::endArray(int fieldId) {
+  const QVariantList list = m_stack.last().list;
+  m_stack.removeLast();
+
+  deliver(fieldId, list);
+}
+
+void VariantListSink::onArray(int fieldId, const PrimitiveArray &array) {
+  deliver(fieldId, array.toVariantList());
+}
+
+void VariantListSink::onValue(int fieldId, qint64 value) {
+  using Opcode = CompiledSchema::Opcode;
+
+  switch (m_schema->at(fieldId).opcode) {
+  case Opcode::UInt24:
+  case Opcode::UInt32:
+    deliver(fieldId, static_cast<uint>(value));
+    break;
+  case Opcode::Int64:
+    deliver(fieldId, value);
+    break;
+  case Opcode::Unixtime: {
+    const auto dateTime = QDateTime::fromMSecsSinceEpoch(value);
+
+    deliver(fieldId, dateTime.toString(Qt::ISODateWithMs));
+  } break;
+  case Opcode::Const:
+    if (value == 0) {
+      deliver(fieldId, false);
+    }
+    break;
+  case Opcode::BitfieldElement:
+    if (value < 0) {
+      deliver(fieldId, value);
+    } else {
+      deliver(fieldId, static_cast<quint64>(value));
+    }
+    break;
+  case Opcode::Crc8:
+  case Opcode::Crc16:
+  case Opcode::Crc32:
+  case Opcode::Crc64:
+    break;
+  default:
+    deliver(fieldId, static_cast<int>(value));
+    break;
+  }
+}
+
+void VariantListSink::onUnsigned(int fieldId, quint64 value) {
+  using Opcode = CompiledSchema::Opcode;
+
+  switch (m_schema->at(fieldId).opcode) {
+  case Opcode::Crc8:
+  case Opcode::Crc16:
+  case Opcode::Crc32:
+  case Opcode::Crc64:
+    break;
+  default:
+    deliver(fieldId, value);
+    break;
+  }
+}
+
+void VariantListSink::onDouble(int fieldId, double value) {
+  if (m_schema->at(fieldId).opcode == CompiledSchema::Opcode::Float) {
+    deliver(fieldId, static_cast<float>(value));
+  } else {
+    deliver(fieldId, value);
+  }
+}
+
+void VariantListSink::onBytes(int fieldId, const char *data, qsizetype size) {
+  deliver(fieldId, QByteArray(data, size).toHex());
+}
+
+void VariantListSink::onNull(int fieldId) { deliver(fieldId, QVariant()); }
+
+void VariantListSink::deliver(int fieldId, const QVariant &value) {
+  const QString &name = m_schema->at(fieldId).name;
+
+  if (m_stack.isEmpty()) {
+    QVariantMap res;
+    res[name] = value;
+
+    m_resList.push_back(res);
+  } else if (m_stack.last().isList) {
+    m_stack.last().list.push_back(value);
+  } else {
+    m_stack.last().map[name] = value;
+  }
+}
+
+} // namespace qbinarizer
@@ -0,0 +1,66 @@
+#include "internal/encodevalues.h"
+
+namespace qbinarizer {
+
+EncodeValues::EncodeValues() {}
+
+EncodeValues::EncodeValues(const CompiledSchema &schema) { reset(schema); }
+
+void EncodeValues::reset(const CompiledSchema &schema) {
+  m_slots.fill(FieldSlot(), schema.size());
+  m_values.fill(QVariant(), schema.size());
+}
+
+int EncodeValues::size() const { return m_slots.size(); }
+
+void EncodeValues::clear() {
+  m_slots.fill(FieldSlot());
+  m_values.fill(QVariant());
+}
+
+void EncodeValues::setInt(int fieldId, qint64 value) {
+  unset(fieldId);
+  m_slots[fieldId].setInt(value);
+}
+
+void EncodeValues::setUInt(int fieldId, quint64 value) {
+  unset(fieldId);
+  m_slots[fieldId].setUInt(value);
+}
+
+void EncodeValues::setDouble(int fieldId, double value) {
+  unset(fieldId);
+  m_slots[fieldId].setDouble(value);
+}
+
+void EncodeValues::setValue(int fieldId, const QVariant &value) {
+  unset(fieldId);
+  m_values[fieldId] = value;
+}
+
+void EncodeValues::unset(int fieldId) {
+  m_slots[fieldId].setNull();
+  m_values[fieldId] = QVariant();
+}
+
+bool EncodeValues::contains(int fieldId) const {
+  return !m_slots.at(fieldId).isNull() || !m_values.at(fieldId).isNull();
+}
+
+const FieldSlot &EncodeValues::slot(int fieldId) const {
+  return m_slots.at(fieldId);
+}
+
+const QVariant &EncodeValues::value(int fieldId) const {
+  return m_values.at(fieldId);
+}
+
+QVariant EncodeValues::toVariant(int fieldId) const {
+  if (!m_slots.at(fieldId).isNull()) {
+    return m_slots.at(fieldId).toVariant();
+  }
+
+  return m_values.at(fieldId);
+}
+
+} // namespace qbinarizer
@@ -0,0 +1,503 @@
+#include "internal/expression.h"
+
+#include <cmath>
+
+namespace qbinarizer {
+
+namespace {
+
+// Parentheses, signs and calls nested deeper than this do not compile
+constexpr int MaxNesting = 256;
+
+struct Function {
+  const char *name;
+  Expression::Op op;
+  int argCount;
+};
+
+constexpr Function functions[] = {
+    {"abs", Expression::Op::Abs, 1},     {"ceil", Expression::Op::Ceil, 1},
+    {"floor", Expression::Op::Floor, 1}, {"round", Expression::Op::Round, 1},
+    {"sqrt", Expression::Op::Sqrt, 1},   {"min", Expression::Op::Min, 2},
+    {"max", Expression::Op::Max, 2},     {"pow", Expression::Op::Pow, 2},
+};
+
+bool isUnary(Expression::Op op) {
+  return (op == Expression::Op::Neg) ||
+         ((op >= Expression::Op::Abs) && (op <= Expression::Op::Sqrt));
+}
+
+bool isDigit(QChar c) {
+  return (c >= QLatin1Char('0')) && (c <= QLatin1Char('9'));
+}
+
+bool isNameStart(QChar c) {
+  return (c == QLatin1Char('_')) ||
+         ((c >= QLatin1Char('a')) && (c <= QLatin1Char('z'))) ||
+         ((c >= QLatin1Char('A')) && (c <= QLatin1Char('Z')));
+}
+
+bool isNamePart(QChar c) { return isNameStart(c) || isDigit(c); }
+
+} // namespace
+
+/**
+ * @brief The ExpressionParser class Recursive descent over the formula text
+ * emitting postfix code. Operands that are known while parsing are folded
+ * into a single constant
+ */
+class ExpressionParser {
+public:
+  ExpressionParser(const QString &text, const Expression::Resolver &resolver,
+                   Expression &expr)
+      : m_text(text), m_resolver(resolver), m_expr(expr), m_pos(0),
+        m_depth(0), m_nesting(0) {}
+
+  bool parse() {
+    if (!parseSum()) {
+      return false;
+    }
+
+    skipSpaces();
+    if (m_pos < m_text.size()) {
+      return fail(QStringLiteral("unexpected '%1'").arg(m_text.at(m_pos)));
+    }
+
+    return true;
+  }
+
+  QString error() const { return m_error; }
+
+protected:
+  bool parseSum() {
+    if (!parseProduct()) {
+      return false;
+    }
+
+    while (true) {
+      Expression::Op op = Expression::Op::Add;
+      if (accept('+')) {
+        op = Expression::Op::Add;
+      } else if (accept('-')) {
+        op = Expression::Op::Sub;
+      } else {
+        return true;
+      }
+
+      if (!parseProduct()) {
+        return false;
+      }
+
+      emitBinary(op);
+    }
+  }
+
+  bool parseProduct() {
+    if (!parsePower()) {
+      return false;
+    }
+
+    while (true) {
+      Expression::Op op = Expression::Op::Mul;
+      if (accept('*')) {
+        op = Expression::Op::Mul;
+      } else if (accept('/')) {
+        op = Expression::Op::Div;
+      } else if (accept('%')) {
+        op = Expression::Op::Mod;
+      } else {
+        return true;
+      }
+
+      if (!parsePower()) {
+        return false;
+      }
+
+      emitBinary(op);
+    }
+  }
+
+  // Left associative and below unary minus, as in tinyexpr
+  bool parsePower() {
+    if (!parseUnary()) {
+      return false;
+    }
+
+    while (accept('^')) {
+      if (!parseUnary()) {
+        return false;
+      }
+
+      emitBinary(Expression::Op::Pow);
+    }
+
+    return true;
+  }
+
+  bool parseUnary() {
+    if (++m_nesting > MaxNesting) {
+      return fail(QStringLiteral("too deeply nested"));
+    }
+
+    const bool parsed = parseSigned();
+    m_nesting--;
+
+    return parsed;
+  }
+
+  bool parseSigned() {
+    if (accept('-')) {
+      if (!parseUnary()) {
+        return false;
+      }
+
+      emitUnary(Expression::Op::Neg);
+
+      return true;
+    }
+
+    if (accept('+')) {
+      return parseUnary();
+    }
+
+    return parsePrimary();
+  }
+
+  bool parsePrimary() {
+    skipSpaces();
+    if (m_pos >= m_text.size()) {
+      return fail(QStringLiteral("unexpected end"));
+    }
+
+    const QChar c = m_text.at(m_pos);
+    if (accept('(')) {
+      if (!parseSum()) {
+        return false;
+      }
+
+      return accept(')') || fail(QStringLiteral("missing ')'"));
+    }
+
+    if (isDigit(c) || (c == QLatin1Char('.'))) {
+      return parseNumber();
+    }
+
+    if (isNameStart(c)) {
+      return parseName();
+    }
+
+    return fail(QStringLiteral("unexpected '%1'").arg(c));
+  }
+
+  bool parseNumber() {
+    const int start = m_pos;
+    bool ok = false;
+    double value = 0.0;
+
+    const QStringView text(m_text);
+    if (text.mid(m_pos).startsWith(QLatin1String("0x"), Qt::CaseInsensitive)) {
+      m_pos += 2;
+      while ((m_pos < m_text.size()) && isNamePart(m_text.at(m_pos))) {
+        m_pos++;
+      }
+
+      value = text.mid(start + 2, m_pos - start - 2).toULongLong(&ok, 16);
+    } else {
+      while ((m_pos < m_text.size()) &&
+             (isDigit(m_text.at(m_pos)) || (m_text.at(m_pos) == '.'))) {
+        m_pos++;
+      }
+
+      if ((m_pos < m_text.size()) && (m_text.at(m_pos).toLower() == 'e')) {
+        m_pos++;
+        if ((m_pos < m_text.size()) &&
+            ((m_text.at(m_pos) == '+') || (m_text.at(m_pos) == '-'))) {
+          m_pos++;
+        }
+        while ((m_pos < m_text.size()) && isDigit(m_text.at(m_pos))) {
+          m_pos++;
+        }
+      }
+
+      value = text.mid(start, m_pos - start).toDouble(&ok);
+    }
+
+    if (!ok) {
+      return fail(QStringLiteral("bad number '%1'")
+                      .arg(m_text.mid(start, m_pos - start)));
+    }
+
+    return emitConst(value);
+  }
+
+  bool parseName() {
+    const int start = m_pos;
+    while ((m_pos < m_text.size()) && isNamePart(m_text.at(m_pos))) {
+      m_pos++;
+    }
+
+    const QString name = m_text.mid(start, m_pos - start);
+
+    skipSpaces();
+    if ((m_pos < m_text.size()) && (m_text.at(m_pos) == '(')) {
+      return parseCall(name);
+    }
+
+    const int slot = m_resolver ? m_resolver(name) : -1;
+    if (slot < 0) {
+      return fail(QStringLiteral("unknown name '%1'").arg(name));
+    }
+
+    return emitSlot(slot);
+  }
+
+  bool parseCall(const QString &name) {
+    const Function *function = nullptr;
+    for (const Function &f : functions) {
+      if (name == QLatin1String(f.name)) {
+        function = &f;
+        break;
+      }
+    }
+
+    if (function == nullptr) {
+      return fail(QStringLiteral("unknown function '%1'").arg(name));
+    }
+
+    accept('(');
+    for (int i = 0; i < function->argCount; i++) {
+      if ((i > 0) && !accept(',')) {
+        return fail(QStringLiteral("'%1' takes %2 arguments")
+                        .arg(name)
+                        .arg(function->argCount));
+      }
+
+      if (!parseSum()) {
+        return false;
+      }
+    }
+
+    if (!accept(')')) {
+      return fail(QStringLiteral("missing ')' after '%1'").arg(name));
+    }
+
+    if (function->argCount == 1) {
+      emitUnary(function->op);
+    } else {
+      emitBinary(function->op);
+    }
+
+    return true;
+  }
+
+  void skipSpaces() {
+    while ((m_pos < m_text.size()) && m_text.at(m_pos).isSpace()) {
+      m_pos++;
+    }
+  }
+
+  bool accept(char c) {
+    skipSpaces();
+    if ((m_pos < m_text.size()) && (m_text.at(m_pos) == QLatin1Char(c))) {
+      m_pos++;
+
+      return true;
+    }
+
+    return false;
+  }
+
+  bool emitConst(double value) {
+    return push({Expression::Op::Const, -1, value});
+  }
+
+  bool emitSlot(int slot) {
+    if (!m_expr.m_slotRefs.contains(slot)) {
+      m_expr.m_slotRefs.push_back(slot);
+    }
+
+    return push({Expression::Op::Slot, slot, 0.0});
+  }
+
+  void emitUnary(Expression::Op op) {
+    Expression::Instruction &top = m_expr.m_code.last();
+    if (top.op == Expression::Op::Const) {
+      top.value = Expression::apply(op, top.value);
+
+      return;
+    }
+
+    m_expr.m_code.push_back({op, -1, 0.0});
+  }
+
+  void emitBinary(Expression::Op op) {
+    m_depth--;
+
+    QVector<Expression::Instruction> &code = m_expr.m_code;
+    const int size = code.size();
+    if ((code.at(size - 1).op == Expression::Op::Const) &&
+        (code.at(size - 2).op == Expression::Op::Const)) {
+      code[size - 2].value = Expression::apply(op, code.at(size - 2).value,
+                                               code.at(size - 1).value);
+      code.removeLast();
+
+      return;
+    }
+
+    code.push_back({op, -1, 0.0});
+  }
+
+  bool push(const Expression::Instruction &instr) {
+    if (++m_depth > Expression::MaxDepth) {
+      return fail(QStringLiteral("too deeply nested"));
+    }
+
+    m_expr.m_code.push_back(instr);
+
+    return true;
+  }
+
+  bool fail(const QString &message) {
+    if (m_error.isEmpty()) {
+      m_error = QStringLiteral("%1 at %2").arg(message).arg(m_pos);
+    }
+
+    return false;
+  }
+
+private:
+  const QString &m_text;
+  const Expression::Resolver &m_resolver;
+  Expression &m_expr;
+  int m_pos;
+  int m_depth;
+  int m_nesting;
+  QString m_error;
+};
+
+Expression::Expression() : m_valid(false) {}
+
+Expression Expression::compile(const QString &text, const Resolver &resolver,
+                               QString *error) {
+  Expression expr;
+  expr.m_text = text;
+
+  ExpressionParser parser(text, resolver, expr);
+  expr.m_valid = parser.parse();
+  if (!expr.m_valid) {
+    expr.m_code.clear();
+    expr.m_slotRefs.clear();
+  }
+
+  if (error != nullptr) {
+    *error = parser.error();
+  }
+
+  return expr;
+}
+
+bool Expression::isValid() const { return m_valid; }
+
+bool Expression::isConstant() const { return m_valid && m_slotRefs.isEmpty(); }
+
+QString Expression::text() const { return m_text; }
+
+const QVector<Expression::Instruction> &Expression::code() const {
+  return m_code;
+}
+
+const QVector<int> &Expression::slotRefs() const { return m_slotRefs; }
+
+bool Expression::eval(const FieldSlot *slots, double &value) const {
+  if (!m_valid) {
+    return false;
+  }
+
+  for (const int slot : m_slotRefs) {
+    if (!slots[slot].isVisited() || slots[slot].isNull()) {
+      return false;
+    }
+  }
+
+  double stack[MaxDepth];
+  int top = -1;
+  for (const Instruction &instr : m_code) {
+    switch (instr.op) {
+    case Op::Const:
+      stack[++top] = instr.value;
+      break;
+    case Op::Slot:
+      stack[++top] = slots[instr.slot].toDouble();
+      break;
+    default:
+      if (isUnary(instr.op)) {
+        stack[top] = apply(instr.op, stack[top]);
+      } else {
+        top--;
+        stack[top] = apply(instr.op, stack[top], stack[top + 1]);
+      }
+      break;
+    }
+  }
+
+  value = stack[0];
+
+  return true;
+}
+
+bool Expression::evalInt(const FieldSlot *slots, qint64 &value) const {
+  double result = 0.0;
+  // 2^63 is the first double past the qint64 range
+  if (!eval(slots, result) || !(result >= -9223372036854775808.0) ||
+      !(result < 9223372036854775808.0)) {
+    return false;
+  }
+
+  value = static_cast<qint64>(result);
+
+  return true;
+}
+
+double Expression::apply(Op op, double value) {
+  switch (op) {
+  case Op::Neg:
+    return -value;
+  case Op::Abs:
+    return std::fabs(value);
+  case Op::Ceil:
+    return std::ceil(value);
+  case Op::Floor:
+    return std::floor(value);
+  case Op::Round:
+    return std::round(value);
+  case Op::Sqrt:
+    return std::sqrt(value);
+  default:
+    return value;
+  }
+}
+
+double Expression::apply(Op op, double left, double right) {
+  switch (op) {
+  case Op::Add:
+    return left + right;
+  case Op::Sub:
+    return left - right;
+  case Op::Mul:
+    return left * right;
+  case Op::Div:
+    return left / right;
+  case Op::Mod:
+    return std::fmod(left, right);
+  case Op::Pow:
+    return std::pow(left, right);
+  case Op::Min:
+    return qMin(left, right);
+  case Op::Max:
+    return qMax(left, right);
+  default:
+    return left;
+  }
+}
+
+} // namespace qbinarizer
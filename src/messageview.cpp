@@ -0,0 +1,403 @@
+#include "internal/messageview.h"
+
+#include "bitutils.h"
+#include "internal/bytecursor.h"
+
+#include <limits>
+
+namespace qbinarizer {
+
+MessageView::MessageView(const CompiledSchema &schema, const char *data,
+                         qsizetype size)
+    : m_schema(schema), m_data(data), m_size(size), m_pos(0), m_next(0) {
+  m_offsets.fill(-1, m_schema.size());
+  m_counts.fill(0, m_schema.size());
+}
+
+MessageView::MessageView(const CompiledSchema &schema, const QByteArray &data)
+    : MessageView(schema, data.constData(), data.size()) {}
+
+const CompiledSchema &MessageView::schema() const { return m_schema; }
+
+bool MessageView::contains(int fieldId) { return count(fieldId) > 0; }
+
+bool MessageView::contains(const QString &name) {
+  return contains(m_schema.indexOf(name));
+}
+
+qsizetype MessageView::offset(int fieldId) {
+  if (count(fieldId) == 0) {
+    return -1;
+  }
+
+  return m_offsets[fieldId];
+}
+
+qsizetype MessageView::offset(const QString &name) {
+  return offset(m_schema.indexOf(name));
+}
+
+int MessageView::count(int fieldId) {
+  if ((fieldId < 0) || (fieldId >= m_schema.size())) {
+    return 0;
+  }
+
+  ensure(fieldId);
+
+  return m_counts[fieldId];
+}
+
+int MessageView::count(const QString &name) {
+  return count(m_schema.indexOf(name));
+}
+
+QVariant MessageView::value(int fieldId, int element) {
+  if (count(fieldId) == 0) {
+    return QVariant();
+  }
+
+  return read(fieldId, element);
+}
+
+QVariant MessageView::value(const QString &name, int element) {
+  return value(m_schema.indexOf(name), element);
+}
+
+qint64 MessageView::toInt(int fieldId, int element) {
+  return value(fieldId, element).toLongLong();
+}
+
+qint64 MessageView::toInt(const QString &name, int element) {
+  return toInt(m_schema.indexOf(name), element);
+}
+
+quint64 MessageView::toUInt(int fieldId, int element) {
+  return value(fieldId, element).toULongLong();
+}
+
+quint64 MessageView::toUInt(const QString &name, int element) {
+  return toUInt(m_schema.indexOf(name), element);
+}
+
+double MessageView::toDouble(int fieldId, int element) {
+  return value(fieldId, element).toDouble();
+}
+
+double MessageView::toDouble(const QString &name, int element) {
+  return toDouble(m_schema.indexOf(name), element);
+}
+
+QByteArray MessageView::toBytes(int fieldId, int element) {
+  if (count(fieldId) <= element) {
+    return QByteArray();
+  }
+
+  const int size = elementSize(fieldId);
+  if ((size <= 0) || (element < 0)) {
+    return QByteArray();
+  }
+
+  const qsizetype offset = m_offsets[fieldId] + qsizetype(element) * size;
+  if (offset + size <= m_size) {
+    return QByteArray::fromRawData(m_data + offset, size);
+  }
+
+  // Cut off by the end of the frame, padded like StructDecoder does
+  QByteArray bytes(size, static_cast<char>(0));
+  if (offset < m_size) {
+    std::memcpy(bytes.data(), m_data + offset, m_size - offset);
+  }
+
+  return bytes;
+}
+
+QByteArray MessageView::toBytes(const QString &name, int element) {
+  return toBytes(m_schema.indexOf(name), element);
+}
+
+void MessageView::ensure(int fieldId) {
+  // Offsets of the fixed prefix are known without stepping over anything
+  const CompiledSchema::Instruction &instr = m_schema.at(fieldId);
+  if ((instr.offset >= 0) && (m_size >= m_schema.fixedPrefixSize())) {
+    m_offsets[fieldId] = instr.offset;
+    if (instr.opcode == CompiledSchema::Opcode::BitfieldElement) {
+      m_counts[fieldId] = (instr.bitOffset >= 0) ? 1 : 0;
+    } else {
+      m_counts[fieldId] = qMax(instr.count, 1);
+    }
+
+    return;
+  }
+
+  int root = fieldId;
+  while (m_schema.at(root).parent >= 0) {
+    root = m_schema.at(root).parent;
+  }
+
+  while ((m_next <= root) && (m_next < m_schema.size())) {
+    const int index = m_next;
+    m_next = m_schema.at(index).end;
+
+    measureField(index);
+  }
+}
+
+void MessageView::measureField(int index) {
+  const CompiledSchema::Instruction &instr = m_schema.at(index);
+
+  qint64 pos = instr.pos;
+  if ((instr.posExpr >= 0) && !evalFormula(instr.posExpr, pos)) {
+    return;
+  }
+
+  if ((pos >= 0) && (pos <= m_size)) {
+    m_pos = pos;
+  }
+  m_offsets[index] = m_pos;
+
+  int count = instr.count;
+  if (instr.countRef != CompiledSchema::NoRef) {
+    if ((instr.countRef == CompiledSchema::UnresolvedRef) ||
+        (m_offsets[instr.countRef] < 0)) {
+      return;
+    }
+
+    count = slotValue(instr.countRef).toInt();
+  } else if (instr.countExpr >= 0) {
+    qint64 value = 0;
+    if (!evalFormula(instr.countExpr, value)) {
+      return;
+    }
+
+    count = static_cast<int>(
+        qBound<qint64>(0, value, std::numeric_limits<int>::max()));
+  }
+
+  if (instr.sizeExpr >= 0) {
+    qint64 size = 0;
+    evalFormula(instr.sizeExpr, size);
+
+    if (m_sizes.isEmpty()) {
+      m_sizes.fill(0, m_schema.size());
+    }
+    m_sizes[index] = static_cast<int>(qBound<qint64>(0, size, m_size));
+  }
+
+  if (count <= 1) {
+    m_counts[index] = 1;
+    measureElement(index);
+
+    return;
+  }
+
+  m_counts[index] = count;
+
+  const int size = elementSize(index);
+  if (size >= 0) {
+    advance(qsizetype(count) * size);
+
+    return;
+  }
+
+  for (int i = 0; i < count; i++) {
+    measureElement(index);
+  }
+}
+
+void MessageView::measureElement(int index) {
+  using Opcode = CompiledSchema::Opcode;
+
+  const CompiledSchema::Instruction &instr = m_schema.at(index);
+
+  switch (instr.opcode) {
+  case Opcode::Struct:
+    for (int i = index + 1; i < instr.end; i = m_schema.at(i).end) {
+      measureField(i);
+    }
+    break;
+  case Opcode::Custom: {
+    if ((instr.dependRef < 0) || (m_offsets[instr.dependRef] < 0)) {
+      return;
+    }
+
+    const int branch =
+        m_schema.chooseBranch(index, slotValue(instr.dependRef));
+    if ((branch >= 0) && (m_schema.at(branch).opcode != Opcode::None)) {
+      measureField(branch);
+    }
+  } break;
+  case Opcode::Bitfield:
+    for (int i = index + 1; i < instr.end; i++) {
+      m_offsets[i] = m_pos;
+      m_counts[i] = (m_schema.at(i).bitOffset >= 0) ? 1 : 0;
+    }
+
+    advance(instr.size);
+    break;
+  default:
+    advance(elementSize(index));
+    break;
+  }
+}
+
+void MessageView::advance(qsizetype size) {
+  m_pos = qMin(m_pos + size, m_size);
+}
+
+int MessageView::elementSize(int index) const {
+  using Opcode = CompiledSchema::Opcode;
+
+  const CompiledSchema::Instruction &instr = m_schema.at(index);
+
+  switch (instr.opcode) {
+  case Opcode::Struct:
+  case Opcode::Custom:
+    return -1;
+  case Opcode::Raw:
+  case Opcode::Skip:
+    return (instr.sizeExpr >= 0) ? m_sizes.value(index, 0) : instr.size;
+  case Opcode::Const:
+  case Opcode::Bitfield:
+  case Opcode::Crc8:
+  case Opcode::Crc16:
+  case Opcode::Crc32:
+  case Opcode::Crc64:
+    return instr.size;
+  default:
+    return CompiledSchema::valueSize(instr.opcode);
+  }
+}
+
+FieldSlot MessageView::slotValue(int index) {
+  using Opcode = CompiledSchema::Opcode;
+
+  // Only fields StructDecoder keeps a value for can drive count and depend
+  switch (m_schema.at(index).opcode) {
+  case Opcode::Const:
+  case Opcode::Raw:
+  case Opcode::Skip:
+  case Opcode::Struct:
+  case Opcode::Custom:
+  case Opcode::Bitfield:
+  case Opcode::None:
+    return FieldSlot();
+  default:
+    break;
+  }
+
+  if (m_counts[index] == 0) {
+    return FieldSlot();
+  }
+
+  const int last = (elementSize(index) >= 0) ? m_counts[index] - 1 : 0;
+
+  return FieldSlot::fromVariant(read(index, last));
+}
+
+bool MessageView::evalFormula(int expr, qint64 &value) {
+  const Expression &formula = m_schema.expression(expr);
+
+  if (m_slots.isEmpty()) {
+    m_slots.resize(m_schema.size());
+  }
+
+  for (const int ref : formula.slotRefs()) {
+    if (m_offsets[ref] < 0) {
+      return false;
+    }
+
+    m_slots[ref] = slotValue(ref);
+    m_slots[ref].from = m_offsets[ref];
+  }
+
+  return formula.evalInt(m_slots.constData(), value);
+}
+
+QVariant MessageView::read(int index, int element) {
+  using Opcode = CompiledSchema::Opcode;
+
+  const CompiledSchema::Instruction &instr = m_schema.at(index);
+  if ((element < 0) || (element >= m_counts[index])) {
+    return QVariant();
+  }
+
+  if (instr.opcode == Opcode::BitfieldElement) {
+    const int size = m_schema.at(instr.parent).size;
+    const qsizetype offset = m_offsets[index];
+
+    // Zero padding for the 9-byte load of extractBits
+    m_scratch.fill(static_cast<char>(0), size + sizeof(quint64) + 1);
+    const qsizetype available = qBound<qsizetype>(0, m_size - offset, size);
+    if (available > 0) {
+      std::memcpy(m_scratch.data(), m_data + offset, available);
+    }
+
+    const quint64 valueU =
+        extractBits(m_scratch.constData() + instr.bitOffset, instr.bitShift,
+                    instr.size, instr.reversed);
+    if (!instr.isSigned) {
+      return valueU;
+    }
+
+    if (instr.size >= 64) {
+      return static_cast<qint64>(valueU);
+    }
+
+    const int unused = 64 - instr.size;
+
+    return static_cast<qint64>(valueU << unused) >> unused;
+  }
+
+  const int size = elementSize(index);
+  if ((size < 0) || ((size == 0) && (element > 0))) {
+    return QVariant();
+  }
+
+  if (instr.opcode == Opcode::Raw) {
+    return toBytes(index, element);
+  }
+
+  const qsizetype offset = m_offsets[index] + qsizetype(element) * size;
+  const bool fits = offset + size <= m_size;
+  const char *src = m_data + offset;
+  const bool bigEndian = instr.bigEndian;
+
+  switch (instr.opcode) {
+  case Opcode::Int8:
+    return fits ? qint64(loadValue<qint8>(src, bigEndian)) : 0;
+  case Opcode::UInt8:
+  case Opcode::Crc8:
+    return fits ? qint64(loadValue<quint8>(src, bigEndian)) : 0;
+  case Opcode::Int16:
+    return fits ? qint64(loadValue<qint16>(src, bigEndian)) : 0;
+  case Opcode::UInt16:
+  case Opcode::Crc16:
+    return fits ? qint64(loadValue<quint16>(src, bigEndian)) : 0;
+  case Opcode::Int24:
+    return fits ? qint64(fixSign24(loadUInt24(src, bigEndian))) : 0;
+  case Opcode::UInt24:
+    return fits ? qint64(loadUInt24(src, bigEndian)) : 0;
+  case Opcode::Int32:
+    return fits ? qint64(loadValue<qint32>(src, bigEndian)) : 0;
+  case Opcode::UInt32:
+  case Opcode::Crc32:
+    return fits ? qint64(loadValue<quint32>(src, bigEndian)) : 0;
+  case Opcode::Int64:
+  case Opcode::Unixtime:
+    return fits ? loadValue<qint64>(src, bigEndian) : 0;
+  case Opcode::UInt64:
+  case Opcode::Crc64:
+    return fits ? loadValue<quint64>(src, bigEndian) : quint64(0);
+  case Opcode::Float:
+    return fits ? double(loadValue<float>(src, bigEndian)) : 0.0;
+  case Opcode::Double:
+    return fits ? loadValue<double>(src, bigEndian) : 0.0;
+  case Opcode::Const:
+    return qint64(fits && (std::memcmp(src, instr.constData.constData(),
+                                       size) == 0));
+  default:
+    return QVariant();
+  }
+}
+
+} // namespace qbinarizer
@@ -0,0 +1,88 @@
+#include "internal/schemacache.h"
+
+#include "jsonutils.h"
+
+#include <QMutexLocker>
+
+namespace qbinarizer {
+
+SchemaCache::SchemaCache(int capacity)
+    : m_cache(capacity), m_hits(0), m_misses(0) {}
+
+SchemaCache &SchemaCache::globalInstance() {
+  static SchemaCache cache;
+
+  return cache;
+}
+
+QVariantList SchemaCache::parsed(const QString &datafieldListStr) {
+  return lookup(datafieldListStr).parsed;
+}
+
+CompiledSchema SchemaCache::compiled(const QString &datafieldListStr) {
+  return lookup(datafieldListStr).compiled;
+}
+
+int SchemaCache::capacity() const {
+  QMutexLocker locker(&m_mutex);
+
+  return m_cache.maxCost();
+}
+
+void SchemaCache::setCapacity(int capacity) {
+  QMutexLocker locker(&m_mutex);
+
+  m_cache.setMaxCost(capacity);
+}
+
+quint64 SchemaCache::hits() const {
+  QMutexLocker locker(&m_mutex);
+
+  return m_hits;
+}
+
+quint64 SchemaCache::misses() const {
+  QMutexLocker locker(&m_mutex);
+
+  return m_misses;
+}
+
+void SchemaCache::clear() {
+  QMutexLocker locker(&m_mutex);
+
+  m_cache.clear();
+  m_hits = 0;
+  m_misses = 0;
+}
+
+SchemaCache::Entry SchemaCache::lookup(const QString &datafieldListStr) {
+  {
+    QMutexLocker locker(&m_mutex);
+
+    // QCache::object moves the entry to the front of the LRU list
+    const Entry *entry = m_cache.object(datafieldListStr);
+    if (entry) {
+      m_hits++;
+
+      return *entry;
+    }
+
+    m_misses++;
+  }
+
+  // Parse and compile outside the lock, a concurrent miss on the same text
+  // only costs a duplicate compile
+  Entry *entry = new Entry;
+  entry->parsed = parseJson(datafieldListStr);
+  entry->compiled = CompiledSchema(entry->parsed);
+
+  const Entry res = *entry;
+
+  // QCache owns the entry even if it is dropped right away
+  QMutexLocker locker(&m_mutex);
+  m_cache.insert(datafieldListStr, entry);
+
+  return res;
+}
+
+} // namespace qbinarizer
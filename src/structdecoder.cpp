@@ -1,648 +1,654 @@
 #include "internal/structdecoder.h"
 
-#include "bitfield/bitfield.h"
 #include "bitutils.h"
 #include "checksum.h"
-#include "jsonutils.h"
+#include "internal/crcutils.h"
+#include "internal/schemacache.h"
 
-#include <QDateTime>
+#include <cstring>
+#include <limits>
 
 namespace qbinarizer {
 
-StructDecoder::StructDecoder(QObject *parent) : QObject{parent} {}
+StructDecoder::StructDecoder(QObject *parent)
+    : QObject{parent}, m_sink(nullptr) {}
 
 QVariantList StructDecoder::decode(const QString &datafieldListStr,
                                    const QByteArray &data) {
-  const QVariantList datafieldList = parseJson(datafieldListStr);
-  QVariantList valueList = decode(datafieldList, data);
+  const CompiledSchema schema =
+      SchemaCache::globalInstance().compiled(datafieldListStr);
+  QVariantList valueList = decode(schema, data);
 
   return valueList;
 }
 
 QVariantList StructDecoder::decode(const QVariantList &datafieldList,
                                    const QByteArray &data) {
-  clear();
+  return decode(datafieldList, data.constData(), data.size());
+}
 
-  if (datafieldList.isEmpty()) {
-    return {};
-  }
+QVariantList StructDecoder::decode(const QVariantList &datafieldList,
+                                   const char *data, qsizetype size) {
+  const CompiledSchema schema(datafieldList);
 
-  m_datafieldList = datafieldList;
-  m_data = data;
+  return decode(schema, data, size);
+}
 
-  m_buf.setData(m_data);
-  m_buf.open(QIODevice::ReadOnly);
-  m_ds.setDevice(&m_buf);
+QVariantList StructDecoder::decode(const CompiledSchema &schema,
+                                   const QByteArray &data) {
+  return decode(schema, data.constData(), data.size());
+}
 
-  decode();
+QVariantList StructDecoder::decode(const CompiledSchema &schema,
+                                   const char *data, qsizetype size) {
+  VariantListSink sink;
+  decode(schema, data, size, sink);
 
-  return m_resList;
+  return sink.result();
 }
 
-void StructDecoder::clear() {
-  m_name = QString();
-  m_datafieldList = QVariantList();
-  m_pos = 0;
-
-  m_buf.close();
-  m_ds.setDevice(nullptr);
-  m_data = QByteArray();
-  m_resList = QVariantList();
-  m_decodedFields = QVariantMap();
+void StructDecoder::decode(const CompiledSchema &schema,
+                           const QByteArray &data, DecodeSink &sink) {
+  decode(schema, data.constData(), data.size(), sink);
 }
 
-void StructDecoder::decode() { m_resList = decodeList(m_datafieldList); }
+void StructDecoder::decode(const CompiledSchema &schema, const char *data,
+                           qsizetype size, DecodeSink &sink) {
+  clear();
 
-inline QVariantMap toMap(const QVariantMap &field) {
-  const QString &name = field["name"].toString();
+  if (schema.isEmpty()) {
+    return;
+  }
 
-  QVariantMap res;
+  m_schema = schema;
+  m_sink = &sink;
+  m_slots.fill(FieldSlot(), schema.size());
+  m_reader.reset(data, size);
+  openCrcRegions();
 
-  if (field.contains("value")) {
-    res[name] = field["value"];
+  // One length check covers every read of the fixed prefix
+  int first = 0;
+  if (size >= m_schema.fixedPrefixSize()) {
+    first = m_schema.fixedPrefixEnd();
   }
 
-  return res;
-}
+  m_sink->beginMessage(m_schema);
+  execFixed(0, first);
+  execList(first, m_schema.size());
+  m_sink->endMessage();
 
-QVariantList StructDecoder::decodeList(const QVariantList &fieldList) {
-  QVariantList resList;
+  m_reader.reset();
+  m_sink = nullptr;
+}
 
-  for (int i = 0; i < fieldList.size(); i++) {
-    const QVariant &field = fieldList.at(i);
-    if (field.type() == QVariant::List) {
-      const QVariantList subList = field.toList();
-      QVariantList subResList = decodeList(subList);
+void StructDecoder::clear() {
+  m_schema = CompiledSchema();
+  m_sink = nullptr;
 
-      resList.append(subResList);
-    } else if (field.type() == QVariant::Map) {
-      const QVariantMap fieldMap = field.toMap();
+  m_reader.reset();
+  m_slots.clear();
+  m_crcRegions.clear();
+}
 
-      QVariantMap res = decodeMap(fieldMap);
-      if (res.isEmpty()) {
-        continue;
-      }
+void StructDecoder::execList(int first, int end) {
+  for (int i = first; i < end; i = m_schema.at(i).end) {
+    execField(i);
 
-      resList.push_back(res);
-    }
+    advanceCrcRegions();
   }
-
-  return resList;
 }
 
-QVariantMap StructDecoder::decodeMap(const QVariantMap &field) {
-  const QString &fieldName = field.firstKey();
-  const QVariantMap fieldDescription = field[fieldName].toMap();
-  const QString type = fieldDescription["type"].toString();
-
-  // const qint64 oldPos = m_buf.pos();
-  qint64 newPos = -1;
-  if (fieldDescription.contains("pos") &&
-      fieldDescription["pos"].canConvert<qint64>()) {
-    newPos = fieldDescription["pos"].toLongLong();
-    m_buf.seek(newPos);
-  }
-
-  QVariantMap decodedField;
-  decodedField["name"] = fieldName;
-  decodedField["from"] = m_buf.pos();
-  decodedField["type"] = type;
-  m_decodedFields[fieldName] = decodedField;
-
-  if (fieldDescription.contains("count")) {
-    int count = 0;
-
-    const QVariant &countValue = fieldDescription["count"];
-    if (countValue.type() == QVariant::String) {
-      const QString countField = countValue.toString();
-      if (!m_decodedFields.contains(countField)) {
-        return {};
-      }
-
-      count = getDecodedValue(countField).toInt();
-    } else {
-      count = countValue.toInt();
-    }
-
-    if (count > 1) {
-      QVariantMap subFieldDescription = fieldDescription;
-      subFieldDescription["count"] = 1;
-      subFieldDescription.remove("pos");
+void StructDecoder::execFixed(int first, int end) {
+  using Opcode = CompiledSchema::Opcode;
 
-      QVariantMap subField;
-      subField[fieldName] = subFieldDescription;
+  for (int i = first; i < end; i = m_schema.at(i).end) {
+    const CompiledSchema::Instruction &instr = m_schema.at(i);
 
-      QVariantList subResList;
-      for (int i = 0; i < count; i++) {
-        const QVariantMap subRes = decodeMap(subField);
-        if (subRes.isEmpty()) {
-          continue;
-        }
+    if ((instr.count > 1) || (instr.offset < 0)) {
+      execField(i);
+    } else if (instr.opcode == Opcode::Struct) {
+      m_slots[i].from = instr.offset;
 
-        const QVariant &value = subRes.first();
-        subResList.push_back(value);
-      }
-
-      QVariantMap res;
-      res["name"] = fieldName;
-      res["value"] = subResList;
-
-      //      if (newPos >= 0) {
-      //        m_buf.seek(oldPos);
-      //      }
-
-      return toMap(res);
+      m_sink->beginStruct(i);
+      execFixed(i + 1, instr.end);
+      m_sink->endStruct(i);
+    } else if (execFixedValue(i)) {
+      m_slots[i].from = instr.offset;
+      m_reader.seek(instr.offset + instr.fixedSize);
+    } else {
+      execField(i);
     }
+
+    advanceCrcRegions();
   }
+}
 
-  QVariantMap valueRes;
-
-  if (type == "array") {
-    QVariantMap fieldDescriptionNew = fieldDescription;
-    fieldDescriptionNew["type"] = fieldDescription["subtype"];
-    fieldDescriptionNew.remove("subtype");
-    fieldDescriptionNew.remove("pos");
-
-    QVariantMap fieldNew;
-    fieldNew[fieldName] = fieldDescriptionNew;
-
-    valueRes = decodeMap(fieldNew);
-  } else if (type.startsWith("int") || type.startsWith("uint") ||
-             (type == "float") || (type == "double")) {
-    valueRes = decodeValue(field);
-  } else if (type == "const") {
-    valueRes = decodeConst(field);
-  } else if (type.startsWith("crc")) {
-    valueRes = decodeCrc(field);
-  } else if (type == "struct") {
-    valueRes = decodeStruct(field);
-  } else if (type == "custom") {
-    valueRes = decodeCustom(field);
-  } else if (type == "unixtime") {
-    valueRes = decodeUnixtime(field);
-  } else if (type == "raw") {
-    valueRes = decodeRaw(field);
-  } else if (type == "skip") {
-    valueRes = decodeSkip(field);
-  } else if (type == "bitfield") {
-    valueRes = decodeBitfield(field);
-  }
-
-  //  if (newPos >= 0) {
-  //    m_buf.seek(oldPos);
-  //  }
-
-  return valueRes;
+bool StructDecoder::execFixedValue(int index) {
+  using Opcode = CompiledSchema::Opcode;
+
+  const CompiledSchema::Instruction &instr = m_schema.at(index);
+  const char *src = m_reader.data() + instr.offset;
+  const bool bigEndian = instr.bigEndian;
+
+  switch (instr.opcode) {
+  case Opcode::Int8:
+    setValue(index, loadValue<qint8>(src, bigEndian));
+    break;
+  case Opcode::UInt8:
+    setValue(index, loadValue<quint8>(src, bigEndian));
+    break;
+  case Opcode::Int16:
+    setValue(index, loadValue<qint16>(src, bigEndian));
+    break;
+  case Opcode::UInt16:
+    setValue(index, loadValue<quint16>(src, bigEndian));
+    break;
+  case Opcode::Int24:
+    setValue(index, fixSign24(loadUInt24(src, bigEndian)));
+    break;
+  case Opcode::UInt24:
+    setValue(index, loadUInt24(src, bigEndian));
+    break;
+  case Opcode::Int32:
+    setValue(index, loadValue<qint32>(src, bigEndian));
+    break;
+  case Opcode::UInt32:
+    setValue(index, loadValue<quint32>(src, bigEndian));
+    break;
+  case Opcode::Int64:
+  case Opcode::Unixtime:
+    setValue(index, loadValue<qint64>(src, bigEndian));
+    break;
+  case Opcode::UInt64:
+    setUnsigned(index, loadValue<quint64>(src, bigEndian));
+    break;
+  case Opcode::Float:
+    setDouble(index, loadValue<float>(src, bigEndian));
+    break;
+  case Opcode::Double:
+    setDouble(index, loadValue<double>(src, bigEndian));
+    break;
+  default:
+    return false;
+  }
+
+  return true;
 }
 
-QVariantMap StructDecoder::decodeValue(const QVariantMap &field) {
-  const QString &fieldName = field.firstKey();
-  const QVariantMap fieldDescription = field[fieldName].toMap();
+void StructDecoder::execField(int index) {
+  const CompiledSchema::Instruction &instr = m_schema.at(index);
 
-  const QString endian = fieldDescription["endian"].toString().toLower();
-  const bool bigEndian = (endian == "big");
-  if (bigEndian) {
-    m_ds.setByteOrder(QDataStream::BigEndian);
-  } else {
-    m_ds.setByteOrder(QDataStream::LittleEndian);
-  }
-
-  QVariant value;
-
-  // Value
-  const QString type = fieldDescription["type"].toString();
-  if (type == "int8" || type == "char") {
-    readValue<qint8>(m_ds, value);
-  } else if (type == "uint8") {
-    readValue<qint8>(m_ds, value);
-  } else if (type == "int16") {
-    readValue<qint16>(m_ds, value);
-  } else if (type == "uint16") {
-    readValue<quint16>(m_ds, value);
-  } else if (type == "int24") {
-    qint32 val = read24<qint32>(m_ds);
-    if (bigEndian) {
-      val = reverse24<qint32>(val);
+  if (instr.pos >= 0) {
+    m_reader.seek(instr.pos);
+  } else if (instr.posExpr >= 0) {
+    qint64 pos = 0;
+    if (!m_schema.expression(instr.posExpr)
+             .evalInt(m_slots.constData(), pos)) {
+      return;
     }
-    val = fixSign24(val);
-    value = val;
-  } else if (type == "uint24") {
-    quint32 val = read24<quint32>(m_ds);
-    if (bigEndian) {
-      val = reverse24<quint32>(val);
-    }
-    value = val;
-  } else if (type == "int32") {
-    readValue<qint32>(m_ds, value);
-  } else if (type == "uint32") {
-    readValue<quint32>(m_ds, value);
-  } else if (type == "int64") {
-    readValue<qint64>(m_ds, value);
-  } else if (type == "uint64") {
-    readValue<quint64>(m_ds, value);
-  } else if (type == "float") {
-    m_ds.setFloatingPointPrecision(QDataStream::SinglePrecision);
-
-    readValue<float>(m_ds, value);
-  } else if (type == "double") {
-    m_ds.setFloatingPointPrecision(QDataStream::DoublePrecision);
-
-    readValue<double>(m_ds, value);
-  }
-  setDecodedValue(fieldName, value);
-
-  QVariantMap res;
-  res["name"] = fieldName;
-  res["value"] = value;
-
-  return toMap(res);
-}
 
-QVariantMap StructDecoder::decodeBitfield(const QVariantMap &field) {
-  const QString &fieldName = field.firstKey();
-  const QVariantMap fieldDescription = field[fieldName].toMap();
-
-  if (!fieldDescription.contains("size")) {
-    return {};
+    m_reader.seek(pos);
   }
+  m_slots[index].from = m_reader.pos();
 
-  quint32 size = fieldDescription["size"].toUInt();
-  size = (size <= 0) ? 1 : size;
+  int count = instr.count;
+  if (instr.countRef != CompiledSchema::NoRef) {
+    if ((instr.countRef == CompiledSchema::UnresolvedRef) ||
+        !m_slots[instr.countRef].isVisited()) {
+      return;
+    }
 
-  QByteArray data(size, static_cast<char>(0));
-  m_ds.readRawData(data.data(), data.size());
+    count = m_slots[instr.countRef].toInt();
+  } else if (instr.countExpr >= 0) {
+    qint64 value = 0;
+    if (!m_schema.expression(instr.countExpr)
+             .evalInt(m_slots.constData(), value)) {
+      return;
+    }
 
-  if (fieldDescription.contains("reversed") &&
-      fieldDescription["reversed"].toBool()) {
-    std::reverse(data.begin(), data.end());
-    std::transform(data.begin(), data.end(), data.begin(),
-                   [](const auto value) -> bool {
-                     return reverseChar((uint8_t)(value & 0xff));
-                   });
+    count = static_cast<int>(
+        qBound<qint64>(0, value, std::numeric_limits<int>::max()));
   }
 
-  if (!fieldDescription.contains("spec") ||
-      (fieldDescription["spec"].type() != QVariant::Map)) {
-    return {};
-  }
+  if (count <= 1) {
+    execElement(index);
 
-  const QVariantMap spec = fieldDescription["spec"].toMap();
-  if (spec.isEmpty()) {
-    return {};
+    return;
   }
 
-  QVariantMap resMap;
-  const QStringList specNameList = spec.keys();
-  for (const auto &specName : specNameList) {
-    const QVariantMap specField = spec[specName].toMap();
-
-    QVariantMap specFieldNew;
-    specFieldNew[specName] = specField;
-    const QVariant specRes = decodeBitfieldElement(specFieldNew, data);
-
-    resMap[specName] = specRes;
+  if (execArray(index, count)) {
+    return;
   }
 
-  QVariantMap res;
-  res["name"] = fieldName;
-  res["value"] = resMap;
-  setDecodedValue(fieldName, resMap);
-
-  return toMap(res);
-}
-
-QVariant StructDecoder::decodeBitfieldElement(const QVariantMap &field,
-                                              const QByteArray &data) {
-  const QString &fieldName = field.firstKey();
-  const QVariantMap fieldDescription = field[fieldName].toMap();
-
-  int size = fieldDescription["size"].toInt();
-  size = (size == 0) ? 1 : size;
+  m_sink->beginArray(index, count);
+  for (int i = 0; i < count; i++) {
+    m_slots[index].from = m_reader.pos();
 
-  const int pos = fieldDescription["pos"].toInt();
-  const int last = pos + size - 1;
-  if (last > (data.size() * CHAR_WIDTH)) {
-    return {};
+    execElement(index);
   }
+  m_sink->endArray(index);
+}
 
-  quint64 valueU = get_bitfield(reinterpret_cast<const uint8_t *>(data.data()),
-                                size, pos, size) &
-                   bitmask(size);
-
-  if (fieldDescription.contains("signed") &&
-      fieldDescription["signed"].toBool()) {
-    if ((valueU & ((quint64)1 << (size - 1))) > 0) {
-      qint64 valueS = (qint64)(-1) & ~bitmask(size) | (qint64)valueU;
+void StructDecoder::execElement(int index) {
+  using Opcode = CompiledSchema::Opcode;
+
+  const CompiledSchema::Instruction &instr = m_schema.at(index);
+
+  switch (instr.opcode) {
+  case Opcode::Int8:
+  case Opcode::UInt8:
+  case Opcode::Int16:
+  case Opcode::UInt16:
+  case Opcode::Int24:
+  case Opcode::UInt24:
+  case Opcode::Int32:
+  case Opcode::UInt32:
+  case Opcode::Int64:
+  case Opcode::UInt64:
+  case Opcode::Float:
+  case Opcode::Double:
+  case Opcode::Unixtime:
+    execValue(index);
+    break;
+  case Opcode::Const: {
+    const bool match = m_reader.canRead(instr.size) &&
+                       (std::memcmp(m_reader.current(),
+                                    instr.constData.constData(),
+                                    instr.size) == 0);
+    m_reader.skip(instr.size);
+
+    m_sink->onValue(index, match ? 1 : 0);
+  } break;
+  case Opcode::Crc8:
+  case Opcode::Crc16:
+  case Opcode::Crc32:
+  case Opcode::Crc64:
+    execCrc(index);
+    break;
+  case Opcode::Struct:
+    execStruct(index);
+    break;
+  case Opcode::Custom:
+    execCustom(index);
+    break;
+  case Opcode::Raw: {
+    const qsizetype size = elementSize(index);
+    if (m_reader.canRead(size)) {
+      m_sink->onBytes(index, m_reader.current(), size);
+      m_reader.skip(size);
+    } else {
+      m_scratch.fill(static_cast<char>(0), size);
+      m_reader.readRaw(m_scratch.data(), m_scratch.size());
 
-      return valueS;
+      m_sink->onBytes(index, m_scratch.constData(), m_scratch.size());
     }
+  } break;
+  case Opcode::Skip:
+    m_reader.skip(elementSize(index));
+
+    m_sink->onNull(index);
+    break;
+  case Opcode::Bitfield:
+    execBitfield(index);
+    break;
+  default:
+    break;
   }
-
-  return valueU;
 }
 
-QVariantMap StructDecoder::decodeCustom(const QVariantMap &field) {
-  const QString &fieldName = field.firstKey();
-  const QVariantMap fieldDescription = field[fieldName].toMap();
-
-  if (!fieldDescription.contains("depend") ||
-      (fieldDescription["depend"].type() != QVariant::String)) {
-    return {};
-  }
-
-  const QString dependFieldName = fieldDescription["depend"].toString();
-  if (!m_decodedFields.contains(dependFieldName)) {
-    return {};
-  }
-
-  const QVariantMap dependField = m_decodedFields[dependFieldName].toMap();
-  const QVariant &dependValue = dependField["value"];
-  if (dependValue.isNull()) {
-    return {};
+qsizetype StructDecoder::elementSize(int index) const {
+  const CompiledSchema::Instruction &instr = m_schema.at(index);
+  if (instr.sizeExpr < 0) {
+    return instr.size;
   }
 
-  if (!fieldDescription.contains("choose") ||
-      (fieldDescription["choose"].type() != QVariant::Map)) {
-    return {};
-  }
+  // A missing operand reads nothing, no field is larger than the frame
+  qint64 size = 0;
+  m_schema.expression(instr.sizeExpr).evalInt(m_slots.constData(), size);
 
-  const QVariantMap choose = fieldDescription["choose"].toMap();
-  if (choose.isEmpty()) {
-    return {};
-  }
+  return qBound<qint64>(0, size, m_reader.size());
+}
 
-  const auto it = std::find_if(
-      choose.constBegin(), choose.constEnd(),
-      [&dependValue](const auto &it) -> bool { return dependValue == it; });
-  if (it == choose.constEnd()) {
-    return {};
-  }
+bool StructDecoder::execArray(int index, int count) {
+  const CompiledSchema::Instruction &instr = m_schema.at(index);
+  if (!PrimitiveArray::supports(instr.opcode)) {
+    return false;
+  }
+
+  const int elementSize = CompiledSchema::valueSize(instr.opcode);
+  const qsizetype size = static_cast<qsizetype>(count) * elementSize;
+  if (!m_reader.canRead(size)) {
+    return false;
+  }
+
+  PrimitiveArray array;
+  array.type = instr.opcode;
+  array.data = m_reader.current();
+  array.count = count;
+
+  const bool swap = (elementSize > 1) &&
+                    (instr.bigEndian != (Q_BYTE_ORDER == Q_BIG_ENDIAN));
+  if (swap) {
+    m_arrayBuffer.resize(size);
+    void *dest = m_arrayBuffer.data();
+
+    switch (elementSize) {
+    case 2:
+      qbswap<2>(array.data, count, dest);
+      break;
+    case 4:
+      qbswap<4>(array.data, count, dest);
+      break;
+    default:
+      qbswap<8>(array.data, count, dest);
+      break;
+    }
 
-  const QString &chooseFieldName = it.key();
-  const QVariantMap spec = fieldDescription["spec"].toMap();
-  if (!spec.contains(chooseFieldName)) {
-    return {};
+    array.data = m_arrayBuffer.constData();
   }
 
-  QVariantMap decodedField;
-  decodedField[chooseFieldName] = spec[chooseFieldName];
+  m_slots[index].from = m_reader.pos() + size - elementSize;
+  setSlot(index, array);
+  m_reader.skip(size);
 
-  QVariantMap res;
-  res[fieldName] = decodeMap(decodedField);
+  m_sink->onArray(index, array);
 
-  return res;
+  return true;
 }
 
-QVariantMap StructDecoder::decodeStruct(const QVariantMap &field) {
-  const QString &fieldName = field.firstKey();
-  const QVariantMap fieldDescription = field[fieldName].toMap();
-  const QVariantMap spec = fieldDescription["spec"].toMap();
+void StructDecoder::execValue(int index) {
+  using Opcode = CompiledSchema::Opcode;
+
+  const CompiledSchema::Instruction &instr = m_schema.at(index);
+  const bool bigEndian = instr.bigEndian;
+
+  switch (instr.opcode) {
+  case Opcode::Int8:
+    setValue(index, m_reader.read<qint8>(bigEndian));
+    break;
+  case Opcode::UInt8:
+    setValue(index, m_reader.read<quint8>(bigEndian));
+    break;
+  case Opcode::Int16:
+    setValue(index, m_reader.read<qint16>(bigEndian));
+    break;
+  case Opcode::UInt16:
+    setValue(index, m_reader.read<quint16>(bigEndian));
+    break;
+  case Opcode::Int24:
+    setValue(index, fixSign24(m_reader.readUInt24(bigEndian)));
+    break;
+  case Opcode::UInt24:
+    setValue(index, m_reader.readUInt24(bigEndian));
+    break;
+  case Opcode::Int32:
+    setValue(index, m_reader.read<qint32>(bigEndian));
+    break;
+  case Opcode::UInt32:
+    setValue(index, m_reader.read<quint32>(bigEndian));
+    break;
+  case Opcode::Int64:
+  case Opcode::Unixtime:
+    setValue(index, m_reader.read<qint64>(bigEndian));
+    break;
+  case Opcode::UInt64:
+    setUnsigned(index, m_reader.read<quint64>(bigEndian));
+    break;
+  case Opcode::Float:
+    setDouble(index, m_reader.read<float>(bigEndian));
+    break;
+  case Opcode::Double:
+    setDouble(index, m_reader.read<double>(bigEndian));
+    break;
+  default:
+    break;
+  }
+}
 
-  QVariantMap res;
-  res[fieldName] = decodeMap(spec);
+void StructDecoder::execBitfield(int index) {
+  const CompiledSchema::Instruction &instr = m_schema.at(index);
 
-  return res;
-}
+  // Zero padding lets every element use a full 64-bit load plus one byte
+  const qsizetype padding = sizeof(quint64) + 1;
+  m_scratch.resize(instr.size + padding);
+  const qsizetype copied = m_reader.readRaw(m_scratch.data(), instr.size);
+  std::memset(m_scratch.data() + copied, 0, m_scratch.size() - copied);
 
-QVariantMap StructDecoder::decodeRaw(const QVariantMap &field) {
-  const QString &fieldName = field.firstKey();
-  const QVariantMap fieldDescription = field[fieldName].toMap();
+  if (instr.end == index + 1) {
+    return;
+  }
 
-  int size = fieldDescription["size"].toUInt();
-  size = (size == 0) ? 1 : size;
+  const char *data = m_scratch.constData();
 
-  QByteArray data(size, static_cast<char>(0));
-  m_ds.readRawData(data.data(), data.size());
+  m_sink->beginStruct(index);
+  for (int i = index + 1; i < instr.end; i++) {
+    const CompiledSchema::Instruction &element = m_schema.at(i);
+    if (element.bitOffset < 0) {
+      m_slots[i].setNull();
+      m_sink->onNull(i);
 
-  QVariantMap res;
-  res["name"] = fieldName;
-  res["value"] = data.toHex();
-  setDecodedValue(fieldName, data.toHex());
+      continue;
+    }
 
-  return toMap(res);
-}
+    const quint64 valueU =
+        extractBits(data + element.bitOffset, element.bitShift, element.size,
+                    element.reversed);
+    if (!element.isSigned || (element.size >= 64)) {
+      if (element.isSigned) {
+        setValue(i, static_cast<qint64>(valueU));
+      } else {
+        setUnsigned(i, valueU);
+      }
 
-QVariantMap StructDecoder::decodeSkip(const QVariantMap &field) {
-  const QString &fieldName = field.firstKey();
-  const QVariantMap fieldDescription = field[fieldName].toMap();
+      continue;
+    }
 
-  const int size = fieldDescription["size"].toUInt();
-  if (size <= 0) {
-    return {};
+    const int unused = 64 - element.size;
+    setValue(i, static_cast<qint64>(valueU << unused) >> unused);
   }
+  m_sink->endStruct(index);
+}
 
-  m_ds.skipRawData(size);
+void StructDecoder::execCustom(int index) {
+  const CompiledSchema::Instruction &instr = m_schema.at(index);
+  if ((instr.dependRef < 0) || !m_slots[instr.dependRef].isVisited()) {
+    return;
+  }
 
-  QVariantMap res;
-  res["name"] = fieldName;
-  res["value"] = {};
-  setDecodedValue(fieldName, {});
+  const int branch = m_schema.chooseBranch(index, m_slots[instr.dependRef]);
+  if ((branch < 0) ||
+      (m_schema.at(branch).opcode == CompiledSchema::Opcode::None)) {
+    return;
+  }
 
-  return toMap(res);
+  m_sink->beginStruct(index);
+  execField(branch);
+  m_sink->endStruct(index);
 }
 
-QVariantMap StructDecoder::decodeCrc(const QVariantMap &field) {
-  const QString &fieldName = field.firstKey();
-  const QVariantMap fieldDescription = field[fieldName].toMap();
-
-  const QString type = fieldDescription["type"].toString();
-  const QString mode = type.mid(3);
+void StructDecoder::execStruct(int index) {
+  const CompiledSchema::Instruction &instr = m_schema.at(index);
 
-  int to = m_buf.pos() - 1;
-  if (fieldDescription.contains("include") &&
-      fieldDescription["include"].toBool()) {
-    const int size = mode.toInt() / CHAR_WIDTH;
+  m_sink->beginStruct(index);
+  execList(index + 1, instr.end);
+  m_sink->endStruct(index);
+}
 
-    to += size;
-  }
+void StructDecoder::execCrc(int index) {
+  using Opcode = CompiledSchema::Opcode;
 
-  if (fieldDescription.contains("to") &&
-      (fieldDescription["to"].type() == QVariant::String)) {
-    const QString toFieldName = fieldDescription["to"].toString();
+  const CompiledSchema::Instruction &instr = m_schema.at(index);
 
-    to = getDecodedValue(toFieldName).toInt();
+  qint64 to = m_reader.pos() - 1;
+  if (instr.include) {
+    to += instr.size;
   }
 
-  int from = fieldDescription["from"].toInt();
-  if (fieldDescription.contains("parent")) {
-    const QString parentName = fieldDescription["parent"].toString();
-    if (m_decodedFields.contains(parentName)) {
-      const QVariantMap parentField = m_decodedFields[parentName].toMap();
-
-      from = parentField["from"].toInt();
-    }
+  if (instr.toRef != CompiledSchema::NoRef) {
+    to = (instr.toRef >= 0) ? m_slots[instr.toRef].toInt() : 0;
   }
 
-  if (from > to) {
-    return {};
+  qint64 from = instr.from;
+  if ((instr.parentRef >= 0) && m_slots[instr.parentRef].isVisited()) {
+    from = m_slots[instr.parentRef].from;
   }
 
-  const QByteArray &data = m_buf.buffer();
-  if (to >= data.size()) {
-    return {};
+  if ((from > to) || (to >= m_reader.size())) {
+    return;
   }
 
-  const int size = to - from;
+  const size_t size = to - from + 1;
+  const char *fromData = &m_reader.data()[from];
   const unsigned char *fromC =
-      reinterpret_cast<const unsigned char *>(&data.constData()[from]);
+      reinterpret_cast<const unsigned char *>(fromData);
 
   quint64 crc = 0;
-  bool check = false;
-  if (mode == "8") {
-    crc = crc_8(fromC, size);
-    quint8 crc8Read = 0;
-    m_ds >> crc8Read;
+  if (takeCrcRegion(index, from, to, crc)) {
+    m_reader.skip(instr.size);
+    setUnsigned(index, crc);
+
+    return;
+  }
 
-    check = (crc == crc8Read);
-  } else if (mode == "16") {
+  switch (instr.opcode) {
+  case Opcode::Crc8:
+    crc = crc_8(fromC, size);
+    break;
+  case Opcode::Crc16:
     crc = crc_16(fromC, size);
-    quint8 crc16Read = 0;
-    m_ds >> crc16Read;
+    break;
+  case Opcode::Crc32:
+    crc = crc32(fromData, size);
+    break;
+  case Opcode::Crc64:
+    crc = crc64We(fromData, size);
+    break;
+  default:
+    break;
+  }
+  m_reader.skip(instr.size);
+
+  setUnsigned(index, crc);
+}
 
-    check = (crc == crc16Read);
-  } else if (mode == "32") {
-    crc = crc_32(fromC, size);
-    quint32 crc32Read = 0;
-    m_ds >> crc32Read;
+void StructDecoder::openCrcRegions() {
+  using Opcode = CompiledSchema::Opcode;
 
-    check = (crc == crc32Read);
-  } else if (mode == "64") {
-    crc = crc_64_we(fromC, size);
-    quint64 crc64Read = 0;
-    m_ds >> crc64Read;
+  for (const int index : m_schema.crcFields()) {
+    const CompiledSchema::Instruction &instr = m_schema.at(index);
+    if ((instr.opcode != Opcode::Crc32) && (instr.opcode != Opcode::Crc64)) {
+      continue;
+    }
 
-    check = (crc == crc64Read);
-  }
-  setDecodedValue(fieldName, crc);
+    CrcRegion region;
+    region.index = index;
+    region.from = (instr.parentRef >= 0) ? -1 : instr.from;
+    region.covered = region.from;
+    region.state =
+        (instr.opcode == Opcode::Crc32) ? crc32Init : crc64WeInit;
 
-  if (field.contains("include") && field["include"].toBool()) {
-    return {}; //(crc == 0)
+    m_crcRegions.push_back(region);
   }
-
-  return {};
 }
 
-QVariantMap StructDecoder::decodeUnixtime(const QVariantMap &field) {
-  const QString &fieldName = field.firstKey();
-  const QVariantMap fieldDescription = field[fieldName].toMap();
-
-  const QString endian = fieldDescription["endian"].toString().toLower();
-  const bool bigEndian = (endian == "big");
-  if (bigEndian) {
-    m_ds.setByteOrder(QDataStream::BigEndian);
-  } else {
-    m_ds.setByteOrder(QDataStream::LittleEndian);
+void StructDecoder::advanceCrcRegions() {
+  if (m_crcRegions.isEmpty()) {
+    return;
   }
 
-  qint64 unixtime = 0;
-  m_ds >> unixtime;
-  const auto dateTime = QDateTime::fromMSecsSinceEpoch(unixtime);
-  const QString dateTimeStr = dateTime.toString(Qt::ISODateWithMs);
-
-  setDecodedValue(fieldName, dateTimeStr);
+  const qint64 pos = m_reader.pos();
 
-  QVariantMap res;
-  res["name"] = fieldName;
-  res["value"] = dateTimeStr;
-
-  return toMap(res);
-}
+  for (auto &region : m_crcRegions) {
+    const CompiledSchema::Instruction &instr = m_schema.at(region.index);
 
-QVariantMap StructDecoder::decodeConst(const QVariantMap &field) {
-  const QString &fieldName = field.firstKey();
-  const QVariantMap fieldDescription = field[fieldName].toMap();
-  if (!fieldDescription.contains("value") ||
-      (fieldDescription["value"].type() != QVariant::String)) {
-    return {};
-  }
+    if (region.from < 0) {
+      region.from = m_slots[instr.parentRef].from;
+      region.covered = region.from;
+      if (region.from < 0) {
+        continue;
+      }
+    }
 
-  if (!fieldDescription.contains("size") ||
-      (fieldDescription["size"].toUInt() == 0)) {
-    return {};
-  }
+    if (pos <= region.covered) {
+      continue;
+    }
 
-  const QString constDataStr = fieldDescription["value"].toString();
-  if (constDataStr.isEmpty()) {
-    return {};
+    const char *data = m_reader.data() + region.covered;
+    const qsizetype size = pos - region.covered;
+    if (instr.opcode == CompiledSchema::Opcode::Crc32) {
+      region.state =
+          crc32Update(static_cast<quint32>(region.state), data, size);
+    } else {
+      region.state = crc64WeUpdate(region.state, data, size);
+    }
+    region.covered = pos;
   }
+}
 
-  QByteArray constData = QByteArray::fromHex(constDataStr.toLatin1());
-  if (constData.isEmpty()) {
-    return {};
-  }
+bool StructDecoder::takeCrcRegion(int index, qint64 from, qint64 to,
+                                  quint64 &crc) {
+  for (int i = 0; i < m_crcRegions.size(); i++) {
+    CrcRegion region = m_crcRegions.at(i);
+    if (region.index != index) {
+      continue;
+    }
 
-  const quint32 size = fieldDescription["size"].toUInt();
-  if (size > constData.size()) {
-    return {};
-  }
-  constData = constData.mid(0, size);
+    m_crcRegions.remove(i);
 
-  QByteArray readData(size, static_cast<char>(0));
-  m_ds.readRawData(readData.data(), readData.size());
+    // Seek or "to" reference moved the range away from what was scanned
+    if ((region.from != from) || (region.covered > to + 1)) {
+      return false;
+    }
 
-  if (constData != readData) {
-    QVariantMap res;
-    res["name"] = fieldName;
-    res["value"] = false;
+    const char *data = m_reader.data() + region.covered;
+    const qsizetype size = to + 1 - region.covered;
+    if (m_schema.at(index).opcode == CompiledSchema::Opcode::Crc32) {
+      crc = crc32Final(
+          crc32Update(static_cast<quint32>(region.state), data, size));
+    } else {
+      crc = crc64WeFinal(crc64WeUpdate(region.state, data, size));
+    }
 
-    return toMap(res);
+    return true;
   }
 
-  return {};
+  return false;
 }
 
-void StructDecoder::updateEncodedTo(const QString &name) {
-  if (!m_decodedFields.contains(name)) {
-    return;
-  }
-
-  QVariantMap decodedField = m_decodedFields[name].toMap();
-  decodedField["to"] = m_buf.pos();
-  m_decodedFields[name] = decodedField;
+void StructDecoder::setValue(int index, qint64 value) {
+  m_slots[index].setInt(value);
+  m_sink->onValue(index, value);
 }
 
-QVariant StructDecoder::getDecodedValue(const QString &name) const {
-  if (!m_decodedFields.contains(name)) {
-    return {};
-  }
-
-  const QVariantMap decodedField = m_decodedFields[name].toMap();
-  QVariant decodedValue = decodedField["value"];
-
-  return decodedValue;
+void StructDecoder::setUnsigned(int index, quint64 value) {
+  m_slots[index].setUInt(value);
+  m_sink->onUnsigned(index, value);
 }
 
-QVariant StructDecoder::generateDecodedValue(const QString &name,
-                                             const QVariant &value) {
-  if (!m_decodedFields.contains(name) || (value.type() == QVariant::List)) {
-    return value;
-  }
-
-  QVariant decodedValue = getDecodedValue(name);
-  if (decodedValue.type() == QVariant::List) {
-    QVariantList decodedValueList = decodedValue.toList();
-    decodedValueList.push_back(value);
-
-    return decodedValueList;
-  }
-
-  QVariantList decodedValueList = {m_decodedFields, value};
-
-  return decodedValueList;
+void StructDecoder::setDouble(int index, double value) {
+  m_slots[index].setDouble(value);
+  m_sink->onDouble(index, value);
 }
 
-void StructDecoder::setDecodedValue(const QString &name,
-                                    const QVariant &value) {
-  if (!m_decodedFields.contains(name)) {
-    return;
+void StructDecoder::setSlot(int index, const PrimitiveArray &array) {
+  using Opcode = CompiledSchema::Opcode;
+
+  const int last = array.count - 1;
+
+  switch (array.type) {
+  case Opcode::UInt64:
+    m_slots[index].setUInt(array.at<quint64>(last));
+    break;
+  case Opcode::Float:
+    m_slots[index].setDouble(array.at<float>(last));
+    break;
+  case Opcode::Double:
+    m_slots[index].setDouble(array.at<double>(last));
+    break;
+  default:
+    m_slots[index].setInt(array.value(last).toLongLong());
+    break;
   }
-
-  QVariantMap decodedField = m_decodedFields[name].toMap();
-
-  QVariant decodedValue = generateDecodedValue(name, value);
-  decodedField["value"] = value;
-
-  m_decodedFields[name] = decodedField;
 }
 
 QVariantList StructDecoder::extractValues(const QVariant &value) {
@@ -2,682 +2,935 @@
 
 #include "bitutils.h"
 #include "checksum.h"
+#include "internal/crcutils.h"
+#include "internal/schemacache.h"
 #include "jsonutils.h"
-#include <bitfield/bitfield.h>
 
 #include <QDateTime>
 
+#include <limits>
+
 namespace qbinarizer {
 
-StructEncoder::StructEncoder(QObject *parent) : QObject{parent} {}
+StructEncoder::StructEncoder(QObject *parent)
+    : QObject{parent}, m_input(nullptr), m_valueCursor(0),
+      m_valueIndexed(false), m_pendingLengths(0), m_sizeHint(0),
+      m_exactSize(false) {}
 
 std::tuple<QByteArray, QVariantList>
 StructEncoder::encode(const QString &datafieldListStr,
                       const QString &valueListStr) {
-  const QVariantList datafieldList = parseJson(datafieldListStr);
+  const CompiledSchema schema =
+      SchemaCache::globalInstance().compiled(datafieldListStr);
   const QVariantList valueList = parseJson(valueListStr);
 
-  return encode(datafieldList, valueList);
+  return encode(schema, valueList);
 }
 
 std::tuple<QByteArray, QVariantList>
 StructEncoder::encode(const QVariantList &datafieldList,
                       const QVariantList &valueList) {
+  const CompiledSchema schema(datafieldList);
+
+  return encode(schema, valueList);
+}
+
+std::tuple<QByteArray, QVariantList>
+StructEncoder::encode(const CompiledSchema &schema,
+                      const QVariantList &valueList) {
   clear();
 
-  m_datafieldList = datafieldList;
+  m_schema = schema;
   m_valueList = valueList;
 
-  m_buf.open(QIODevice::WriteOnly);
-  m_ds.setDevice(&m_buf);
+  return encodeFrame();
+}
 
-  encode();
+std::tuple<QByteArray, QVariantList>
+StructEncoder::encode(const CompiledSchema &schema,
+                      const EncodeValues &values) {
+  clear();
 
-  QByteArray data = m_buf.buffer().mid(0, m_buf.pos());
+  m_schema = schema;
+  m_input = &values;
 
-  return std::make_tuple(data, m_encodeList);
+  const auto res = encodeFrame();
+  m_input = nullptr;
+
+  return res;
 }
 
-void StructEncoder::clear() {
-  m_encodedFields = QVariantMap();
-  m_datafieldList = QVariantList();
-  m_valueList = QVariantList();
+qsizetype StructEncoder::encodeInto(QByteArray &out,
+                                    const QVariantList &datafieldList,
+                                    const QVariantList &valueList) {
+  return encodeInto(out, CompiledSchema(datafieldList), valueList);
+}
+
+qsizetype StructEncoder::encodeInto(QByteArray &out,
+                                    const CompiledSchema &schema,
+                                    const QVariantList &valueList) {
+  clear();
 
-  m_buf.close();
-  m_ds.setDevice(nullptr);
+  m_schema = schema;
+  m_valueList = valueList;
+
+  return writeInto(out);
 }
 
-void StructEncoder::encode() {
-  m_encodeList = encodeList(m_datafieldList, m_valueList);
+qsizetype StructEncoder::encodeInto(QByteArray &out,
+                                    const CompiledSchema &schema,
+                                    const EncodeValues &values) {
+  clear();
+
+  m_schema = schema;
+  m_input = &values;
+
+  const qsizetype size = writeInto(out);
+  m_input = nullptr;
+
+  return size;
 }
 
-inline QVariantMap toMap(const QVariantMap &field) {
-  const QString &name = field["name"].toString();
+qsizetype StructEncoder::encodeInto(char *data, qsizetype capacity,
+                                    const QVariantList &datafieldList,
+                                    const QVariantList &valueList) {
+  return encodeInto(data, capacity, CompiledSchema(datafieldList), valueList);
+}
 
-  QVariantMap res;
+qsizetype StructEncoder::encodeInto(char *data, qsizetype capacity,
+                                    const CompiledSchema &schema,
+                                    const QVariantList &valueList) {
+  clear();
 
-  if (field.contains("value")) {
-    res[name] = field["value"];
-  }
+  m_schema = schema;
+  m_valueList = valueList;
 
-  return res;
+  return writeInto(data, capacity);
 }
 
-QVariantList StructEncoder::encodeList(const QVariantList &datafieldList,
-                                       const QVariantList &valueList) {
-  QVariantList encodedListRes;
+qsizetype StructEncoder::encodeInto(char *data, qsizetype capacity,
+                                    const CompiledSchema &schema,
+                                    const EncodeValues &values) {
+  clear();
 
-  for (int i = 0; i < datafieldList.size(); i++) {
-    const QVariant &datafield = datafieldList.at(i);
+  m_schema = schema;
+  m_input = &values;
 
-    if (datafield.type() == QVariant::List) {
-      const QVariantList subDatafieldList = datafield.toList();
+  const qsizetype size = writeInto(data, capacity);
+  m_input = nullptr;
 
-      QVariantList subValueList;
-      if (i < valueList.size()) {
-        subValueList = m_valueList.at(i).toList();
-      }
-      const QVariantList encodedList =
-          encodeList(subDatafieldList, subValueList);
+  return size;
+}
 
-      encodedListRes.append(encodedList);
-    } else if (datafield.type() == QVariant::Map) {
-      const QVariantMap field = datafield.toMap();
-      const QString &fieldName = field.firstKey();
+qsizetype StructEncoder::encodedSize(const QVariantList &datafieldList,
+                                     const QVariantList &valueList) {
+  return encodedSize(CompiledSchema(datafieldList), valueList);
+}
 
-      auto it = std::find_if(valueList.cbegin(), valueList.cend(),
-                             [fieldName](const QVariant &value) -> bool {
-                               const QVariantMap valueMap = value.toMap();
-                               const QString &valueName = valueMap.firstKey();
+qsizetype StructEncoder::encodedSize(const CompiledSchema &schema,
+                                     const QVariantList &valueList) {
+  clear();
 
-                               return fieldName == valueName;
-                             });
+  m_schema = schema;
+  m_valueList = valueList;
 
-      QVariantMap value;
-      if (it != valueList.cend()) {
-        value = it->toMap();
-      }
+  return measure();
+}
 
-      QVariantMap encoedMap = encodeMap(field, value);
-      encodedListRes.push_back(encoedMap);
-    }
-  }
+qsizetype StructEncoder::encodedSize(const CompiledSchema &schema,
+                                     const EncodeValues &values) {
+  clear();
 
-  return encodedListRes;
+  m_schema = schema;
+  m_input = &values;
+
+  const qsizetype size = measure();
+  m_input = nullptr;
+
+  return size;
 }
 
-QVariantMap StructEncoder::encodeMap(const QVariantMap &field,
-                                     const QVariantMap &fieldValue) {
-  const QString &fieldName = field.firstKey();
-  const QVariantMap fieldDescription = field[fieldName].toMap();
-  const QString type = fieldDescription["type"].toString();
+qsizetype StructEncoder::encodedCapacity(const QVariantList &datafieldList,
+                                         const QVariantList &valueList) {
+  return encodedCapacity(CompiledSchema(datafieldList), valueList);
+}
 
-  QVariant valueData = fieldValue[fieldName];
-  if (valueData.isNull()) {
-    valueData = fieldDescription["value"];
-  }
+qsizetype StructEncoder::encodedCapacity(const CompiledSchema &schema,
+                                         const QVariantList &valueList) {
+  clear();
 
-  qint64 newPos = -1;
-  if (fieldDescription.contains("pos") &&
-      fieldDescription["pos"].canConvert<qint64>()) {
-    newPos = fieldDescription["pos"].toLongLong();
-    m_buf.seek(newPos);
-  }
+  m_schema = schema;
+  m_valueList = valueList;
 
-  QVariantMap encodedField;
-  encodedField["name"] = fieldName;
-  encodedField["from"] = m_buf.pos();
-  encodedField["value"] = generateEncodedValue(fieldName, valueData);
-  encodedField["type"] = type;
-  m_encodedFields[fieldName] = encodedField;
+  qsizetype capacity = 0;
+  measure(&capacity);
 
-  if (fieldDescription.contains("count")) {
-    int count = 0;
+  return capacity;
+}
 
-    const QVariant &countValue = fieldDescription["count"];
-    if (countValue.type() == QVariant::String) {
-      const QString countField = countValue.toString();
-      if (m_encodedFields.contains(countField)) {
-        count = getEncodedValue(countField).toInt();
-      }
-    } else {
-      count = countValue.toUInt();
-    }
+qsizetype StructEncoder::encodedCapacity(const CompiledSchema &schema,
+                                         const EncodeValues &values) {
+  clear();
 
-    if (count > 1) {
-      const QVariantList valueList = valueData.toList();
-      QVariantMap subFieldDescription = fieldDescription;
-      subFieldDescription["count"] = 1;
+  m_schema = schema;
+  m_input = &values;
 
-      QVariantMap subField;
-      subField[fieldName] = subFieldDescription;
+  qsizetype capacity = 0;
+  measure(&capacity);
+  m_input = nullptr;
 
-      for (int i = 0; i < count; i++) {
-        QVariantMap subValue;
+  return capacity;
+}
 
-        if (i < valueList.size()) {
-          subValue[fieldName] = valueList.at(i);
-        }
+bool StructEncoder::exactSize() const { return m_exactSize; }
 
-        encodeMap(subField, subValue);
-      }
+void StructEncoder::setExactSize(bool exactSize) { m_exactSize = exactSize; }
 
-      return {};
-    }
-  }
+void StructEncoder::clear() {
+  m_schema = CompiledSchema();
+  m_valueList = QVariantList();
+  m_input = nullptr;
+  m_slots.clear();
+  m_valueIndex.clear();
+  m_valueIndexed = false;
+  m_fixups.clear();
 
-  QVariantMap valueEncoded;
-
-  if (type == "array") {
-    QVariantMap fieldDescriptionNew = fieldDescription;
-    fieldDescriptionNew["type"] = fieldDescription["subtype"];
-    fieldDescriptionNew.remove("subtype");
-
-    QVariantMap fieldNew;
-    fieldNew[fieldName] = fieldDescriptionNew;
-
-    valueEncoded = encodeMap(fieldNew, fieldValue);
-  } else if (type.startsWith("int") || type.startsWith("uint") ||
-             (type == "float") || (type == "double")) {
-    valueEncoded = encodeValue(field, valueData);
-  } else if (type == "const") {
-    valueEncoded = encodeConst(field, valueData);
-  } else if (type.startsWith("crc")) {
-    valueEncoded = encodeСrc(field);
-  } else if (type == "struct") {
-    valueEncoded = encodeStruct(field, valueData);
-  } else if (type == "custom") {
-    valueEncoded = encodeCustom(field, valueData);
-  } else if (type == "unixtime") {
-    valueEncoded = encodeUnixtime(field, valueData);
-  } else if (type == "raw") {
-    valueEncoded = encodeRaw(field, valueData);
-  } else if (type == "skip") {
-    valueEncoded = encodeSkip(fieldDescription);
-  } else if (type == "bitfield") {
-    valueEncoded = encodeBitfield(field, valueData);
-  }
-
-  return valueEncoded;
-}
-
-QVariantMap StructEncoder::encodeValue(const QVariantMap &field,
-                                       const QVariant &valueData) {
-  const QString &fieldName = field.firstKey();
-  const QVariantMap fieldDescription = field[fieldName].toMap();
-
-  const QString endian = fieldDescription["endian"].toString().toLower();
-  const bool bigEndian = (endian == "big");
-  if (bigEndian) {
-    m_ds.setByteOrder(QDataStream::BigEndian);
-    // res["endian"] = "big";
-  } else {
-    m_ds.setByteOrder(QDataStream::LittleEndian);
-    // res["endian"] = "little";
+  m_writer.reset();
+}
+
+std::tuple<QByteArray, QVariantList> StructEncoder::encodeFrame() {
+  if (m_exactSize) {
+    // A field seeking back leaves bytes past the end that are cut off after
+    qsizetype capacity = 0;
+    const qsizetype size = measure(&capacity);
+
+    QByteArray data(capacity, Qt::Uninitialized);
+    if (writeInto(data.data(), data.size()) == size) {
+      data.resize(size);
+
+      return std::make_tuple(data, m_encodeList);
+    }
   }
 
-  const QString type = fieldDescription["type"].toString();
-  if (type == "int8" || type == "char") {
-    writeValue<qint8>(m_ds, valueData);
-  } else if (type == "uint8") {
-    writeValue<qint8>(m_ds, valueData);
-  } else if (type == "int16") {
-    writeValue<qint16>(m_ds, valueData);
-  } else if (type == "uint16") {
-    writeValue<quint16>(m_ds, valueData);
-  } else if (type == "int24") {
-    const qint32 val = valueData.toLongLong();
+  QByteArray data;
+  data.reserve(m_sizeHint);
 
-    write24<qint32>(m_ds, val, bigEndian);
-  } else if (type == "uint24") {
-    const quint32 val = read24<quint32>(m_ds);
+  writeInto(data);
 
-    write24<quint32>(m_ds, val, bigEndian);
-  } else if (type == "int32") {
-    writeValue<qint32>(m_ds, valueData);
-  } else if (type == "uint32") {
-    writeValue<quint32>(m_ds, valueData);
-  } else if (type == "int64") {
-    writeValue<qint64>(m_ds, valueData);
-  } else if (type == "uint64") {
-    writeValue<quint64>(m_ds, valueData);
-  } else if (type == "float") {
-    m_ds.setFloatingPointPrecision(QDataStream::SinglePrecision);
+  return std::make_tuple(data, m_encodeList);
+}
 
-    writeValue<float>(m_ds, valueData);
-  } else if (type == "double") {
-    m_ds.setFloatingPointPrecision(QDataStream::DoublePrecision);
+qsizetype StructEncoder::writeInto(QByteArray &out) {
+  m_writer.reset(&out);
 
-    writeValue<double>(m_ds, valueData);
-  }
-  updateEncodedTo(fieldName);
+  encode();
 
-  QVariantMap valueRes;
-  valueRes["name"] = fieldName;
-  valueRes["value"] = valueData.isNull() ? 0 : valueData;
+  const qsizetype size = m_writer.pos();
+  out.resize(out.size() - m_writer.size() + size);
+  m_sizeHint = qMax(m_sizeHint, size);
+  m_writer.reset();
 
-  return toMap(valueRes);
+  return size;
 }
 
-QVariantMap StructEncoder::encodeBitfield(const QVariantMap &field,
-                                          const QVariant &valueData) {
-  const QString &fieldName = field.firstKey();
-  const QVariantMap fieldDescription = field[fieldName].toMap();
+qsizetype StructEncoder::writeInto(char *data, qsizetype capacity) {
+  m_writer.reset(data, capacity);
 
-  quint32 size = fieldDescription["size"].toUInt();
-  size = (size <= 0) ? 1 : size;
+  encode();
 
-  QByteArray data(size, static_cast<char>(0));
+  const qsizetype size = m_writer.overflow() ? -1 : m_writer.pos();
+  m_writer.reset();
 
-  if (!fieldDescription.contains("spec") ||
-      (fieldDescription["spec"].type() != QVariant::Map)) {
-    return {};
-  }
+  return size;
+}
 
-  const QVariantMap spec = fieldDescription["spec"].toMap();
-  if (spec.isEmpty()) {
-    return {};
-  }
+qsizetype StructEncoder::measure(qsizetype *capacity) {
+  m_writer.resetCounting();
 
-  const QVariantMap valueMap = valueData.toMap();
-  const QStringList specNameList = spec.keys();
-  for (int i = 0; i < specNameList.size(); i++) {
-    const QString &specName = specNameList.at(i);
-    const QVariantMap specField = spec[specName].toMap();
+  encode();
 
-    QVariantMap specFieldNew;
-    specFieldNew[specName] = specField;
+  const qsizetype size = m_writer.pos();
+  if (capacity != nullptr) {
+    *capacity = m_writer.size();
+  }
+  m_writer.reset();
+
+  return size;
+}
 
-    QVariant bitfieldValue;
-    if (valueMap.contains(specName)) {
-      bitfieldValue = valueMap[specName];
+void StructEncoder::encode() {
+  m_slots.fill(FieldSlot(), m_schema.size());
+  m_encodeList = QVariantList();
+  m_valueCursor = 0;
+  m_fixups.clear();
+  m_pendingLengths = 0;
+
+  for (int i = 0; i < m_schema.size(); i = m_schema.at(i).end) {
+    const QString &name = m_schema.at(i).name;
+    const QVariant value =
+        (m_input != nullptr) ? m_input->value(i) : topValue(name);
+
+    QVariantMap encodedMap;
+    QVariant res;
+    if (encodeField(i, value, res)) {
+      encodedMap[name] = res;
     }
 
-    encodeBitfieldElement(specFieldNew, bitfieldValue, data);
+    m_encodeList.push_back(encodedMap);
   }
 
-  if (fieldDescription.contains("reversed") &&
-      fieldDescription["reversed"].toBool()) {
-    std::reverse(data.begin(), data.end());
-    std::transform(data.begin(), data.end(), data.begin(),
-                   [](const auto value) -> bool {
-                     return reverseChar((uint8_t)(value & 0xff));
-                   });
+  resolveFixups();
+}
+
+bool StructEncoder::encodeField(int index, const QVariant &value,
+                                QVariant &res) {
+  const CompiledSchema::Instruction &instr = m_schema.at(index);
+  const QVariant &valueData = value.isNull() ? instr.value : value;
+
+  if (instr.pos >= 0) {
+    m_writer.seek(instr.pos);
+  } else if (instr.posExpr >= 0) {
+    qint64 pos = 0;
+    if (!m_schema.expression(instr.posExpr)
+             .evalInt(m_slots.constData(), pos)) {
+      return false;
+    }
+
+    m_writer.seek(pos);
   }
+  const qint64 from = m_writer.pos();
+  m_slots[index].from = from;
 
-  m_ds.writeRawData(data.constBegin(), data.size());
-  updateEncodedTo(fieldName);
+  const bool encoded = encodeElements(index, valueData, res);
 
-  QVariantMap valueRes;
-  valueRes["name"] = fieldName;
-  valueRes["value"] = valueData;
+  if (m_pendingLengths > 0) {
+    closeLength(index, from);
+  }
 
-  return toMap(valueRes);
+  return encoded;
 }
 
-QVariantMap StructEncoder::encodeBitfieldElement(const QVariantMap &field,
-                                                 const QVariant &value,
-                                                 QByteArray &data) {
-  const QString &fieldName = field.firstKey();
-  const QVariantMap fieldDescription = field[fieldName].toMap();
+bool StructEncoder::encodeElements(int index, const QVariant &valueData,
+                                   QVariant &res) {
+  const CompiledSchema::Instruction &instr = m_schema.at(index);
+
+  int count = instr.count;
+  if (instr.countRef != CompiledSchema::NoRef) {
+    count = 0;
+    if ((instr.countRef >= 0) && m_slots[instr.countRef].isVisited()) {
+      FieldSlot &countSlot = m_slots[instr.countRef];
+
+      // A count given no value is taken from the data
+      if (countSlot.isNull() && isNumber(m_schema.at(instr.countRef).opcode)) {
+        countSlot.setInt((valueData.type() == QVariant::List)
+                             ? valueData.toList().size()
+                             : 1);
+        setFixupValue(instr.countRef, countSlot);
+      }
 
-  QVariant valueData = value;
-  if (value.isNull()) {
-    valueData = fieldDescription["value"];
+      count = countSlot.toInt();
+    }
+  } else if (instr.countExpr >= 0) {
+    // A formula cannot be solved for its operands, so a count that does not
+    // evaluate is taken from the data without filling them in
+    qint64 value = 0;
+    if (m_schema.expression(instr.countExpr)
+            .evalInt(m_slots.constData(), value)) {
+      count = static_cast<int>(
+          qBound<qint64>(0, value, std::numeric_limits<int>::max()));
+    } else {
+      count = (valueData.type() == QVariant::List)
+                  ? valueData.toList().size()
+                  : 1;
+    }
   }
 
-  int size = fieldDescription["size"].toUInt();
-  size = (size == 0) ? 1 : size;
+  if (count <= 1) {
+    if ((m_input == nullptr) || m_input->slot(index).isNull()) {
+      if (valueData.isNull() && (instr.valueExpr >= 0) &&
+          encodeDerived(index, res)) {
+        return true;
+      }
 
-  const int pos = fieldDescription["pos"].toUInt();
-  const int last = pos + size - 1;
-  if (last > (data.size() * CHAR_WIDTH)) {
-    return {};
-  }
+      if (valueData.isNull() && isNumber(instr.opcode) &&
+          (instr.countSource || (instr.lengthRef >= 0))) {
+        deferValue(index);
 
-  quint64 valueU = 0;
-  if (fieldDescription.contains("signed") &&
-      fieldDescription["signed"].toBool()) {
-    const qint64 valueS = valueData.toLongLong();
-    valueU = valueS & bitmask(size);
-  } else {
-    valueU = valueData.toULongLong();
+        return true;
+      }
+
+      return encodeElement(index, valueData, res);
+    }
+
+    // Numbers set by id skip the QVariant conversion
+    const FieldSlot &typed = m_input->slot(index);
+    if (!isNumber(instr.opcode)) {
+      return encodeElement(index, typed.toVariant(), res);
+    }
+
+    encodeValue(index, typed);
+    res = typed.toVariant();
+
+    return true;
   }
 
-  set_bitfield(valueU, pos, size, reinterpret_cast<uint8_t *>(data.data()),
-               data.size());
+  const QVariantList valueList = valueData.toList();
+  for (int i = 0; i < count; i++) {
+    QVariant element;
+    if (i < valueList.size()) {
+      element = valueList.at(i);
+    }
 
-  QVariantMap encodedField;
-  encodedField["name"] = fieldName;
-  encodedField["value"] = valueData;
-  encodedField["from"] = pos;
-  encodedField["to"] = last;
-  m_encodedFields[fieldName] = encodedField;
+    m_slots[index].from = m_writer.pos();
 
-  QVariantMap valueRes;
-  valueRes["name"] = fieldName;
-  valueRes["value"] = valueData;
+    QVariant elementRes;
+    encodeElement(index, element.isNull() ? instr.value : element,
+                  elementRes);
+  }
 
-  return toMap(valueRes);
+  return false;
 }
 
-QVariantMap StructEncoder::encodeСrc(const QVariantMap &field) {
-  const QString &fieldName = field.firstKey();
-  const QVariantMap fieldDescription = field[fieldName].toMap();
+bool StructEncoder::encodeElement(int index, const QVariant &valueData,
+                                  QVariant &res) {
+  using Opcode = CompiledSchema::Opcode;
+
+  const CompiledSchema::Instruction &instr = m_schema.at(index);
+
+  switch (instr.opcode) {
+  case Opcode::Int8:
+  case Opcode::UInt8:
+  case Opcode::Int16:
+  case Opcode::UInt16:
+  case Opcode::Int24:
+  case Opcode::UInt24:
+  case Opcode::Int32:
+  case Opcode::UInt32:
+  case Opcode::Int64:
+  case Opcode::UInt64:
+  case Opcode::Float:
+  case Opcode::Double:
+    encodeValue(index, typedValue(instr.opcode, valueData));
+
+    res = valueData.isNull() ? QVariant(0) : valueData;
+    return true;
+  case Opcode::Unixtime: {
+    const QString dateTimeStr = valueData.toString();
+    const auto dateTime =
+        QDateTime::fromString(dateTimeStr, Qt::ISODateWithMs);
+    const qint64 unixtime = dateTime.toMSecsSinceEpoch();
+
+    m_writer.write(unixtime, instr.bigEndian);
+    m_slots[index].setInt(unixtime);
+
+    res = dateTimeStr;
+    return true;
+  }
+  case Opcode::Const:
+    m_writer.writeRaw(instr.constData.constData(), instr.constData.size());
+
+    res = instr.value;
+    return true;
+  case Opcode::Crc8:
+  case Opcode::Crc16:
+  case Opcode::Crc32:
+  case Opcode::Crc64:
+    // Top-level results are filled in with the fixup
+    if (!encodeCrc(index)) {
+      return false;
+    }
 
-  const QString type = fieldDescription["type"].toString();
-  const QString mode = type.mid(3);
-  const int crcSize = mode.toInt() / CHAR_WIDTH;
-  int to = m_buf.pos() - 1;
-  if (to < 0) {
-    return {};
-  }
+    res = QVariant();
+    return true;
+  case Opcode::Struct:
+    encodeStruct(index, valueData);
 
-  if (fieldDescription.contains("include") &&
-      fieldDescription["include"].toBool()) {
-    to += crcSize;
+    res = valueData;
+    return true;
+  case Opcode::Custom:
+    if (!encodeCustom(index, valueData)) {
+      return false;
+    }
+
+    res = valueData;
+    return true;
+  case Opcode::Raw: {
+    const QByteArray data =
+        QByteArray::fromHex(valueData.toString().toLatin1());
+    m_writer.writeRaw(data.constData(), data.size());
 
-    QByteArray data(crcSize, static_cast<char>(0));
-    m_ds.writeRawData(data.constData(), data.size());
+    res = data.toHex();
+    return true;
   }
+  case Opcode::Skip:
+    m_writer.skip(skipSize(index));
 
-  if (fieldDescription.contains("to") &&
-      (fieldDescription["to"].type() == QVariant::String)) {
-    const QString toField = fieldDescription["to"].toString();
+    res = QVariant();
+    return true;
+  case Opcode::Bitfield:
+    if (!encodeBitfield(index, valueData)) {
+      return false;
+    }
 
-    to = getEncodedValue(toField).toInt();
+    res = valueData;
+    return true;
+  default:
+    return false;
   }
+}
+
+bool StructEncoder::encodeDerived(int index, QVariant &res) {
+  using Opcode = CompiledSchema::Opcode;
 
-  int from = fieldDescription["from"].toInt();
-  if (fieldDescription.contains("parent")) {
-    const QString parentName = fieldDescription["parent"].toString();
-    if (m_encodedFields.contains(parentName)) {
-      const QVariantMap parentField = m_encodedFields[parentName].toMap();
+  const CompiledSchema::Instruction &instr = m_schema.at(index);
+  const Expression &expr = m_schema.expression(instr.valueExpr);
 
-      from = parentField["from"].toInt();
+  FieldSlot value;
+  if ((instr.opcode == Opcode::Float) || (instr.opcode == Opcode::Double)) {
+    double result = 0.0;
+    if (!expr.eval(m_slots.constData(), result)) {
+      return false;
     }
-  }
 
-  if (from > to) {
-    return {};
+    value.setDouble(result);
+  } else {
+    qint64 result = 0;
+    if (!expr.evalInt(m_slots.constData(), result)) {
+      return false;
+    }
+
+    value.setInt(result);
   }
 
-  const QByteArray &data = m_buf.buffer();
-  if (to >= data.size()) {
-    return {};
+  encodeValue(index, value);
+  res = value.toVariant();
+
+  return true;
+}
+
+qint64 StructEncoder::skipSize(int index) const {
+  const CompiledSchema::Instruction &instr = m_schema.at(index);
+  if (instr.sizeExpr < 0) {
+    return instr.size;
   }
 
-  const int dataSize = to - from + 1;
-  const unsigned char *fromC =
-      reinterpret_cast<const unsigned char *>(&data.constData()[from]);
+  qint64 size = 0;
+  m_schema.expression(instr.sizeExpr).evalInt(m_slots.constData(), size);
 
-  if (fieldDescription.contains("include") &&
-      fieldDescription["include"].toBool()) {
-    const int pos = m_buf.pos();
+  return qMax<qint64>(size, 0);
+}
 
-    m_buf.seek(pos - crcSize);
+void StructEncoder::encodeValue(int index, const FieldSlot &value) {
+  using Opcode = CompiledSchema::Opcode;
+
+  const CompiledSchema::Instruction &instr = m_schema.at(index);
+  const bool bigEndian = instr.bigEndian;
+  FieldSlot &slot = m_slots[index];
+
+  switch (instr.opcode) {
+  case Opcode::Int8: {
+    const auto valueS = static_cast<qint8>(value.toInt());
+    m_writer.write(valueS, bigEndian);
+    slot.setInt(valueS);
+  } break;
+  case Opcode::UInt8: {
+    const auto valueU = static_cast<quint8>(value.toInt());
+    m_writer.write(valueU, bigEndian);
+    slot.setInt(valueU);
+  } break;
+  case Opcode::Int16: {
+    const auto valueS = static_cast<qint16>(value.toInt());
+    m_writer.write(valueS, bigEndian);
+    slot.setInt(valueS);
+  } break;
+  case Opcode::UInt16: {
+    const auto valueU = static_cast<quint16>(value.toInt());
+    m_writer.write(valueU, bigEndian);
+    slot.setInt(valueU);
+  } break;
+  case Opcode::Int24: {
+    const auto valueU = static_cast<quint32>(value.toInt());
+    m_writer.writeUInt24(valueU, bigEndian);
+    slot.setInt(fixSign24(valueU & 0xffffff));
+  } break;
+  case Opcode::UInt24: {
+    const auto valueU = static_cast<quint32>(value.toInt());
+    m_writer.writeUInt24(valueU, bigEndian);
+    slot.setInt(valueU & 0xffffff);
+  } break;
+  case Opcode::Int32: {
+    const auto valueS = static_cast<qint32>(value.toInt());
+    m_writer.write(valueS, bigEndian);
+    slot.setInt(valueS);
+  } break;
+  case Opcode::UInt32: {
+    const auto valueU = static_cast<quint32>(value.toInt());
+    m_writer.write(valueU, bigEndian);
+    slot.setInt(valueU);
+  } break;
+  case Opcode::Int64: {
+    const qint64 valueS = value.toInt();
+    m_writer.write(valueS, bigEndian);
+    slot.setInt(valueS);
+  } break;
+  case Opcode::UInt64: {
+    const quint64 valueU = value.toUInt();
+    m_writer.write(valueU, bigEndian);
+    slot.setUInt(valueU);
+  } break;
+  case Opcode::Float: {
+    const auto valueF = static_cast<float>(value.toDouble());
+    m_writer.write(valueF, bigEndian);
+    slot.setDouble(valueF);
+  } break;
+  case Opcode::Double: {
+    const double valueD = value.toDouble();
+    m_writer.write(valueD, bigEndian);
+    slot.setDouble(valueD);
+  } break;
+  default:
+    break;
   }
+}
 
-  quint64 crc = 0;
-  if (mode == "8") {
-    const quint8 crc8 = crc_8(fromC, dataSize);
-    m_ds << crc8;
-    crc = crc8;
-  } else if (mode == "16") {
-    const quint16 crc16 = crc_16(fromC, dataSize);
-    m_ds << crc16;
-    crc = crc16;
-  } else if (mode == "32") {
-    const quint32 crc32 = crc_32(fromC, dataSize);
-    m_ds << crc32;
-    crc = crc32;
-  } else if (mode == "64") {
-    const quint64 crc64 = crc_64_we(fromC, dataSize);
-    m_ds << crc64;
-    crc = crc64;
+bool StructEncoder::encodeBitfield(int index, const QVariant &valueData) {
+  const CompiledSchema::Instruction &instr = m_schema.at(index);
+  if (instr.end == index + 1) {
+    return false;
   }
 
-  QVariantMap encodedField = m_encodedFields[fieldName].toMap();
-  encodedField["to"] = m_buf.pos();
-  encodedField["value"] = crc;
-  m_encodedFields[fieldName] = encodedField;
+  // Zero padding for the 9-byte access of insertBits
+  m_scratch.fill(static_cast<char>(0), instr.size + sizeof(quint64) + 1);
 
-  QVariantMap valueRes;
-  valueRes["name"] = fieldName;
-  valueRes["value"] = crc;
+  const QVariantMap valueMap = valueData.toMap();
+  for (int i = index + 1; i < instr.end; i++) {
+    const QVariant value = (m_input != nullptr)
+                               ? m_input->toVariant(i)
+                               : valueMap.value(m_schema.at(i).name);
 
-  return toMap(valueRes);
-}
+    encodeBitfieldElement(i, value, m_scratch.data());
+  }
 
-QVariantMap StructEncoder::encodeRaw(const QVariantMap &field,
-                                     const QVariant &valueData) {
-  const QString &fieldName = field.firstKey();
-  const QVariantMap fieldDescription = field[fieldName].toMap();
+  m_writer.writeRaw(m_scratch.constData(), instr.size);
+
+  return true;
+}
 
-  const int size = fieldDescription["size"].toUInt();
-  if (size == 0) {
-    return {};
+void StructEncoder::encodeBitfieldElement(int index, const QVariant &value,
+                                          char *data) {
+  const CompiledSchema::Instruction &element = m_schema.at(index);
+  if (element.bitOffset < 0) {
+    return;
   }
 
-  const QByteArray data = QByteArray::fromHex(valueData.toString().toLatin1());
-  m_ds.writeRawData(data.data(), data.size());
-  updateEncodedTo(fieldName);
+  const QVariant &valueData = value.isNull() ? element.value : value;
+  const quint64 mask =
+      (element.size >= 64) ? ~0ull : (1ull << element.size) - 1;
 
-  QVariantMap valueRes;
-  valueRes["name"] = fieldName;
-  valueRes["value"] = data.toHex();
+  FieldSlot &slot = m_slots[index];
+  slot.from = m_slots[element.parent].from;
 
-  return toMap(valueRes);
-}
+  quint64 valueU = 0;
+  if (element.isSigned) {
+    const qint64 valueS = valueData.toLongLong();
+    slot.setInt(valueS);
 
-QVariantMap StructEncoder::encodeCustom(const QVariantMap &field,
-                                        const QVariant &valueData) {
-  const QString &fieldName = field.firstKey();
-  const QVariantMap fieldDescription = field[fieldName].toMap();
+    valueU = valueS & mask;
+  } else {
+    valueU = valueData.toULongLong();
+    slot.setUInt(valueU);
 
-  if (!fieldDescription.contains("depend") ||
-      (fieldDescription["depend"].type() != QVariant::String)) {
-    return {};
+    // Values wider than the element are not written
+    if (valueU > mask) {
+      return;
+    }
   }
 
-  const QString dependFieldName = fieldDescription["depend"].toString();
-  if (!m_encodedFields.contains(dependFieldName)) {
-    return {};
-  }
+  insertBits(data + element.bitOffset, element.bitShift, element.size,
+             element.reversed, valueU);
+}
 
-  const QVariantMap dependField = m_encodedFields[dependFieldName].toMap();
-  const QVariant &dependValue = dependField["value"];
-  if (dependValue.isNull()) {
-    return {};
-  }
+bool StructEncoder::encodeCrc(int index) {
+  const CompiledSchema::Instruction &instr = m_schema.at(index);
 
-  if (!fieldDescription.contains("choose") ||
-      (fieldDescription["choose"].type() != QVariant::Map)) {
-    return {};
-  }
-  const QVariantMap choose = fieldDescription["choose"].toMap();
-  if (choose.isEmpty()) {
-    return {};
+  qint64 to = m_writer.pos() - 1;
+  if (to < 0) {
+    return false;
   }
 
-  const auto it = std::find_if(
-      choose.constBegin(), choose.constEnd(),
-      [&dependValue](const auto &it) -> bool { return dependValue == it; });
-  if (it == choose.constEnd()) {
-    return {};
+  if (instr.include) {
+    to += instr.size;
+
+    m_writer.skip(instr.size);
   }
 
-  const QString &chooseFieldName = it.key();
-  QVariantMap spec = fieldDescription["spec"].toMap();
-  if (!spec.contains(chooseFieldName)) {
-    return {};
+  if (instr.toRef != CompiledSchema::NoRef) {
+    to = (instr.toRef >= 0) ? m_slots[instr.toRef].toInt() : 0;
   }
 
-  QVariantMap specValue = spec[chooseFieldName].toMap();
-  specValue["parent"] = fieldName;
+  qint64 from = instr.from;
+  if ((instr.parentRef >= 0) && m_slots[instr.parentRef].isVisited()) {
+    from = m_slots[instr.parentRef].from;
+  }
 
-  m_encodedFields[chooseFieldName] = specValue;
+  if ((from < 0) || (from > to) || (to >= m_writer.size())) {
+    return false;
+  }
 
-  QVariantMap encodedField;
-  encodedField[chooseFieldName] = specValue;
-  encodeMap(encodedField, valueData.toMap());
-  updateEncodedTo(fieldName);
+  if (instr.include) {
+    m_writer.seek(m_writer.pos() - instr.size);
+  }
 
-  QVariantMap valueRes;
-  valueRes["name"] = fieldName;
-  valueRes["value"] = valueData;
+  // The checksum is written once every byte it covers is final
+  addFixup(Fixup::Kind::Crc, index, from, to);
+  writeCrc(index, 0);
+  m_slots[index].setNull();
 
-  return toMap(valueRes);
+  return true;
 }
 
-QVariantMap StructEncoder::encodeStruct(const QVariantMap &field,
-                                        const QVariant &valueData) {
-  const QString &fieldName = field.firstKey();
-  const QVariantMap fieldDescription = field[fieldName].toMap();
+void StructEncoder::writeCrc(int index, quint64 crc) {
+  using Opcode = CompiledSchema::Opcode;
+
+  const CompiledSchema::Instruction &instr = m_schema.at(index);
+
+  switch (instr.opcode) {
+  case Opcode::Crc8:
+    m_writer.write(static_cast<quint8>(crc), instr.bigEndian);
+    break;
+  case Opcode::Crc16:
+    m_writer.write(static_cast<quint16>(crc), instr.bigEndian);
+    break;
+  case Opcode::Crc32:
+    m_writer.write(static_cast<quint32>(crc), instr.bigEndian);
+    break;
+  default:
+    m_writer.write(crc, instr.bigEndian);
+    break;
+  }
+  m_slots[index].setUInt(crc);
+}
 
-  const QVariantMap spec = fieldDescription["spec"].toMap();
-  const QString &specName = spec.firstKey();
-  QVariantMap specValue = spec[specName].toMap();
-  specValue["parent"] = fieldName;
+void StructEncoder::deferValue(int index) {
+  addFixup(Fixup::Kind::Value, index, 0, 0);
+  encodeValue(index, FieldSlot());
+  m_slots[index].setNull();
 
-  m_encodedFields[specName] = specValue;
+  if (m_schema.at(index).lengthRef >= 0) {
+    m_pendingLengths++;
+  }
+}
 
-  QVariantMap encodedField;
-  encodedField[specName] = specValue;
-  encodeMap(encodedField, valueData.toMap());
-  updateEncodedTo(fieldName);
+void StructEncoder::addFixup(Fixup::Kind kind, int index, qint64 from,
+                             qint64 to) {
+  Fixup fixup;
+  fixup.kind = kind;
+  fixup.index = index;
+  fixup.pos = m_writer.pos();
+  fixup.from = from;
+  fixup.to = to;
+  fixup.listPos = (m_schema.at(index).parent < 0) ? m_encodeList.size() : -1;
+
+  m_fixups.push_back(fixup);
+}
 
-  QVariantMap valueRes;
-  valueRes["name"] = fieldName;
-  valueRes["value"] = valueData;
+void StructEncoder::setFixupValue(int index, const FieldSlot &value) {
+  for (int i = m_fixups.size() - 1; i >= 0; i--) {
+    if ((m_fixups.at(i).kind == Fixup::Kind::Value) &&
+        (m_fixups.at(i).index == index)) {
+      m_fixups[i].value = value;
 
-  return toMap(valueRes);
+      return;
+    }
+  }
 }
 
-QVariantMap StructEncoder::encodeSkip(const QVariantMap &field) {
-  const QString &fieldName = field.firstKey();
-  const QVariantMap fieldDescription = field[fieldName].toMap();
+void StructEncoder::closeLength(int index, qint64 from) {
+  const qint64 length = m_writer.pos() - from;
 
-  const int size = fieldDescription["size"].toUInt();
-  if (size <= 0) {
-    return {};
+  for (auto &fixup : m_fixups) {
+    if ((fixup.kind == Fixup::Kind::Value) && fixup.value.isNull() &&
+        (m_schema.at(fixup.index).lengthRef == index)) {
+      fixup.value.setInt(length);
+      m_slots[fixup.index].setInt(length);
+      m_pendingLengths--;
+    }
   }
+}
 
-  m_ds.skipRawData(size);
-  updateEncodedTo(fieldName);
+void StructEncoder::resolveFixups() {
+  if (m_fixups.isEmpty() || m_writer.isCounting() || m_writer.overflow()) {
+    return;
+  }
 
-  QVariantMap valueRes;
-  valueRes["name"] = fieldName;
-  valueRes["value"] = {};
+  const qsizetype end = m_writer.pos();
+  CrcStream stream;
 
-  return toMap(valueRes);
-}
+  // Fixups are recorded in write order, so every region a checksum covers
+  // is patched before it
+  for (auto &fixup : m_fixups) {
+    m_writer.seek(fixup.pos);
 
-QVariantMap StructEncoder::encodeUnixtime(const QVariantMap &field,
-                                          const QVariant &valueData) {
-  const QString &fieldName = field.firstKey();
-  const QVariantMap fieldDescription = field[fieldName].toMap();
+    if (fixup.kind == Fixup::Kind::Crc) {
+      writeCrc(fixup.index, checksum(fixup, stream));
+    } else {
+      encodeValue(fixup.index, fixup.value);
+    }
 
-  const QString dateTimeStr = valueData.toString();
-  const auto dateTime = QDateTime::fromString(dateTimeStr, Qt::ISODateWithMs);
+    if (fixup.pos <= stream.to) {
+      stream = CrcStream();
+    }
 
-  const qint64 unixtime = dateTime.toMSecsSinceEpoch();
+    if (fixup.listPos >= 0) {
+      QVariantMap encodedMap;
+      encodedMap[m_schema.at(fixup.index).name] =
+          m_slots[fixup.index].toVariant();
 
-  const QString endian = fieldDescription["endian"].toString().toLower();
-  const bool bigEndian = (endian == "big");
-  if (bigEndian) {
-    m_ds.setByteOrder(QDataStream::BigEndian);
-  } else {
-    m_ds.setByteOrder(QDataStream::LittleEndian);
+      m_encodeList[fixup.listPos] = encodedMap;
+    }
   }
-  m_ds << unixtime;
 
-  updateEncodedTo(fieldName);
+  m_writer.seek(end);
+}
 
-  QVariantMap valueRes;
-  valueRes["name"] = fieldName;
-  valueRes["value"] = dateTimeStr;
+quint64 StructEncoder::checksum(const Fixup &fixup, CrcStream &stream) const {
+  using Opcode = CompiledSchema::Opcode;
 
-  return toMap(valueRes);
-}
+  const Opcode opcode = m_schema.at(fixup.index).opcode;
+  const char *data = m_writer.data();
+  const auto *dataC = reinterpret_cast<const unsigned char *>(data);
 
-QVariantMap StructEncoder::encodeConst(const QVariantMap &field,
-                                       const QVariant &valueData) {
-  const QString &fieldName = field.firstKey();
-  const QVariantMap fieldDescription = field[fieldName].toMap();
+  switch (opcode) {
+  case Opcode::Crc8:
+    return crc_8(dataC + fixup.from, fixup.to - fixup.from + 1);
+  case Opcode::Crc16:
+    return crc_16(dataC + fixup.from, fixup.to - fixup.from + 1);
+  default:
+    break;
+  }
 
-  if (!fieldDescription.contains("value") ||
-      (fieldDescription["value"].type() != QVariant::String)) {
-    return {};
+  // A range extending the previous one continues its register
+  qint64 next = fixup.from;
+  quint64 crc = (opcode == Opcode::Crc32) ? crc32Init : crc64WeInit;
+  if ((stream.opcode == opcode) && (stream.from == fixup.from) &&
+      (stream.to <= fixup.to)) {
+    next = stream.to + 1;
+    crc = stream.crc;
   }
 
-  if (!fieldDescription.contains("size") ||
-      (fieldDescription["size"].toUInt() == 0)) {
-    return {};
+  if (opcode == Opcode::Crc32) {
+    crc = crc32Update(static_cast<quint32>(crc), data + next,
+                      fixup.to - next + 1);
+  } else {
+    crc = crc64WeUpdate(crc, data + next, fixup.to - next + 1);
   }
 
-  const QString constDataStr = fieldDescription["value"].toString();
-  if (constDataStr.isEmpty()) {
-    return {};
+  stream.opcode = opcode;
+  stream.from = fixup.from;
+  stream.to = fixup.to;
+  stream.crc = crc;
+
+  if (opcode == Opcode::Crc32) {
+    return crc32Final(static_cast<quint32>(crc));
   }
 
-  QByteArray constData = QByteArray::fromHex(constDataStr.toLatin1());
-  if (constData.isEmpty()) {
-    return {};
+  return crc64WeFinal(crc);
+}
+
+bool StructEncoder::encodeCustom(int index, const QVariant &valueData) {
+  const CompiledSchema::Instruction &instr = m_schema.at(index);
+  if ((instr.dependRef < 0) || !m_slots[instr.dependRef].isVisited()) {
+    return false;
   }
 
-  const quint32 size = fieldDescription["size"].toUInt();
-  if (size > constData.size()) {
-    return {};
+  const int branch = m_schema.chooseBranch(index, m_slots[instr.dependRef]);
+  if ((branch < 0) ||
+      (m_schema.at(branch).opcode == CompiledSchema::Opcode::None)) {
+    return false;
   }
-  constData = constData.mid(0, size);
-  m_ds.writeRawData(constData.data(), constData.size());
 
-  QVariantMap valueRes;
-  valueRes["name"] = fieldName;
-  valueRes["value"] = constDataStr;
+  QVariant res;
+  encodeField(branch, childValue(branch, valueData.toMap()), res);
 
-  return toMap(valueRes);
+  return true;
 }
 
-void StructEncoder::updateEncodedTo(const QString &name) {
-  if (!m_encodedFields.contains(name)) {
-    return;
-  }
+void StructEncoder::encodeStruct(int index, const QVariant &valueData) {
+  const CompiledSchema::Instruction &instr = m_schema.at(index);
+  const QVariantMap valueMap = valueData.toMap();
 
-  QVariantMap encodedField = m_encodedFields[name].toMap();
-  encodedField["to"] = m_buf.pos();
-  m_encodedFields[name] = encodedField;
+  for (int i = index + 1; i < instr.end; i = m_schema.at(i).end) {
+    QVariant res;
+    encodeField(i, childValue(i, valueMap), res);
+  }
 }
 
-QVariant StructEncoder::getEncodedValue(const QString &name) const {
-  if (!m_encodedFields.contains(name)) {
-    return {};
+QVariant StructEncoder::topValue(const QString &name) {
+  // Values listed in schema order are taken in one pass
+  if (m_valueCursor < m_valueList.size()) {
+    const QVariantMap valueMap = m_valueList.at(m_valueCursor).toMap();
+    if (!valueMap.isEmpty() && (valueMap.firstKey() == name)) {
+      m_valueCursor++;
+
+      return valueMap.first();
+    }
+  }
+
+  if (!m_valueIndexed) {
+    m_valueIndexed = true;
+
+    for (int i = 0; i < m_valueList.size(); i++) {
+      const QVariantMap valueMap = m_valueList.at(i).toMap();
+      if (!valueMap.isEmpty() && !m_valueIndex.contains(valueMap.firstKey())) {
+        m_valueIndex.insert(valueMap.firstKey(), i);
+      }
+    }
   }
 
-  const QVariantMap encodedField = m_encodedFields[name].toMap();
-  QVariant value = encodedField["value"];
+  const int index = m_valueIndex.value(name, -1);
+  if (index < 0) {
+    return QVariant();
+  }
 
-  return value;
+  m_valueCursor = index + 1;
+
+  return m_valueList.at(index).toMap().first();
 }
 
-QVariant StructEncoder::generateEncodedValue(const QString &name,
-                                             const QVariant &value) {
-  if (!m_encodedFields.contains(name) || (value.type() == QVariant::List)) {
-    return value;
+QVariant StructEncoder::childValue(int index,
+                                   const QVariantMap &valueMap) const {
+  if (m_input != nullptr) {
+    return m_input->value(index);
   }
 
-  QVariant encodedValue = getEncodedValue(name);
-  if (encodedValue.type() == QVariant::List) {
-    QVariantList encodedValueList = encodedValue.toList();
-    encodedValueList.push_back(value);
+  return valueMap.value(m_schema.at(index).name);
+}
+
+FieldSlot StructEncoder::typedValue(CompiledSchema::Opcode opcode,
+                                    const QVariant &value) {
+  using Opcode = CompiledSchema::Opcode;
 
-    return encodedValueList;
+  FieldSlot slot;
+
+  switch (opcode) {
+  case Opcode::UInt64:
+    slot.setUInt(value.toULongLong());
+    break;
+  case Opcode::Float:
+  case Opcode::Double:
+    slot.setDouble(value.toDouble());
+    break;
+  default:
+    slot.setInt(value.toLongLong());
+    break;
   }
 
-  QVariantList encodedValueList = {encodedValue, value};
+  return slot;
+}
 
-  return encodedValueList;
+bool StructEncoder::isNumber(CompiledSchema::Opcode opcode) {
+  return (opcode >= CompiledSchema::Opcode::Int8) &&
+         (opcode <= CompiledSchema::Opcode::Double);
 }
 
 } // namespace qbinarizer
@@ -1,299 +1,587 @@
 #include "internal/structreflector.h"
-#include "jsonutils.h"
+
+#include <QDateTime>
+#include <QHash>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QStringList>
+#include <QtDebug>
+
+#include <cstddef>
 
 namespace qbinarizer {
 
-StructReflector::StructReflector() {}
+namespace {
 
-QVariantList StructReflector::createFieldSpecList(const QMetaObject *object) {
-  const QString fieldSpecStr = createFieldSpecStr(object);
-  const QString fieldSpecListStr = QString("[%1]").arg(fieldSpecStr);
-  QVariantList fieldList = parseJson(fieldSpecListStr);
+using FieldPlan = StructReflector::FieldPlan;
+using GadgetPlan = StructReflector::GadgetPlan;
+
+struct PlanCache {
+  QMutex mutex;
+  QHash<const QMetaObject *, const GadgetPlan *> plans;
+
+  ~PlanCache() { qDeleteAll(plans); }
+};
+
+PlanCache &planCache() {
+  static PlanCache cache;
 
-  return fieldList;
+  return cache;
 }
 
-QList<QMetaProperty>
-StructReflector::getPropertyList(const QMetaObject *object) {
-  QList<QMetaProperty> propertyList;
+// value points to an instance of the field meta type
+void accessProperty(const FieldPlan &field, void *gadget,
+                    QMetaObject::Call call, void *value) {
+#if QT_VERSION < QT_VERSION_CHECK(6, 0, 0)
+  // Qt 5 moc takes the value in argv[0], which skips the QVariant round trip.
+  // This is not a public contract, so other versions use QMetaProperty
+  if (field.metacall != nullptr) {
+    int status = -1;
+    int flags = 0;
+    void *argv[] = {value, nullptr, &status, &flags};
+
+    field.metacall(reinterpret_cast<QObject *>(gadget), call,
+                   field.metacallIndex, argv);
+
+    return;
+  }
+#endif
 
-  for (int i = 0; i < object->propertyCount(); i++) {
-    const QMetaProperty property = object->property(i);
+  if (call == QMetaObject::ReadProperty) {
+    const QVariant variant = field.property.readOnGadget(gadget);
+    if (variant.userType() == field.metaType) {
+      QMetaType::destruct(field.metaType, value);
+      QMetaType::construct(field.metaType, value, variant.constData());
+    }
 
-    propertyList.push_back(property);
+    return;
   }
 
-  return propertyList;
+#if QT_VERSION < QT_VERSION_CHECK(6, 0, 0)
+  field.property.writeOnGadget(gadget, QVariant(field.metaType, value));
+#else
+  field.property.writeOnGadget(gadget,
+                               QVariant(QMetaType(field.metaType), value));
+#endif
 }
 
-QString StructReflector::createFieldSpecStr(const QMetaObject *object) {
-  const QList<QMetaProperty> propertyList = getPropertyList(object);
-
-  QStringList fieldSpecList;
-  for (const auto &property : propertyList) {
-    const QString name(property.name());
-    const QVariant::Type type = property.type();
-    const QMetaType::Type metaType = static_cast<QMetaType::Type>(type);
-
-    QString valueType;
-    switch (metaType) {
-    case QMetaType::Bool:
-      valueType = QStringLiteral("uint8");
-      break;
-    case QMetaType::Int:
-      valueType = QStringLiteral("int32");
-      break;
-    case QMetaType::UInt:
-      valueType = QStringLiteral("uint32");
-      break;
-    case QMetaType::LongLong:
-      valueType = QStringLiteral("int64");
-      break;
-    case QMetaType::ULongLong:
-      valueType = QStringLiteral("uint64");
-      break;
-    case QMetaType::Double:
-      valueType = QStringLiteral("double");
-      break;
-    case QMetaType::Long:
-      valueType = QStringLiteral("int64");
-      break;
-    case QMetaType::Short:
-      valueType = QStringLiteral("int16");
-      break;
-    case QMetaType::Char:
-      valueType = QStringLiteral("int8");
-      break;
-    case QMetaType::ULong:
-      valueType = QStringLiteral("uint64");
-      break;
-    case QMetaType::UShort:
-      valueType = QStringLiteral("uint16");
-      break;
-    case QMetaType::UChar:
-      valueType = QStringLiteral("uint8");
-      break;
-    case QMetaType::Float:
-      valueType = QStringLiteral("float");
-      break;
-    case QMetaType::SChar:
-      valueType = QStringLiteral("uint8");
-      break;
-    case QMetaType::QDateTime:
-      valueType = QStringLiteral("unixtime");
-      break;
-    case QMetaType::QByteArray:
-      valueType = QStringLiteral("raw");
-      break;
-    default:
-      valueType = QStringLiteral("struct");
-      break;
+void readProperty(const FieldPlan &field, const void *gadget, void *value) {
+  accessProperty(field, const_cast<void *>(gadget), QMetaObject::ReadProperty,
+                 value);
+}
+
+void writeProperty(const FieldPlan &field, void *gadget, void *value) {
+  accessProperty(field, gadget, QMetaObject::WriteProperty, value);
+}
+
+void bindMetacall(FieldPlan &field) {
+#if QT_VERSION < QT_VERSION_CHECK(6, 0, 0)
+  const QMetaObject *owner = field.property.enclosingMetaObject();
+  field.metacall = owner->d.static_metacall;
+  field.metacallIndex =
+      field.property.propertyIndex() - owner->propertyOffset();
+#else
+  Q_UNUSED(field);
+#endif
+}
+
+/**
+ * @brief The GadgetValue class Nested gadget constructed in place, on the
+ * stack unless it is large
+ */
+class GadgetValue {
+public:
+  explicit GadgetValue(int metaType) : m_metaType(metaType) {
+    const int size = QMetaType::sizeOf(metaType);
+    void *where = (size <= static_cast<int>(sizeof(m_buffer)))
+                      ? static_cast<void *>(m_buffer)
+                      : ::operator new(size);
+
+    m_data = QMetaType::construct(metaType, where, nullptr);
+  }
+
+  ~GadgetValue() {
+    QMetaType::destruct(m_metaType, m_data);
+    if (m_data != m_buffer) {
+      ::operator delete(m_data);
     }
+  }
+
+  void *data() { return m_data; }
+
+private:
+  Q_DISABLE_COPY(GadgetValue)
+
+  alignas(std::max_align_t) char m_buffer[256];
+  int m_metaType;
+  void *m_data;
+};
+
+void encodeFields(const GadgetPlan &plan, const void *gadget,
+                  ByteWriter &writer) {
+  for (const FieldPlan &field : plan.fields) {
+    field.encode(field, gadget, writer);
+  }
+}
+
+void decodeFields(const GadgetPlan &plan, void *gadget, ByteReader &reader) {
+  for (const FieldPlan &field : plan.fields) {
+    field.decode(field, gadget, reader);
+  }
+}
+
+// W is the wire type of the member type T
+template <typename T, typename W = T>
+void encodeNumber(const FieldPlan &field, const void *gadget,
+                  ByteWriter &writer) {
+  T value = T();
+  readProperty(field, gadget, &value);
+
+  writer.write<W>(static_cast<W>(value), false);
+}
+
+template <typename T, typename W = T>
+void decodeNumber(const FieldPlan &field, void *gadget, ByteReader &reader) {
+  T value = static_cast<T>(reader.read<W>(false));
+
+  writeProperty(field, gadget, &value);
+}
+
+void encodeDateTime(const FieldPlan &field, const void *gadget,
+                    ByteWriter &writer) {
+  QDateTime value;
+  readProperty(field, gadget, &value);
+
+  writer.write<qint64>(value.toMSecsSinceEpoch(), false);
+}
+
+void decodeDateTime(const FieldPlan &field, void *gadget, ByteReader &reader) {
+  QDateTime value = QDateTime::fromMSecsSinceEpoch(reader.read<qint64>(false));
+
+  writeProperty(field, gadget, &value);
+}
+
+void encodeBytes(const FieldPlan &field, const void *gadget,
+                 ByteWriter &writer) {
+  QByteArray value;
+  readProperty(field, gadget, &value);
+
+  writer.writeRaw(value.constData(), value.size());
+}
+
+void decodeBytes(const FieldPlan &field, void *gadget, ByteReader &reader) {
+  QByteArray value(field.size, '\0');
+  reader.readRaw(value.data(), field.size);
+
+  writeProperty(field, gadget, &value);
+}
 
-    QString fieldSpecStr;
-    if (valueType == "struct") {
-      const QMetaObject *subMeta = property.enclosingMetaObject();
-      if (subMeta == nullptr) {
-        continue;
+void encodeGadgetField(const FieldPlan &field, const void *gadget,
+                       ByteWriter &writer) {
+  GadgetValue value(field.metaType);
+  readProperty(field, gadget, value.data());
+
+  encodeFields(*field.nested, value.data(), writer);
+}
+
+void decodeGadgetField(const FieldPlan &field, void *gadget,
+                       ByteReader &reader) {
+  // Read first so members outside the plan keep their values
+  GadgetValue value(field.metaType);
+  readProperty(field, gadget, value.data());
+
+  decodeFields(*field.nested, value.data(), reader);
+
+  writeProperty(field, gadget, value.data());
+}
+
+// Probe bytes hold their own offset, so each number read back tells where
+// it lies in the top-level gadget. Nested gadgets are copied with the bytes
+bool matchOffsets(const GadgetPlan &plan, const void *gadget, int &offset) {
+  for (const FieldPlan &field : plan.fields) {
+    if (field.kind == FieldPlan::Kind::Gadget) {
+      GadgetValue value(field.metaType);
+      readProperty(field, gadget, value.data());
+      if (!matchOffsets(*field.nested, value.data(), offset)) {
+        return false;
       }
 
-      static const QString fieldSpecTemplate =
-          R"({"%1": {"type": "%2", "spec": [%3]}})";
-      const QString subFieldStr = createFieldSpecStr(subMeta);
-      fieldSpecStr =
-          fieldSpecTemplate.arg(name).arg(valueType).arg(subFieldStr);
-    } else if (!valueType.isEmpty()) {
-      static const QString fieldSpecTemplate = R"({"%1": {"type": "%2"}})";
-      fieldSpecStr = fieldSpecTemplate.arg(name).arg(valueType);
-    } else {
       continue;
     }
 
-    fieldSpecList.push_back(fieldSpecStr);
+    quint64 storage = 0;
+    readProperty(field, gadget, &storage);
+
+    const auto *bytes = reinterpret_cast<const uchar *>(&storage);
+    for (int i = 0; i < field.size; i++) {
+      if (bytes[i] != offset + i) {
+        return false;
+      }
+    }
+    offset += field.size;
   }
 
-  QString fieldSpecAll = fieldSpecList.join(",");
+  return true;
+}
 
-  return fieldSpecAll;
+template <typename T, typename W = T> void setNumberCodec(FieldPlan &field) {
+  field.encode = encodeNumber<T, W>;
+  field.decode = decodeNumber<T, W>;
 }
 
-int StructReflector::setValuesInfo(const QMetaObject &metaObject,
-                                   const QVariantMap &valueMap, void *gadget,
-                                   const int offset) {
-  int size = offset;
-  QList<QMetaProperty> propertyList = getPropertyList(&metaObject);
-  for (const auto &property : propertyList) {
-    const QString name(property.name());
-    const QVariant::Type type = property.type();
-    const QMetaType::Type metaType = static_cast<QMetaType::Type>(type);
-
-    QVariant value;
-    if (valueMap.contains(name)) {
-      value = valueMap[name];
+bool setFieldType(FieldPlan &field) {
+  switch (field.metaType) {
+  case QMetaType::Bool:
+    field.kind = FieldPlan::Kind::Bool;
+    field.type = QStringLiteral("uint8");
+    field.size = 1;
+    setNumberCodec<bool, quint8>(field);
+    break;
+  case QMetaType::Char:
+    field.kind = FieldPlan::Kind::Int;
+    field.type = QStringLiteral("int8");
+    field.size = 1;
+    setNumberCodec<char, qint8>(field);
+    break;
+  case QMetaType::SChar:
+    field.kind = FieldPlan::Kind::Int;
+    field.type = QStringLiteral("int8");
+    field.size = 1;
+    setNumberCodec<signed char, qint8>(field);
+    break;
+  case QMetaType::UChar:
+    field.kind = FieldPlan::Kind::UInt;
+    field.type = QStringLiteral("uint8");
+    field.size = 1;
+    setNumberCodec<uchar, quint8>(field);
+    break;
+  case QMetaType::Short:
+    field.kind = FieldPlan::Kind::Int;
+    field.type = QStringLiteral("int16");
+    field.size = 2;
+    setNumberCodec<short, qint16>(field);
+    break;
+  case QMetaType::UShort:
+    field.kind = FieldPlan::Kind::UInt;
+    field.type = QStringLiteral("uint16");
+    field.size = 2;
+    setNumberCodec<ushort, quint16>(field);
+    break;
+  case QMetaType::Int:
+    field.kind = FieldPlan::Kind::Int;
+    field.type = QStringLiteral("int32");
+    field.size = 4;
+    setNumberCodec<int, qint32>(field);
+    break;
+  case QMetaType::UInt:
+    field.kind = FieldPlan::Kind::UInt;
+    field.type = QStringLiteral("uint32");
+    field.size = 4;
+    setNumberCodec<uint, quint32>(field);
+    break;
+  case QMetaType::Long:
+    field.kind = FieldPlan::Kind::Int64;
+    field.type = QStringLiteral("int64");
+    field.size = 8;
+    setNumberCodec<long, qint64>(field);
+    break;
+  case QMetaType::LongLong:
+    field.kind = FieldPlan::Kind::Int64;
+    field.type = QStringLiteral("int64");
+    field.size = 8;
+    setNumberCodec<qlonglong, qint64>(field);
+    break;
+  case QMetaType::ULong:
+    field.kind = FieldPlan::Kind::UInt64;
+    field.type = QStringLiteral("uint64");
+    field.size = 8;
+    setNumberCodec<ulong, quint64>(field);
+    break;
+  case QMetaType::ULongLong:
+    field.kind = FieldPlan::Kind::UInt64;
+    field.type = QStringLiteral("uint64");
+    field.size = 8;
+    setNumberCodec<qulonglong, quint64>(field);
+    break;
+  case QMetaType::Float:
+    field.kind = FieldPlan::Kind::Float;
+    field.type = QStringLiteral("float");
+    field.size = 4;
+    setNumberCodec<float>(field);
+    break;
+  case QMetaType::Double:
+    field.kind = FieldPlan::Kind::Double;
+    field.type = QStringLiteral("double");
+    field.size = 8;
+    setNumberCodec<double>(field);
+    break;
+  case QMetaType::QDateTime:
+    field.kind = FieldPlan::Kind::DateTime;
+    field.type = QStringLiteral("unixtime");
+    field.size = 8;
+    field.encode = encodeDateTime;
+    field.decode = decodeDateTime;
+    break;
+  case QMetaType::QByteArray:
+    field.kind = FieldPlan::Kind::Bytes;
+    field.type = QStringLiteral("raw");
+    field.size = 1;
+    field.encode = encodeBytes;
+    field.decode = decodeBytes;
+    break;
+  default: {
+    const QMetaObject *subMeta = QMetaType::metaObjectForType(field.metaType);
+    if ((subMeta == nullptr) ||
+        !(QMetaType::typeFlags(field.metaType) & QMetaType::IsGadget)) {
+      return false;
     }
 
-    QVariant valueNew;
-    switch (metaType) {
-    case QMetaType::Bool:
-      size += 1;
-      break;
-    case QMetaType::Char:
-      size += 1;
-      break;
-    case QMetaType::UChar:
-      size += 1;
-      break;
-    case QMetaType::SChar:
-      size += 1;
-      break;
-    case QMetaType::Short:
-      size += 2;
-      break;
-    case QMetaType::UShort:
-      size += 2;
-      break;
-    case QMetaType::Int:
-      size += 4;
-      break;
-    case QMetaType::UInt:
-      size += 4;
-      break;
-    case QMetaType::Long:
-      size += 4;
-      break;
-    case QMetaType::ULong:
-      size += 4;
-      break;
-    case QMetaType::LongLong:
-      size += 8;
-      break;
-    case QMetaType::ULongLong:
-      size += 8;
+    field.kind = FieldPlan::Kind::Gadget;
+    field.type = QStringLiteral("struct");
+    field.nested = &StructReflector::plan(subMeta);
+    field.size = field.nested->size;
+    field.encode = encodeGadgetField;
+    field.decode = decodeGadgetField;
+  } break;
+  }
+
+  return true;
+}
+
+GadgetPlan *createPlan(const QMetaObject *object) {
+  auto *plan = new GadgetPlan;
+  plan->metaObject = object;
+
+  QStringList fieldSpecStrList;
+  plan->plainNumbers = (object->propertyCount() > 0);
+  for (int i = 0; i < object->propertyCount(); i++) {
+    const QMetaProperty property = object->property(i);
+
+    FieldPlan field;
+    field.name = QString::fromLatin1(property.name());
+    field.metaType = property.userType();
+    field.propertyIndex = i;
+    field.property = property;
+    if (!setFieldType(field)) {
+      qWarning() << "gadget" << object->className() << "property"
+                 << field.name << "of type" << property.typeName()
+                 << "is not encoded";
+      continue;
+    }
+
+    bindMetacall(field);
+
+    QVariantMap description{{QStringLiteral("type"), field.type}};
+    if (field.nested != nullptr) {
+      description[QStringLiteral("spec")] = field.nested->fieldSpecList;
+    }
+
+    const QVariantMap fieldSpec{{field.name, description}};
+    plan->fieldSpecList.push_back(fieldSpec);
+    fieldSpecStrList.push_back(
+        QJsonDocument(QJsonObject::fromVariantMap(fieldSpec))
+            .toJson(QJsonDocument::Compact));
+
+    switch (field.kind) {
+    case FieldPlan::Kind::Bool:
+    case FieldPlan::Kind::DateTime:
+    case FieldPlan::Kind::Bytes:
+      plan->plainNumbers = false;
       break;
-    case QMetaType::Float:
-      size += 4;
+    case FieldPlan::Kind::Gadget:
+      plan->plainNumbers &= field.nested->plainNumbers;
       break;
-    case QMetaType::Double:
-      size += 8;
+    default:
       break;
-    default: {
-      const int type = QMetaType::type(property.typeName());
-      const QMetaObject *subMeta = QMetaType::metaObjectForType(type);
-      if (subMeta == nullptr) {
-        continue;
-      }
+    }
 
-      const int offset = size;
-      char *gadgetData = reinterpret_cast<char *>(gadget);
-      char *propertyData = &gadgetData[offset];
-      const int subSize =
-          setValuesInfo(*subMeta, value.toMap(), propertyData, size);
-      size += subSize;
-    } break;
+    plan->size += field.size;
+    plan->fields.push_back(field);
+  }
+  plan->fieldSpecStr = fieldSpecStrList.join(",");
+
+  return plan;
+}
+
+} // namespace
+
+StructReflector::StructReflector() {}
+
+const StructReflector::GadgetPlan &
+StructReflector::plan(const QMetaObject *object) {
+  PlanCache &cache = planCache();
+
+  {
+    QMutexLocker locker(&cache.mutex);
+
+    const GadgetPlan *plan = cache.plans.value(object);
+    if (plan != nullptr) {
+      return *plan;
+    }
+  }
+
+  // Built outside the lock as nested gadgets look up their own plans. A
+  // concurrent first use of the same type keeps whichever plan came first
+  GadgetPlan *plan = createPlan(object);
+
+  QMutexLocker locker(&cache.mutex);
+
+  const GadgetPlan *existing = cache.plans.value(object);
+  if (existing != nullptr) {
+    delete plan;
+
+    return *existing;
+  }
+
+  cache.plans.insert(object, plan);
+
+  return *plan;
+}
+
+void StructReflector::encodeGadget(const QMetaObject &metaObject,
+                                   const void *gadget, ByteWriter &writer) {
+  encodeFields(plan(&metaObject), gadget, writer);
+}
+
+bool StructReflector::hasWireLayout(const QMetaObject &metaObject,
+                                    void *probe, int size) {
+  const GadgetPlan &gadgetPlan = plan(&metaObject);
+
+  // Offsets are told apart by byte value, so up to 256 bytes are probed
+  if (!gadgetPlan.plainNumbers || (gadgetPlan.size != size) ||
+      (size > 256)) {
+    return false;
+  }
+
+  auto *bytes = static_cast<uchar *>(probe);
+  for (int i = 0; i < size; i++) {
+    bytes[i] = static_cast<uchar>(i);
+  }
+
+  int offset = 0;
+
+  return matchOffsets(gadgetPlan, probe, offset) && (offset == size);
+}
+
+bool StructReflector::decodeGadget(const QMetaObject &metaObject,
+                                   void *gadget, ByteReader &reader) {
+  const GadgetPlan &gadgetPlan = plan(&metaObject);
+
+  // Every field has a fixed size, so one check covers the whole gadget
+  if (!reader.canRead(gadgetPlan.size)) {
+    return false;
+  }
+
+  decodeFields(gadgetPlan, gadget, reader);
+
+  return true;
+}
+
+QVariantList StructReflector::createFieldSpecList(const QMetaObject *object) {
+  return plan(object).fieldSpecList;
+}
+
+QList<QMetaProperty>
+StructReflector::getPropertyList(const QMetaObject *object) {
+  QList<QMetaProperty> propertyList;
+
+  for (int i = 0; i < object->propertyCount(); i++) {
+    const QMetaProperty property = object->property(i);
+
+    propertyList.push_back(property);
+  }
+
+  return propertyList;
+}
+
+QString StructReflector::createFieldSpecStr(const QMetaObject *object) {
+  return plan(object).fieldSpecStr;
+}
+
+int StructReflector::setValuesInfo(const QMetaObject &metaObject,
+                                   const QVariantMap &valueMap, void *gadget,
+                                   const int offset) {
+  const GadgetPlan &gadgetPlan = plan(&metaObject);
+
+  for (const FieldPlan &field : gadgetPlan.fields) {
+    const auto it = valueMap.constFind(field.name);
+    if ((it == valueMap.constEnd()) || it->isNull()) {
+      continue;
     }
 
-    if (!value.isNull()) {
+    const QMetaProperty property = metaObject.property(field.propertyIndex);
+
+    switch (field.kind) {
+    case FieldPlan::Kind::Bytes:
+      property.writeOnGadget(
+          gadget, QByteArray::fromHex(it->toString().toLatin1()));
+      break;
+    case FieldPlan::Kind::Gadget: {
+      // Filled in place on a copy, fields missing from the map keep their
+      // values
+      QVariant value = property.readOnGadget(gadget);
+      setValuesInfo(*field.nested->metaObject, it->toMap(), value.data());
       property.writeOnGadget(gadget, value);
+    } break;
+    default:
+      property.writeOnGadget(gadget, *it);
+      break;
     }
   }
 
-  return size;
+  return offset + gadgetPlan.size;
 }
 
 StructReflector::StructInfo
 StructReflector::getValuesInfo(const QMetaObject &metaObject,
                                const void *gadget, const int offset) {
-  QVariantMap valueMap;
-
-  int size = offset;
-  QList<QMetaProperty> propertyList = getPropertyList(&metaObject);
-  for (const auto &property : propertyList) {
-    const QString name(property.name());
-    const QVariant::Type type = property.type();
-    const QMetaType::Type metaType = static_cast<QMetaType::Type>(type);
+  const GadgetPlan &gadgetPlan = plan(&metaObject);
 
-    QVariant value = property.readOnGadget(gadget);
+  QVariantMap valueMap;
+  for (const FieldPlan &field : gadgetPlan.fields) {
+    const QMetaProperty property = metaObject.property(field.propertyIndex);
+    const QVariant value = property.readOnGadget(gadget);
 
     QVariant valueNew;
-    switch (metaType) {
-    case QMetaType::Bool:
-      size += 1;
-      valueNew = (int)value.toBool();
-      break;
-    case QMetaType::Char:
-      size += 1;
-      valueNew = value.toChar();
+    switch (field.kind) {
+    case FieldPlan::Kind::Bool:
+      valueNew = static_cast<int>(value.toBool());
       break;
-    case QMetaType::UChar:
-      size += 1;
-      valueNew = value.toUInt();
-      break;
-    case QMetaType::SChar:
-      size += 1;
-      valueNew = value.toInt();
-      break;
-    case QMetaType::Short:
-      size += 2;
+    case FieldPlan::Kind::Int:
       valueNew = value.toInt();
       break;
-    case QMetaType::UShort:
-      size += 2;
+    case FieldPlan::Kind::UInt:
       valueNew = value.toUInt();
       break;
-    case QMetaType::Int:
-      size += 4;
-      valueNew = value.toInt();
-      break;
-    case QMetaType::UInt:
-      size += 4;
-      valueNew = value.toUInt();
-      break;
-    case QMetaType::Long:
-      size += 4;
-      valueNew = value.toLongLong();
-      break;
-    case QMetaType::ULong:
-      size += 4;
-      valueNew = value.toULongLong();
-      break;
-    case QMetaType::LongLong:
-      size += 8;
+    case FieldPlan::Kind::Int64:
       valueNew = value.toLongLong();
       break;
-    case QMetaType::ULongLong:
-      size += 8;
+    case FieldPlan::Kind::UInt64:
       valueNew = value.toULongLong();
       break;
-    case QMetaType::Float:
-      size += 4;
+    case FieldPlan::Kind::Float:
       valueNew = value.toFloat();
       break;
-    case QMetaType::Double:
-      size += 8;
+    case FieldPlan::Kind::Double:
       valueNew = value.toDouble();
       break;
-    default: {
-      const int type = QMetaType::type(property.typeName());
-      const QMetaObject *subMeta = QMetaType::metaObjectForType(type);
-      if (subMeta == nullptr) {
-        continue;
-      }
-
-      const int offset = size;
-      const char *gadgetData = reinterpret_cast<const char *>(gadget);
-      const char *propertyData = &gadgetData[offset];
-
-      const StructInfo info = getValuesInfo(*subMeta, propertyData);
-      size += info.size;
-      valueNew = info.valueMap;
-    } break;
+    case FieldPlan::Kind::DateTime:
+      valueNew = value.toDateTime().toString(Qt::ISODateWithMs);
+      break;
+    case FieldPlan::Kind::Bytes:
+      valueNew = QString::fromLatin1(value.toByteArray().toHex());
+      break;
+    case FieldPlan::Kind::Gadget:
+      valueNew =
+          getValuesInfo(*field.nested->metaObject, value.constData()).valueMap;
+      break;
     }
 
-    valueMap[name] = valueNew;
+    valueMap[field.name] = valueNew;
   }
 
   StructInfo info;
-  info.size = size;
+  info.size = offset + gadgetPlan.size;
   info.valueMap = valueMap;
 
   return info;
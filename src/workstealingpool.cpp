@@ -0,0 +1,157 @@
+#include "workstealingpool.h"
+
+namespace qbinarizer {
+
+WorkStealingPool::WorkStealingPool(int threadCount)
+    : m_threadCount(qMax(1, threadCount)),
+      m_ranges(new Range[qMax(1, threadCount)]), m_generation(0),
+      m_active(0), m_quit(false), m_task(nullptr) {
+  for (int worker = 1; worker < m_threadCount; worker++) {
+    m_threads.emplace_back(&WorkStealingPool::workerLoop, this, worker);
+  }
+}
+
+WorkStealingPool::~WorkStealingPool() {
+  {
+    std::lock_guard<std::mutex> locker(m_mutex);
+    m_quit = true;
+  }
+  m_wake.notify_all();
+
+  for (auto &thread : m_threads) {
+    thread.join();
+  }
+}
+
+WorkStealingPool &WorkStealingPool::globalInstance() {
+  static WorkStealingPool pool(std::thread::hardware_concurrency());
+
+  return pool;
+}
+
+int WorkStealingPool::threadCount() const { return m_threadCount; }
+
+void WorkStealingPool::run(qsizetype count, const Task &task) {
+  if (count <= 0) {
+    return;
+  }
+
+  std::lock_guard<std::mutex> runLocker(m_runMutex);
+
+  if ((m_threadCount == 1) || (count == 1)) {
+    for (qsizetype i = 0; i < count; i++) {
+      task(0, i);
+    }
+
+    return;
+  }
+
+  for (int worker = 0; worker < m_threadCount; worker++) {
+    Range &range = m_ranges[worker];
+
+    std::lock_guard<std::mutex> locker(range.mutex);
+    range.begin = count * worker / m_threadCount;
+    range.end = count * (worker + 1) / m_threadCount;
+  }
+
+  {
+    std::lock_guard<std::mutex> locker(m_mutex);
+    m_task = &task;
+    m_active = m_threadCount - 1;
+    m_generation++;
+  }
+  m_wake.notify_all();
+
+  work(0);
+
+  std::unique_lock<std::mutex> locker(m_mutex);
+  m_done.wait(locker, [this]() -> bool { return m_active == 0; });
+  m_task = nullptr;
+}
+
+void WorkStealingPool::workerLoop(int worker) {
+  quint64 generation = 0;
+
+  for (;;) {
+    {
+      std::unique_lock<std::mutex> locker(m_mutex);
+      m_wake.wait(locker, [this, generation]() -> bool {
+        return m_quit || (m_generation != generation);
+      });
+
+      if (m_quit) {
+        return;
+      }
+
+      generation = m_generation;
+    }
+
+    work(worker);
+
+    {
+      std::lock_guard<std::mutex> locker(m_mutex);
+      m_active--;
+    }
+    m_done.notify_one();
+  }
+}
+
+void WorkStealingPool::work(int worker) {
+  for (;;) {
+    qsizetype index = 0;
+    if (takeLocal(worker, index)) {
+      (*m_task)(worker, index);
+
+      continue;
+    }
+
+    if (!steal(worker)) {
+      return;
+    }
+  }
+}
+
+bool WorkStealingPool::takeLocal(int worker, qsizetype &index) {
+  Range &range = m_ranges[worker];
+
+  std::lock_guard<std::mutex> locker(range.mutex);
+  if (range.begin >= range.end) {
+    return false;
+  }
+
+  index = range.begin++;
+
+  return true;
+}
+
+bool WorkStealingPool::steal(int worker) {
+  for (int i = 1; i < m_threadCount; i++) {
+    Range &victim = m_ranges[(worker + i) % m_threadCount];
+
+    qsizetype begin = 0;
+    qsizetype end = 0;
+    {
+      std::lock_guard<std::mutex> locker(victim.mutex);
+      const qsizetype remaining = victim.end - victim.begin;
+      if (remaining <= 0) {
+        continue;
+      }
+
+      end = victim.end;
+      begin = end - (remaining + 1) / 2;
+      victim.end = begin;
+    }
+
+    Range &range = m_ranges[worker];
+
+    std::lock_guard<std::mutex> locker(range.mutex);
+    range.begin = begin;
+    range.end = end;
+
+    return true;
+  }
+
+  return false;
+}
+
+} // namespace qbinarizer
@@ -0,0 +1,70 @@
+#ifndef WORKSTEALINGPOOL_H
+#define WORKSTEALINGPOOL_H
+
+#include <QtGlobal>
+
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace qbinarizer {
+
+/**
+ * @brief The WorkStealingPool class Runs task(worker, index) for every index
+ * of a job. Each worker starts with an equal slice of the indices and, once
+ * it runs dry, steals half of the remaining slice of another worker, so
+ * uneven item costs do not leave workers idle. The calling thread is worker 0
+ */
+class WorkStealingPool {
+public:
+  using Task = std::function<void(int worker, qsizetype index)>;
+
+  explicit WorkStealingPool(int threadCount);
+
+  ~WorkStealingPool();
+
+  static WorkStealingPool &globalInstance();
+
+  int threadCount() const;
+
+  /**
+   * @brief run Blocks until all indices in [0, count) are processed
+   */
+  void run(qsizetype count, const Task &task);
+
+protected:
+  void workerLoop(int worker);
+
+  void work(int worker);
+
+  bool takeLocal(int worker, qsizetype &index);
+
+  bool steal(int worker);
+
+private:
+  struct Range {
+    std::mutex mutex;
+    qsizetype begin = 0;
+    qsizetype end = 0;
+  };
+
+  int m_threadCount;
+  std::unique_ptr<Range[]> m_ranges;
+  std::vector<std::thread> m_threads;
+
+  std::mutex m_runMutex;
+  std::mutex m_mutex;
+  std::condition_variable m_wake;
+  std::condition_variable m_done;
+  quint64 m_generation;
+  int m_active;
+  bool m_quit;
+  const Task *m_task;
+};
+
+} // namespace qbinarizer
+
+#endif // WORKSTEALINGPOOL_H
@@ -1,4 +1,7 @@
 #include "binarizertest.h"
+#include "genschema.h"
+
+#include <qbinarizer/internal/crcutils.h>
 
 #include <QJsonArray>
 #include <QJsonDocument>
@@ -106,6 +109,9 @@ const QVector<CheckStruct> checkList = {
     {R"([{"b": {"type": "bitfield", "size": 1, "spec": {"f1": {"pos": 0,
         "size": 2, "signed": true}}}}])",
      R"([{"b": {"f1": -1}}])", "C0"},
+    {R"([{"b": {"type": "bitfield", "size": 2, "reversed": true, "spec":
+        {"f1": {"pos": 0, "size": 3}, "f2": {"pos": 12, "size": 4}}}}])",
+     R"([{"b": {"f1": 5, "f2": 9}}])", "9005"},
     {R"([{"b": {"type": "unixtime"}}])",
      R"([{"b": "2022-09-04T22:01:31.902"}])", "7e1ee10983010000"},
     {R"([{"a": {"type": "const", "size": 3, "value": "112233"}}, {"b": {"type": "int8"}}])",
@@ -126,7 +132,8 @@ TEST_F(BinarizerTest, EncodeDecodeTest) {
     const QVariantList valueList = getList(check.valueStr);
     const QByteArray testData = QByteArray::fromHex(check.dataHex.toLatin1());
 
-    const QByteArray encData = encoder.encode(fieldList, valueList);
+    const QByteArray encData =
+        std::get<0>(encoder.encode(fieldList, valueList));
     const QVariantList decList = decoder.decode(fieldList, encData);
 
     if (!compareVariants(valueList, decList) || (testData != encData)) {
@@ -140,6 +147,764 @@ TEST_F(BinarizerTest, EncodeDecodeTest) {
   }
 }
 
+TEST_F(BinarizerTest, CompiledDecodeTest) {
+  for (const auto &check : checkList) {
+    const QVariantList fieldList = getList(check.fieldStr);
+    const QVariantList valueList = getList(check.valueStr);
+    const QByteArray testData = QByteArray::fromHex(check.dataHex.toLatin1());
+
+    const qbinarizer::CompiledSchema schema(fieldList);
+    const QVariantList decList = decoder.decode(schema, testData);
+    const QVariantList refList = decoder.decode(fieldList, testData);
+
+    EXPECT_TRUE(compareVariants(valueList, decList))
+        << "Failed to decode compiled message: "
+        << check.fieldStr.toStdString();
+    EXPECT_TRUE(compareVariants(refList, decList))
+        << "Compiled decode differs from interpreted: "
+        << check.fieldStr.toStdString();
+  }
+}
+
+TEST_F(BinarizerTest, CompiledEncodeTest) {
+  for (const auto &check : checkList) {
+    const QVariantList valueList = getList(check.valueStr);
+    const QByteArray testData = QByteArray::fromHex(check.dataHex.toLatin1());
+
+    const qbinarizer::CompiledSchema schema(getList(check.fieldStr));
+    const QByteArray encData = std::get<0>(encoder.encode(schema, valueList));
+
+    EXPECT_EQ(testData, encData) << "Failed to encode compiled message: "
+                                 << check.fieldStr.toStdString();
+  }
+
+  // Count and depend references read the slots of fields encoded before
+  const qbinarizer::CompiledSchema schema(getList(
+      R"([{"l": {"type": "uint8"}}, {"a": {"type": "int8", "count": "l"}},
+        {"v": {"type": "int8"}}, {"c": {"type": "custom", "choose": {"x": 1},
+        "depend": "v", "spec": {"x": {"type": "uint16"}}}}])"));
+  const QVariantList valueList = getList(
+      R"([{"l": 3}, {"a": [1, 2, 3]}, {"v": 1}, {"c": {"x": 258}}])");
+
+  const auto encoded = encoder.encode(schema, valueList);
+  EXPECT_EQ(std::get<0>(encoded), QByteArray::fromHex("03010203010201"));
+  EXPECT_EQ(std::get<1>(encoded).size(), 4);
+}
+
+TEST_F(BinarizerTest, EncodeValuesTest) {
+  const qbinarizer::CompiledSchema schema(getList(
+      R"([{"a": {"type": "int16", "endian": "big"}}, {"s": {"type": "struct",
+        "spec": [{"x": {"type": "uint8"}}, {"y": {"type": "double"}}]}},
+        {"r": {"type": "raw", "size": 2}}])"));
+  const QByteArray expected = std::get<0>(encoder.encode(
+      schema, getList(R"([{"a": -2}, {"s": {"x": 7, "y": 0.5}},
+        {"r": "abcd"}])")));
+  EXPECT_EQ(expected.toHex(), "fffe07000000000000e03fabcd");
+
+  // Values out of schema order are found by name
+  EXPECT_EQ(std::get<0>(encoder.encode(
+                schema, getList(R"([{"r": "abcd"}, {"s": {"y": 0.5, "x": 7}},
+                  {"a": -2}])"))),
+            expected);
+
+  qbinarizer::EncodeValues values(schema);
+  values.setInt(schema.indexOf("a"), -2);
+  values.setUInt(schema.indexOf("x"), 7);
+  values.setDouble(schema.indexOf("y"), 0.5);
+  values.setValue(schema.indexOf("r"), "abcd");
+
+  EXPECT_EQ(std::get<0>(encoder.encode(schema, values)), expected);
+  EXPECT_EQ(encoder.encodedSize(schema, values), expected.size());
+}
+
+TEST_F(BinarizerTest, TruncatedDecodeTest) {
+  // b runs past the end, so it reads as 0 and the raw field is zero padded
+  const qbinarizer::CompiledSchema schema(getList(
+      R"([{"a": {"type": "uint16", "endian": "big"}}, {"b": {"type": "uint32",
+        "endian": "big"}}, {"c": {"type": "raw", "size": 3}}])"));
+
+  const QVariantList resList =
+      decoder.decode(schema, QByteArray::fromHex("01020304"));
+  ASSERT_EQ(resList.size(), 3);
+  EXPECT_EQ(resList.at(0).toMap().value("a").toInt(), 258);
+  EXPECT_EQ(resList.at(1).toMap().value("b").toInt(), 0);
+  EXPECT_EQ(resList.at(2).toMap().value("c").toByteArray(), "000000");
+
+  // Nothing to read at all still reports every field
+  const QVariantList emptyList = decoder.decode(schema, QByteArray());
+  ASSERT_EQ(emptyList.size(), 3);
+  EXPECT_EQ(emptyList.at(0).toMap().value("a").toInt(), 0);
+  EXPECT_EQ(emptyList.at(2).toMap().value("c").toByteArray(), "000000");
+}
+
+TEST_F(BinarizerTest, EncodeIntoTest) {
+  const qbinarizer::CompiledSchema schema(getList(
+      R"([{"a": {"type": "uint16", "endian": "big"}}, {"b": {"type":
+        "int8"}}])"));
+  const QVariantList valueList = getList(R"([{"a": 258}, {"b": -1}])");
+
+  // Appended after what out already holds
+  QByteArray out = QByteArray::fromHex("aabb");
+  EXPECT_EQ(encoder.encodeInto(out, schema, valueList), 3);
+  EXPECT_EQ(out.toHex(), "aabb0102ff");
+
+  char span[3];
+  EXPECT_EQ(encoder.encodeInto(span, 2, schema, valueList), -1);
+  ASSERT_EQ(encoder.encodeInto(span, sizeof(span), schema, valueList), 3);
+  EXPECT_EQ(QByteArray(span, 3).toHex(), "0102ff");
+}
+
+TEST_F(BinarizerTest, EncodedSizeTest) {
+  encoder.setExactSize(true);
+
+  for (const auto &check : checkList) {
+    const QVariantList valueList = getList(check.valueStr);
+    const QByteArray testData = QByteArray::fromHex(check.dataHex.toLatin1());
+
+    const qbinarizer::CompiledSchema schema(getList(check.fieldStr));
+    EXPECT_EQ(encoder.encodedSize(schema, valueList), testData.size())
+        << check.fieldStr.toStdString();
+
+    const QByteArray encData = std::get<0>(encoder.encode(schema, valueList));
+    EXPECT_EQ(testData, encData) << check.fieldStr.toStdString();
+    EXPECT_EQ(encData.capacity(), encData.size());
+  }
+
+  encoder.setExactSize(false);
+}
+
+TEST_F(BinarizerTest, BackwardSeekEncodeTest) {
+  // b seeks back over a, so the frame ends before the furthest byte written
+  const qbinarizer::CompiledSchema schema(
+      getList(R"([{"a": {"type": "uint64"}}, {"b": {"type": "uint8", "pos":
+        0}}, {"c": {"type": "crc32"}}])"));
+  const QVariantList valueList = getList(R"([{"a": 1}, {"b": 2}])");
+
+  const QByteArray testData = std::get<0>(encoder.encode(schema, valueList));
+  ASSERT_EQ(testData.size(), 5);
+  EXPECT_EQ(encoder.encodedSize(schema, valueList), 5);
+  EXPECT_EQ(encoder.encodedCapacity(schema, valueList), 8);
+
+  encoder.setExactSize(true);
+  EXPECT_EQ(std::get<0>(encoder.encode(schema, valueList)), testData);
+  encoder.setExactSize(false);
+
+  char span[8];
+  EXPECT_EQ(encoder.encodeInto(span, 5, schema, valueList), -1);
+  ASSERT_EQ(encoder.encodeInto(span, sizeof(span), schema, valueList), 5);
+  EXPECT_EQ(QByteArray(span, 5), testData);
+}
+
+class CountingSink : public qbinarizer::DecodeSink {
+public:
+  int depth = 0;
+  int maxDepth = 0;
+  int valueCount = 0;
+
+  void beginStruct(int) override { maxDepth = qMax(maxDepth, ++depth); }
+
+  void endStruct(int) override { depth--; }
+
+  void onValue(int, qint64) override { valueCount++; }
+};
+
+TEST_F(BinarizerTest, FixupEncodeTest) {
+  const qbinarizer::CompiledSchema schema(getList(
+      R"([{"len": {"type": "uint16", "endian": "big", "length": "payload"}},
+        {"n": {"type": "uint8"}}, {"payload": {"type": "struct", "spec":
+        [{"a": {"type": "int16", "count": "n"}}, {"s": {"type": "raw",
+        "size": 2}}]}}, {"c1": {"type": "crc32", "endian": "big"}},
+        {"c2": {"type": "crc32", "endian": "big"}}])"));
+  const QVariantList valueList =
+      getList(R"([{"payload": {"a": [1, 2, 3], "s": "abcd"}}])");
+
+  const auto res = encoder.encode(schema, valueList);
+  EXPECT_EQ(std::get<0>(res).toHex(),
+            "000803010002000300abcd7a2c1889096b7b48");
+
+  const QVariantList &resList = std::get<1>(res);
+  ASSERT_EQ(resList.size(), 5);
+  EXPECT_EQ(resList.at(0).toMap().value("len").toInt(), 8);
+  EXPECT_EQ(resList.at(1).toMap().value("n").toInt(), 3);
+  EXPECT_EQ(resList.at(3).toMap().value("c1").toULongLong(), 0x7a2c1889u);
+
+  EXPECT_EQ(encoder.encodedSize(schema, valueList), 19);
+}
+
+TEST_F(BinarizerTest, SinkDecodeTest) {
+  const qbinarizer::CompiledSchema schema(getList(
+      R"([{"v": {"type": "int8"}}, {"a": {"type": "custom", "choose": {"b":
+        1, "c": 2}, "depend": "v", "spec": {"b": {"type": "int8"}, "c":
+        {"type": "int8"}}}}])"));
+
+  CountingSink sink;
+  decoder.decode(schema, QByteArray::fromHex("0201"), sink);
+
+  EXPECT_EQ(sink.valueCount, 2);
+  EXPECT_EQ(sink.maxDepth, 1);
+  EXPECT_EQ(sink.depth, 0);
+}
+
+TEST_F(BinarizerTest, CustomDispatchTest) {
+  // Dense keys 0..99 and sparse keys spread over the uint32 range
+  for (const quint32 step : {1u, 40000000u}) {
+    QVariantMap choose;
+    QVariantMap spec;
+    for (int i = 0; i < 100; i++) {
+      const QString name = QString("b%1").arg(i);
+
+      choose[name] = double(i * step);
+      spec[name] = QVariantMap{{"type", "uint8"}, {"value", i}};
+    }
+
+    const QVariantList fieldList = {
+        QVariantMap{{"v", QVariantMap{{"type", "uint32"}}}},
+        QVariantMap{{"c", QVariantMap{{"type", "custom"},
+                                      {"depend", "v"},
+                                      {"choose", choose},
+                                      {"spec", spec}}}}};
+    const qbinarizer::CompiledSchema schema(fieldList);
+
+    const QVariantList valueList = {QVariantMap{{"v", 57 * step}}};
+    const QByteArray data = std::get<0>(encoder.encode(schema, valueList));
+
+    QByteArray expected(4, static_cast<char>(0));
+    qToLittleEndian<quint32>(57 * step, expected.data());
+    expected.append(char(57));
+    EXPECT_EQ(data, expected);
+
+    const QVariantList decList = decoder.decode(schema, data);
+    ASSERT_EQ(decList.size(), 2);
+    EXPECT_EQ(decList.at(1).toMap()["c"].toMap()["b57"].toInt(), 57);
+
+    // Values without a branch select nothing
+    qToLittleEndian<quint32>(57 * step + 1, expected.data());
+    EXPECT_EQ(decoder.decode(schema, expected).size(), 1);
+  }
+}
+
+class CrcSink : public qbinarizer::DecodeSink {
+public:
+  QVector<quint64> crcs;
+
+  void onUnsigned(int, quint64 value) override { crcs.push_back(value); }
+};
+
+TEST_F(BinarizerTest, CrcDecodeTest) {
+  const qbinarizer::CompiledSchema schema(
+      getList(R"([{"d": {"type": "raw", "size": 100}}, {"c32": {"type":
+        "crc32"}}, {"c64": {"type": "crc64"}}])"));
+
+  QByteArray frame;
+  for (int i = 0; i < 100; i++) {
+    frame.append(static_cast<char>(i));
+  }
+  frame.append(QByteArray::fromHex("f532c958"));
+  frame.append(QByteArray(8, 0));
+
+  CrcSink sink;
+  decoder.decode(schema, frame, sink);
+
+  ASSERT_EQ(sink.crcs.size(), 2);
+  EXPECT_EQ(sink.crcs.at(0), 0x58c932f5ull);
+  EXPECT_EQ(sink.crcs.at(1), 0xa5d2497b8a780d52ull);
+}
+
+class ArraySink : public qbinarizer::DecodeSink {
+public:
+  QVector<qint16> values;
+
+  void onArray(int, const qbinarizer::PrimitiveArray &array) override {
+    values = array.toVector<qint16>();
+  }
+};
+
+TEST_F(BinarizerTest, NestedCrcDecodeTest) {
+  // c1 covers p only, c2 covers everything before it including c1 and c3
+  // starts inside p, so the running regions overlap
+  const qbinarizer::CompiledSchema schema(getList(
+      R"([{"h": {"type": "uint16"}}, {"p": {"type": "struct", "spec": [{"x":
+        {"type": "raw", "size": 40}}, {"c1": {"type": "crc32", "parent":
+        "p"}}]}}, {"c2": {"type": "crc32"}}, {"c3": {"type": "crc64", "from":
+        10}}])"));
+
+  QByteArray frame;
+  for (int i = 0; i < 58; i++) {
+    frame.append(static_cast<char>(i * 7));
+  }
+
+  CrcSink sink;
+  decoder.decode(schema, frame, sink);
+
+  ASSERT_EQ(sink.crcs.size(), 3);
+  EXPECT_EQ(sink.crcs.at(0), qbinarizer::crc32(frame.constData() + 2, 40));
+  EXPECT_EQ(sink.crcs.at(1), qbinarizer::crc32(frame.constData(), 46));
+  EXPECT_EQ(sink.crcs.at(2), qbinarizer::crc64We(frame.constData() + 10, 40));
+}
+
+TEST_F(BinarizerTest, ArrayDecodeTest) {
+  const qbinarizer::CompiledSchema schema(getList(
+      R"([{"a": {"type": "int16", "endian": "big", "count": 3}}])"));
+  const QByteArray frame = QByteArray::fromHex("0001fffe0100");
+
+  ArraySink sink;
+  decoder.decode(schema, frame, sink);
+  EXPECT_EQ(sink.values, QVector<qint16>({1, -2, 256}));
+
+  const QVariantList resList = decoder.decode(schema, frame);
+  EXPECT_TRUE(compareVariants(resList, getList(R"([{"a": [1, -2, 256]}])")));
+}
+
+TEST_F(BinarizerTest, SchemaCacheTest) {
+  qbinarizer::SchemaCache cache(1);
+  const QString schemaA = R"([{"a": {"type": "int8"}}])";
+  const QString schemaB = R"([{"b": {"type": "int16"}}])";
+
+  EXPECT_EQ(cache.compiled(schemaA).size(), 1);
+  EXPECT_EQ(cache.parsed(schemaA).size(), 1);
+  EXPECT_EQ(cache.hits(), 1u);
+  EXPECT_EQ(cache.misses(), 1u);
+
+  cache.compiled(schemaB);
+  cache.compiled(schemaA);
+  EXPECT_EQ(cache.misses(), 3u);
+}
+
+TEST_F(BinarizerTest, LayoutTest) {
+  using Layout = qbinarizer::CompiledSchema::Layout;
+
+  const qbinarizer::CompiledSchema fixed(
+      getList(R"([{"a": {"type": "int16"}}, {"s": {"type": "struct", "spec":
+        [{"b": {"type": "int8", "count": 3}}, {"c": {"type": "double"}}]}}])"));
+  EXPECT_EQ(fixed.layout(), Layout::Fixed);
+  EXPECT_EQ(fixed.minSize(), 13);
+  EXPECT_EQ(fixed.maxSize(), 13);
+  EXPECT_EQ(fixed.offsetOf(fixed.indexOf("c")), 5);
+
+  const qbinarizer::CompiledSchema prefix(getList(
+      R"([{"l": {"type": "int8"}}, {"a": {"type": "int32", "count": "l"}}])"));
+  EXPECT_EQ(prefix.layout(), Layout::FixedPrefix);
+  EXPECT_EQ(prefix.fixedPrefixSize(), 1);
+  EXPECT_EQ(prefix.minSize(), 1);
+  EXPECT_EQ(prefix.maxSize(), -1);
+  EXPECT_EQ(prefix.offsetOf(prefix.indexOf("a")), -1);
+}
+
+TEST_F(BinarizerTest, MessageViewTest) {
+  const qbinarizer::CompiledSchema schema(getList(
+      R"([{"l": {"type": "int8"}}, {"a": {"type": "int16", "count": "l"}},
+        {"v": {"type": "int8"}}, {"c": {"type": "custom", "choose": {"b": 1,
+        "d": 2}, "depend": "v", "spec": {"b": {"type": "int8"}, "d":
+        {"type": "uint32", "endian": "big"}}}}])"));
+  const QByteArray frame = QByteArray::fromHex("020100feff0200000102");
+
+  qbinarizer::MessageView view(schema, frame);
+  EXPECT_EQ(view.toUInt("d"), 0x102u);
+  EXPECT_FALSE(view.contains("b"));
+  EXPECT_EQ(view.count("a"), 2);
+  EXPECT_EQ(view.toInt("a", 1), -2);
+  EXPECT_EQ(view.offset("v"), 5);
+}
+
+TEST_F(BinarizerTest, BatchDecodeTest) {
+  const qbinarizer::CompiledSchema schema(getList(
+      R"([{"v": {"type": "int8"}}, {"a": {"type": "custom", "choose": {"b":
+        1, "c": 2}, "depend": "v", "spec": {"b": {"type": "int8"}, "c":
+        {"type": "int8"}}}}])"));
+
+  qbinarizer::BatchDecoder batch(schema);
+  batch.decode(QVector<QByteArray>{QByteArray::fromHex("0201"),
+                                   QByteArray::fromHex("0103")});
+  ASSERT_EQ(batch.rowCount(), 2);
+
+  const qbinarizer::BatchColumn *v = batch.column("v");
+  ASSERT_NE(v, nullptr);
+  EXPECT_EQ(v->int32Values, std::vector<qint32>({2, 1}));
+
+  const qbinarizer::BatchColumn *c = batch.column("a.c");
+  ASSERT_NE(c, nullptr);
+  EXPECT_TRUE(c->isValid(0));
+  EXPECT_FALSE(c->isValid(1));
+  EXPECT_EQ(c->int32Values, std::vector<qint32>({1, 0}));
+
+  const qbinarizer::BatchColumn *b = batch.column("a.b");
+  ASSERT_NE(b, nullptr);
+  EXPECT_FALSE(b->isValid(0));
+  EXPECT_EQ(b->int32Values, std::vector<qint32>({0, 3}));
+}
+
+TEST_F(BinarizerTest, BatchDecodeArrayTest) {
+  const qbinarizer::CompiledSchema schema(getList(
+      R"([{"l": {"type": "uint8"}}, {"a": {"type": "int16", "endian": "big",
+        "count": "l"}}, {"d": {"type": "uint32", "count": 2}}])"));
+
+  qbinarizer::BatchDecoder batch(schema);
+  batch.decode(QVector<QByteArray>{
+      QByteArray::fromHex("020001fffe0100000002000000"),
+      QByteArray::fromHex("010005ffffffff03000000")});
+  ASSERT_EQ(batch.rowCount(), 2);
+
+  const qbinarizer::BatchColumn *a = batch.column("a");
+  ASSERT_NE(a, nullptr);
+  EXPECT_TRUE(a->isList);
+  EXPECT_EQ(a->int32Values, std::vector<qint32>({1, -2, 5}));
+  EXPECT_EQ(a->offsets, std::vector<qint32>({0, 2, 3}));
+
+  const qbinarizer::BatchColumn *d = batch.column("d");
+  ASSERT_NE(d, nullptr);
+  EXPECT_EQ(d->int64Values,
+            std::vector<qint64>({1, 2, Q_INT64_C(0xffffffff), 3}));
+  EXPECT_EQ(d->offsets, std::vector<qint32>({0, 2, 4}));
+}
+
+TEST_F(BinarizerTest, BatchDecodeRepeatedNameTest) {
+  const qbinarizer::CompiledSchema schema(
+      getList(R"([{"a": {"type": "int8"}}, {"a": {"type": "uint16"}}])"));
+
+  qbinarizer::BatchDecoder batch(schema);
+  batch.decode(QVector<QByteArray>{QByteArray::fromHex("ff0100"),
+                                   QByteArray::fromHex("020300")});
+  ASSERT_EQ(batch.rowCount(), 2);
+  EXPECT_EQ(batch.columnNames(), QStringList({"a", "a#2"}));
+
+  const qbinarizer::BatchColumn *a = batch.column("a");
+  ASSERT_NE(a, nullptr);
+  EXPECT_FALSE(a->isList);
+  EXPECT_EQ(a->int32Values, std::vector<qint32>({-1, 2}));
+
+  const qbinarizer::BatchColumn *a2 = batch.column("a#2");
+  ASSERT_NE(a2, nullptr);
+  EXPECT_EQ(a2->int32Values, std::vector<qint32>({1, 3}));
+  EXPECT_TRUE(a2->isValid(1));
+}
+
+TEST_F(BinarizerTest, ParallelBatchDecodeTest) {
+  const qbinarizer::CompiledSchema schema(getList(
+      R"([{"l": {"type": "int8"}}, {"a": {"type": "int32", "count": "l"}}])"));
+
+  QVector<QByteArray> frames;
+  QVector<QVariantList> expected;
+  for (int i = 0; i < 1000; i++) {
+    const int count = i % 17 + 2;
+
+    QByteArray frame(1, static_cast<char>(count));
+    QVariantList values;
+    for (int j = 0; j < count; j++) {
+      const qint32 value = i * 100 + j;
+      frame.append(reinterpret_cast<const char *>(&value), sizeof(value));
+      values.push_back(value);
+    }
+
+    frames.push_back(frame);
+    expected.push_back(decoder.decode(schema, frame));
+  }
+
+  const QVector<QVariantList> resList =
+      qbinarizer::BatchDecoder::decodeBatch(schema, frames);
+  ASSERT_EQ(resList.size(), expected.size());
+  for (int i = 0; i < resList.size(); i++) {
+    EXPECT_TRUE(compareVariants(expected.at(i), resList.at(i)));
+  }
+}
+
+TEST_F(BinarizerTest, BatchEncodeTest) {
+  const qbinarizer::CompiledSchema schema(getList(
+      R"([{"a": {"type": "uint16", "endian": "big"}}, {"b": {"type":
+        "int8"}}])"));
+  const qbinarizer::CompiledSchema large(
+      getList(R"([{"s": {"type": "skip", "size": 300}}])"));
+
+  qbinarizer::BatchEncoder batch;
+  batch.setSyncWord(QByteArray::fromHex("aa55"));
+  batch.setLengthPrefix(qbinarizer::BatchEncoder::LengthPrefix::UInt8);
+
+  EXPECT_EQ(batch.append(schema, getList(R"([{"a": 1}, {"b": -1}])")), 6);
+  EXPECT_EQ(batch.append(large), -1);
+  EXPECT_EQ(batch.append(schema, getList(R"([{"a": 515}, {"b": 2}])")), 6);
+
+  EXPECT_EQ(batch.messageCount(), 2);
+  EXPECT_EQ(batch.data().toHex(), "aa55030001ffaa5503020302");
+  EXPECT_EQ(batch.offsets(), std::vector<qsizetype>({0, 6, 12}));
+  EXPECT_EQ(batch.message(1).toHex(), "020302");
+
+  batch.clear();
+  EXPECT_EQ(batch.messageCount(), 0);
+  EXPECT_TRUE(batch.data().isEmpty());
+}
+
+TEST_F(BinarizerTest, GeneratedCodecTest) {
+  gen::GenFrame frame;
+  frame.id = 0x1234;
+  frame.temp = -5;
+  frame.flags.mode = 5;
+  frame.flags.level = -3;
+  frame.flags.tail = 0xab;
+  frame.point.x = 1.5f;
+  frame.point.y = -2.25;
+  frame.tag = {1, 2, 3};
+  frame.n = 3;
+  frame.samples = {1, -2, 3};
+
+  const qbinarizer::CompiledSchema schema(getList(gen::genFrameSchema));
+  const QVariantList valueList = getList(
+      R"([{"id": 4660}, {"temp": -5}, {"flags": {"mode": 5, "level": -3,
+        "tail": 171}}, {"point": {"x": 1.5, "y": -2.25}}, {"tag": "010203"},
+        {"n": 3}, {"samples": [1, -2, 3]}])");
+
+  const QByteArray data = gen::encode(frame);
+  EXPECT_EQ(data, std::get<0>(encoder.encode(schema, valueList)));
+  EXPECT_EQ(gen::encodedSize(frame), data.size());
+
+  gen::GenFrame decoded;
+  ASSERT_EQ(gen::decode(data, decoded), data.size());
+  EXPECT_EQ(decoded.id, 0x1234);
+  EXPECT_EQ(decoded.temp, -5);
+  EXPECT_EQ(decoded.flags.level, -3);
+  EXPECT_EQ(decoded.flags.tail, 0xabu);
+  EXPECT_EQ(decoded.point.y, -2.25);
+  EXPECT_EQ(decoded.samples, std::vector<qint16>({1, -2, 3}));
+  EXPECT_EQ(decoded.crc, qbinarizer::crc32(data.constData(), data.size() - 4));
+
+  EXPECT_EQ(gen::decode(data.left(10), decoded), -1);
+  char small[10];
+  EXPECT_EQ(gen::encode(frame, small, sizeof(small)), -1);
+}
+
+namespace plot {
+QBINARIZER_NAME(sync);
+QBINARIZER_NAME(trk);
+QBINARIZER_NAME(flags);
+QBINARIZER_NAME(mode);
+QBINARIZER_NAME(level);
+QBINARIZER_NAME(pos);
+QBINARIZER_NAME(x);
+QBINARIZER_NAME(y);
+QBINARIZER_NAME(range);
+QBINARIZER_NAME(crc);
+
+using namespace qbinarizer;
+using Pos = Struct<Field<x, Int24>, Field<y, float, BigEndian>>;
+using Plot =
+    Struct<Const<sync, 0xaa, 0x55>, Field<trk, quint16, BigEndian>,
+           Bitfield<flags, 1, Bits<mode, 0, 3>, Bits<level, 3, 5, true>>,
+           Field<pos, Pos>, Array<range, quint8, 2>, Crc32<crc, BigEndian>>;
+} // namespace plot
+
+TEST_F(BinarizerTest, StaticSchemaTest) {
+  using plot::Plot;
+
+  Plot::Value value;
+  value.get<plot::trk>() = 300;
+  value.get<plot::flags>() = {5, -3};
+  value.get<plot::pos>().get<plot::x>() = -2;
+  value.get<plot::pos>().get<plot::y>() = 0.5f;
+  value.get<plot::range>() = {7, 9};
+
+  EXPECT_EQ(Plot::size, 18);
+  EXPECT_EQ(Plot::indexOf<plot::crc>(), 5u);
+
+  const QByteArray data = Plot::encode(value);
+  const qbinarizer::CompiledSchema schema(Plot::description());
+  const QVariantList valueList = getList(
+      R"([{"trk": 300}, {"flags": {"mode": 5, "level": -3}}, {"pos": {"x": -2,
+        "y": 0.5}}, {"range": [7, 9]}])");
+  EXPECT_EQ(data, std::get<0>(encoder.encode(schema, valueList)));
+  EXPECT_EQ(qbinarizer::CompiledSchema::compile(Plot::toJson()).size(),
+            schema.size());
+
+  Plot::Value decoded;
+  ASSERT_EQ(Plot::decode(data, decoded), Plot::size);
+  EXPECT_TRUE(decoded.get<plot::sync>());
+  EXPECT_EQ(decoded.get<plot::trk>(), 300);
+  EXPECT_EQ(std::get<1>(decoded.get<plot::flags>()), -3);
+  EXPECT_EQ(decoded.get<plot::pos>().get<plot::x>(), -2);
+  EXPECT_EQ(decoded.get<plot::range>()[1], 9);
+  EXPECT_EQ(decoded.get<plot::crc>(),
+            qbinarizer::crc32(data.constData(), data.size() - 4));
+
+  EXPECT_EQ(Plot::decode(data.left(16), decoded), -1);
+}
+
+TEST_F(BinarizerTest, ReflectorPlanTest) {
+  using qbinarizer::StructReflector;
+
+  qRegisterMetaType<TestGadgetChild>();
+
+  const StructReflector::GadgetPlan &plan =
+      StructReflector::plan(&TestGadget::staticMetaObject);
+  EXPECT_EQ(&plan, &StructReflector::plan(&TestGadget::staticMetaObject));
+  ASSERT_EQ(plan.fields.size(), 4);
+  EXPECT_EQ(plan.size, 15);
+  EXPECT_EQ(plan.fields.at(2).nested,
+            &StructReflector::plan(&TestGadgetChild::staticMetaObject));
+
+  EXPECT_EQ(StructReflector::createFieldSpecStr(&TestGadget::staticMetaObject),
+            R"({"a":{"type":"uint16"}},{"c":{"type":"int32"}},)"
+            R"({"child":{"spec":[{"b":{"type":"uint8"}}],"type":"struct"}},)"
+            R"({"d":{"type":"double"}})");
+
+  TestGadget gadget;
+  const QVariantMap valueMap{
+      {"a", 7}, {"c", -2}, {"child", QVariantMap{{"b", 9}}}, {"d", 0.5}};
+  EXPECT_EQ(StructReflector::setValuesString(&gadget, valueMap), 15);
+  EXPECT_EQ(gadget.c, -2);
+  EXPECT_EQ(gadget.child.b, 9);
+
+  const StructReflector::StructInfo info =
+      StructReflector::getValuesInfo(TestGadget::staticMetaObject, &gadget);
+  EXPECT_EQ(info.size, 15);
+  EXPECT_TRUE(compareVariants(info.valueMap, valueMap));
+}
+
+TEST_F(BinarizerTest, SignedCharGadgetTest) {
+  using qbinarizer::StructReflector;
+
+  // signed char members are int8, the baseline described them as uint8
+  EXPECT_EQ(
+      StructReflector::createFieldSpecStr(&TestSignedGadget::staticMetaObject),
+      R"({"s":{"type":"int8"}})");
+
+  TestSignedGadget gadget;
+  gadget.s = -3;
+  const QByteArray data = StructReflector::encodeGadget(gadget);
+  EXPECT_EQ(data.toHex(), "fd");
+
+  TestSignedGadget decoded;
+  EXPECT_EQ(StructReflector::decodeGadget(data, decoded), 1);
+  EXPECT_EQ(decoded.s, -3);
+}
+
+TEST_F(BinarizerTest, GadgetCodecTest) {
+  using qbinarizer::StructReflector;
+
+  qRegisterMetaType<TestGadgetChild>();
+
+  TestGadget gadget;
+  gadget.a = 7;
+  gadget.c = -2;
+  gadget.child.b = 9;
+  gadget.d = 0.5;
+
+  const QByteArray data = StructReflector::encodeGadget(gadget);
+  EXPECT_EQ(data.toHex(), "0700feffffff09000000000000e03f");
+
+  const qbinarizer::CompiledSchema schema(
+      StructReflector::createFieldSpecList(&TestGadget::staticMetaObject));
+  const QVariantList valueList = getList(
+      R"([{"a": 7}, {"c": -2}, {"child": {"b": 9}}, {"d": 0.5}])");
+  EXPECT_EQ(data, std::get<0>(encoder.encode(schema, valueList)));
+
+  TestGadget decoded;
+  EXPECT_EQ(StructReflector::decodeGadget(data.left(14), decoded), -1);
+  EXPECT_EQ(decoded.a, 0);
+
+  ASSERT_EQ(StructReflector::decodeGadget(data, decoded), 15);
+  EXPECT_EQ(decoded.a, 7);
+  EXPECT_EQ(decoded.c, -2);
+  EXPECT_EQ(decoded.child.b, 9);
+  EXPECT_EQ(decoded.d, 0.5);
+}
+
+TEST_F(BinarizerTest, WireLayoutTest) {
+  using qbinarizer::StructReflector;
+
+  qRegisterMetaType<TestGadgetChild>();
+
+  EXPECT_FALSE(StructReflector::hasWireLayout<TestGadget>());
+#if Q_BYTE_ORDER == Q_LITTLE_ENDIAN
+  EXPECT_TRUE(StructReflector::hasWireLayout<TestRecord>());
+#endif
+
+  TestRecord records[2];
+  records[0].id = 1;
+  records[0].value = 0.5f;
+  records[0].time = -1;
+  records[1].id = 2;
+  records[1].value = 2.0f;
+  records[1].time = 1000;
+
+  const qbinarizer::CompiledSchema schema(
+      StructReflector::createFieldSpecList(&TestRecord::staticMetaObject));
+  const QByteArray data = StructReflector::encodeGadgets(records, 2);
+  EXPECT_EQ(data,
+            std::get<0>(encoder.encode(
+                schema, getList(R"([{"id": 1}, {"value": 0.5}, {"time":
+                  -1}])"))) +
+                std::get<0>(encoder.encode(
+                    schema, getList(R"([{"id": 2}, {"value": 2.0}, {"time":
+                      1000}])"))));
+
+  TestRecord decoded[2];
+  EXPECT_EQ(StructReflector::decodeGadgets(data.constData(), 31, decoded, 2),
+            -1);
+  ASSERT_EQ(StructReflector::decodeGadgets(data.constData(), data.size(),
+                                           decoded, 2),
+            32);
+  EXPECT_EQ(decoded[1].id, 2);
+  EXPECT_EQ(decoded[1].value, 2.0f);
+  EXPECT_EQ(decoded[1].time, 1000);
+  EXPECT_EQ(StructReflector::encodeGadget(decoded[0]), data.left(16));
+}
+
+TEST_F(BinarizerTest, FormulaTest) {
+  using CompiledSchema = qbinarizer::CompiledSchema;
+
+  const CompiledSchema schema(getList(
+      R"([{"len": {"type": "uint8"}}, {"a": {"type": "int16", "endian":
+        "big", "count": "len / 2"}}, {"pad": {"type": "skip", "size":
+        "len % 2"}}, {"sum": {"type": "uint8", "pos": "len + 1", "expr":
+        "len * 2"}}])"));
+  EXPECT_EQ(schema.layout(), CompiledSchema::Layout::FixedPrefix);
+  EXPECT_EQ(schema.at(schema.indexOf("a")).countRef, CompiledSchema::NoRef);
+
+  const QByteArray frame = QByteArray::fromHex("050001fffe000a");
+  const QVariantList resList = decoder.decode(schema, frame);
+  ASSERT_EQ(resList.size(), 4);
+  EXPECT_TRUE(compareVariants(resList.at(1).toMap().value("a"),
+                              QVariantList({1, -2})));
+  EXPECT_EQ(resList.at(3).toMap().value("sum").toInt(), 10);
+
+  qbinarizer::MessageView view(schema, frame);
+  EXPECT_EQ(view.count("a"), 2);
+  EXPECT_EQ(view.offset("sum"), 6);
+
+  const auto res =
+      encoder.encode(schema, getList(R"([{"len": 5}, {"a": [1, -2]}])"));
+  EXPECT_EQ(std::get<0>(res), frame);
+
+  const auto resolver = [](const QString &name) {
+    return (name == "x") ? 0 : -1;
+  };
+  const qbinarizer::Expression expr =
+      qbinarizer::Expression::compile("max(x, 2) ^ 2 - -1 + 2 * 3", resolver);
+  ASSERT_TRUE(expr.isValid());
+  EXPECT_EQ(expr.code().size(), 9);
+
+  qbinarizer::FieldSlot x;
+  double value = 0.0;
+  EXPECT_FALSE(expr.eval(&x, value));
+
+  x.from = 0;
+  x.setInt(3);
+  ASSERT_TRUE(expr.eval(&x, value));
+  EXPECT_EQ(value, 16.0);
+  EXPECT_FALSE(qbinarizer::Expression::compile("y + 1", resolver).isValid());
+
+  const CompiledSchema typo(getList(R"([{"n": {"type": "uint8"}}, {"s":
+    {"type": "skip", "size": "n +"}}])"));
+  EXPECT_EQ(typo.at(1).opcode, CompiledSchema::Opcode::None);
+
+  // A bad count formula drops the field as size does, a name declared later
+  // stays an unresolved reference
+  const CompiledSchema counts(getList(R"([{"n": {"type": "uint8"}}, {"a":
+    {"type": "uint8", "count": "n *"}}, {"b": {"type": "uint8", "count":
+    "later"}}, {"later": {"type": "uint8"}}])"));
+  EXPECT_EQ(counts.at(1).opcode, CompiledSchema::Opcode::None);
+  EXPECT_EQ(counts.at(2).opcode, CompiledSchema::Opcode::UInt8);
+  EXPECT_EQ(counts.at(2).countRef, CompiledSchema::UnresolvedRef);
+  EXPECT_EQ(counts.at(2).countExpr, CompiledSchema::NoRef);
+}
+
 // TEST_F(BinarizerTest, EncodeTest) {
 //   for (const auto &check : checkList) {
 //     const QVariantMap testObj = getObj(check.jsonStr);
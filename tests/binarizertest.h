@@ -2,8 +2,83 @@
 #define BINARIZERTEST_H
 
 #include <gtest/gtest.h>
+#include <qbinarizer/BatchDecoder>
+#include <qbinarizer/BatchEncoder>
+#include <qbinarizer/CompiledSchema>
+#include <qbinarizer/EncodeValues>
+#include <qbinarizer/Expression>
+#include <qbinarizer/MessageView>
+#include <qbinarizer/SchemaCache>
+#include <qbinarizer/StaticSchema>
 #include <qbinarizer/StructDecoder>
 #include <qbinarizer/StructEncoder>
+#include <qbinarizer/StructReflector>
+
+#include <QObject>
+
+struct TestGadgetChild {
+  Q_GADGET
+
+  Q_PROPERTY(quint8 b MEMBER b)
+
+public:
+  quint8 b;
+
+  TestGadgetChild() : b(0) {}
+};
+Q_DECLARE_METATYPE(TestGadgetChild)
+
+// Written by MEMBER properties of TestGadget
+inline bool operator!=(const TestGadgetChild &child1,
+                       const TestGadgetChild &child2) {
+  return child1.b != child2.b;
+}
+
+struct TestGadget {
+  Q_GADGET
+
+  Q_PROPERTY(quint16 a MEMBER a)
+  Q_PROPERTY(qint32 c MEMBER c)
+  Q_PROPERTY(TestGadgetChild child MEMBER child)
+  Q_PROPERTY(double d MEMBER d)
+
+public:
+  quint16 a;
+  qint32 c;
+  TestGadgetChild child;
+  double d;
+
+  TestGadget() : a(0), c(0), d(0) {}
+};
+Q_DECLARE_METATYPE(TestGadget)
+
+struct TestRecord {
+  Q_GADGET
+
+  Q_PROPERTY(qint32 id MEMBER id)
+  Q_PROPERTY(float value MEMBER value)
+  Q_PROPERTY(qint64 time MEMBER time)
+
+public:
+  qint32 id;
+  float value;
+  qint64 time;
+
+  TestRecord() : id(0), value(0), time(0) {}
+};
+Q_DECLARE_METATYPE(TestRecord)
+
+struct TestSignedGadget {
+  Q_GADGET
+
+  Q_PROPERTY(qint8 s MEMBER s)
+
+public:
+  qint8 s;
+
+  TestSignedGadget() : s(0) {}
+};
+Q_DECLARE_METATYPE(TestSignedGadget)
 
 // The fixture for testing class Foo.
 class BinarizerTest : public ::testing::Test {
@@ -0,0 +1,891 @@
+#include "codegenerator.h"
+
+#include <algorithm>
+
+namespace qbinarizer {
+
+namespace {
+
+using Opcode = CompiledSchema::Opcode;
+
+const QSet<QString> &keywords() {
+  static const QSet<QString> keywords = {
+      "alignas",   "alignof",      "and",         "and_eq",
+      "asm",       "auto",         "bitand",      "bitor",
+      "bool",      "break",        "case",        "catch",
+      "char",      "char16_t",     "char32_t",    "class",
+      "compl",     "const",        "constexpr",   "const_cast",
+      "continue",  "decltype",     "default",     "delete",
+      "do",        "double",       "dynamic_cast", "else",
+      "enum",      "explicit",     "export",      "extern",
+      "false",     "float",        "for",         "friend",
+      "goto",      "if",           "inline",      "int",
+      "long",      "mutable",      "namespace",   "new",
+      "noexcept",  "not",          "not_eq",      "nullptr",
+      "operator",  "or",           "or_eq",       "private",
+      "protected", "public",       "register",    "reinterpret_cast",
+      "return",    "short",        "signed",      "sizeof",
+      "static",    "static_assert", "static_cast", "struct",
+      "switch",    "template",     "this",        "thread_local",
+      "throw",     "true",         "try",         "typedef",
+      "typeid",    "typename",     "union",       "unsigned",
+      "using",     "virtual",      "void",        "volatile",
+      "wchar_t",   "while",        "xor",         "xor_eq"};
+
+  return keywords;
+}
+
+QString uniqueName(const QString &name, QSet<QString> &used) {
+  QString res = name;
+  for (int i = 2; used.contains(res); i++) {
+    res = name + QString::number(i);
+  }
+  used.insert(res);
+
+  return res;
+}
+
+QString offsetExpr(const QString &base, qint64 offset) {
+  if (offset == 0) {
+    return base;
+  }
+
+  return QString("%1 + %2").arg(base).arg(offset);
+}
+
+QString boolLiteral(bool value) { return value ? "true" : "false"; }
+
+} // namespace
+
+CodeGenerator::CodeGenerator(const QVariantList &datafieldList)
+    : m_schema(datafieldList), m_dynamic(false), m_depth(0) {}
+
+void CodeGenerator::setSourceName(const QString &sourceName) {
+  m_sourceName = sourceName;
+}
+
+void CodeGenerator::setTypeName(const QString &typeName) {
+  m_typeName = typeName;
+}
+
+void CodeGenerator::setNamespace(const QString &nameSpace) {
+  m_namespace = nameSpace;
+}
+
+void CodeGenerator::setSchemaJson(const QByteArray &schemaJson) {
+  m_schemaJson = schemaJson;
+}
+
+QString CodeGenerator::generate() {
+  m_out.clear();
+  m_error.clear();
+  m_starts.clear();
+  m_depth = 0;
+
+  m_members = QStringList();
+  m_types = QStringList();
+  m_access = QStringList();
+  for (int i = 0; i < m_schema.size(); i++) {
+    m_members.push_back(QString());
+    m_types.push_back(QString());
+    m_access.push_back(QString());
+  }
+
+  if (identifier(m_typeName) != m_typeName) {
+    m_error = QString("\"%1\" is not a valid type name").arg(m_typeName);
+    return QString();
+  }
+
+  assignNames(0, m_schema.size(), "value", false);
+  if (!checkSchema()) {
+    return QString();
+  }
+
+  const QString guard =
+      QString("QBINARIZER_GEN_%1_H").arg(identifier(m_typeName).toUpper());
+  QString schemaName = m_typeName;
+  schemaName[0] = schemaName[0].toLower();
+
+  line(0, QString("// Generated by qbinarizer-gen from %1. Do not edit")
+              .arg(m_sourceName));
+  line(0, "#ifndef " + guard);
+  line(0, "#define " + guard);
+  line(0);
+  line(0, "#include <QByteArray>");
+  line(0);
+  line(0, "#include <array>");
+  line(0, "#include <cstring>");
+  line(0, "#include <vector>");
+  line(0);
+  line(0, "#include \"qbinarizer/internal/bytecursor.h\"");
+  line(0, "#include \"qbinarizer/internal/crcutils.h\"");
+  line(0);
+
+  if (!m_namespace.isEmpty()) {
+    line(0, QString("namespace %1 {").arg(m_namespace));
+    line(0);
+  }
+
+  line(0, QString("inline constexpr char %1Schema[] = R\"qbinarizer(%2)"
+                  "qbinarizer\";")
+              .arg(schemaName, QString::fromUtf8(m_schemaJson)));
+  line(0);
+
+  emitType(m_typeName, 0, m_schema.size(), 0);
+  line(0);
+
+  emitFunction(Mode::Size);
+  line(0);
+  emitFunction(Mode::Encode);
+  line(0);
+  emitFunction(Mode::Decode);
+  line(0);
+
+  line(0, QString("inline QByteArray encode(const %1 &value) {")
+              .arg(m_typeName));
+  line(1, "QByteArray data(encodedSize(value), Qt::Uninitialized);");
+  line(1, "encode(value, data.data(), data.size());");
+  line(0);
+  line(1, "return data;");
+  line(0, "}");
+  line(0);
+  line(0, QString("inline qsizetype decode(const QByteArray &data, %1 &value) "
+                  "{")
+              .arg(m_typeName));
+  line(1, "return decode(data.constData(), data.size(), value);");
+  line(0, "}");
+  line(0);
+
+  if (!m_namespace.isEmpty()) {
+    line(0, QString("} // namespace %1").arg(m_namespace));
+    line(0);
+  }
+
+  line(0, "#endif // " + guard);
+
+  return m_out;
+}
+
+QString CodeGenerator::errorString() const { return m_error; }
+
+QString CodeGenerator::identifier(const QString &name) {
+  QString res;
+  for (const QChar ch : name) {
+    const bool valid = (ch.unicode() < 128) && (ch.isLetterOrNumber());
+    res.append(valid ? ch : QChar('_'));
+  }
+
+  if (res.isEmpty() || res.at(0).isDigit() || res.startsWith('_')) {
+    res.prepend("f");
+  }
+
+  if (keywords().contains(res)) {
+    res.append('_');
+  }
+
+  return res;
+}
+
+QString CodeGenerator::camelCase(const QString &name) {
+  QString res;
+  bool upper = true;
+  for (const QChar ch : identifier(name)) {
+    if (ch == '_') {
+      upper = true;
+      continue;
+    }
+
+    res.append(upper ? ch.toUpper() : ch);
+    upper = false;
+  }
+
+  return res;
+}
+
+void CodeGenerator::assignNames(int first, int end, const QString &access,
+                                bool counted) {
+  QSet<QString> used;
+
+  for (int i = first; i < end; i = m_schema.at(i).end) {
+    const CompiledSchema::Instruction &instr = m_schema.at(i);
+    if ((instr.opcode == Opcode::None) || (instr.opcode == Opcode::Const) ||
+        (instr.opcode == Opcode::Skip)) {
+      continue;
+    }
+
+    m_members[i] = uniqueName(identifier(instr.name), used);
+    if (!counted) {
+      m_access[i] = access + "." + m_members[i];
+    }
+
+    if ((instr.opcode != Opcode::Struct) &&
+        (instr.opcode != Opcode::Bitfield)) {
+      continue;
+    }
+
+    m_types[i] = uniqueName(camelCase(instr.name), used);
+
+    const bool elementCounted = counted || (instr.count > 1) ||
+                                (instr.countRef != CompiledSchema::NoRef);
+    assignNames(i + 1, instr.end, m_access[i], elementCounted);
+  }
+}
+
+bool CodeGenerator::checkSchema() {
+  for (int i = 0; i < m_schema.size(); i++) {
+    const CompiledSchema::Instruction &instr = m_schema.at(i);
+    const QString field = QString("field \"%1\": ").arg(instr.name);
+
+    switch (instr.opcode) {
+    case Opcode::Custom:
+      m_error = field + "custom fields are not supported";
+      return false;
+    case Opcode::Crc8:
+    case Opcode::Crc16:
+      m_error = field + "only crc32 and crc64 are supported";
+      return false;
+    case Opcode::Crc32:
+    case Opcode::Crc64:
+      if (instr.include || (instr.toRef != CompiledSchema::NoRef)) {
+        m_error = field + "crc \"include\" and \"to\" are not supported";
+        return false;
+      }
+
+      if (instr.parentRef >= 0) {
+        m_starts.insert(instr.parentRef);
+      }
+      break;
+    case Opcode::Bitfield:
+      if (instr.end == i + 1) {
+        m_error = field + "bitfield without elements";
+        return false;
+      }
+      break;
+    default:
+      break;
+    }
+
+    if ((instr.countExpr != CompiledSchema::NoRef) ||
+        (instr.sizeExpr != CompiledSchema::NoRef) ||
+        (instr.posExpr != CompiledSchema::NoRef)) {
+      m_error = field + "formula \"count\", \"size\" and \"pos\" are not "
+                        "supported";
+      return false;
+    }
+
+    if ((instr.opcode != Opcode::BitfieldElement) && (instr.pos >= 0)) {
+      m_error = field + "\"pos\" is not supported";
+      return false;
+    }
+
+    if (instr.countRef == CompiledSchema::NoRef) {
+      continue;
+    }
+
+    m_dynamic = true;
+
+    if ((instr.countRef < 0) ||
+        !isNumber(m_schema.at(instr.countRef).opcode) ||
+        (m_schema.at(instr.countRef).count > 1) ||
+        (m_schema.at(instr.countRef).countRef != CompiledSchema::NoRef) ||
+        m_access.at(instr.countRef).isEmpty()) {
+      m_error = field + "count must name a number declared before outside "
+                        "of counted fields";
+      return false;
+    }
+  }
+
+  return true;
+}
+
+void CodeGenerator::emitType(const QString &typeName, int first, int end,
+                             int indent) {
+  line(indent, QString("struct %1 {").arg(typeName));
+
+  bool nested = false;
+  for (int i = first; i < end; i = m_schema.at(i).end) {
+    if (m_types.at(i).isEmpty()) {
+      continue;
+    }
+
+    emitType(m_types.at(i), i + 1, m_schema.at(i).end, indent + 1);
+    nested = true;
+  }
+
+  bool members = false;
+  for (int i = first; i < end; i = m_schema.at(i).end) {
+    if (m_members.at(i).isEmpty()) {
+      continue;
+    }
+
+    if (nested && !members) {
+      line(0);
+    }
+
+    line(indent + 1, memberDeclaration(i));
+    members = true;
+  }
+
+  line(indent, "};");
+}
+
+void CodeGenerator::emitFunction(Mode mode) {
+  switch (mode) {
+  case Mode::Size:
+    line(0, QString("inline qsizetype encodedSize(const %1 &value) {")
+                .arg(m_typeName));
+    if (!m_dynamic) {
+      line(1, "Q_UNUSED(value);");
+      line(0);
+    }
+    break;
+  case Mode::Encode:
+    line(0, QString("inline qsizetype encode(const %1 &value, char *data, "
+                    "qsizetype size) {")
+                .arg(m_typeName));
+    break;
+  case Mode::Decode:
+    line(0, QString("inline qsizetype decode(const char *data, qsizetype "
+                    "size, %1 &value) {")
+                .arg(m_typeName));
+    break;
+  }
+
+  line(1, "qsizetype pos = 0;");
+  if (mode != Mode::Size) {
+    QList<int> starts = m_starts.values();
+    std::sort(starts.begin(), starts.end());
+    for (const int start : qAsConst(starts)) {
+      line(1, QString("qsizetype start%1 = -1;").arg(start));
+    }
+  }
+  line(0);
+
+  emitList(mode, 0, m_schema.size(), "value", 1);
+
+  line(0);
+  line(1, "return pos;");
+  line(0, "}");
+}
+
+void CodeGenerator::emitList(Mode mode, int first, int end,
+                             const QString &owner, int indent) {
+  for (int i = first; i < end;) {
+    if (fieldSize(i) < 0) {
+      emitDynamicField(mode, i, owner, indent);
+
+      i = m_schema.at(i).end;
+      continue;
+    }
+
+    qint64 runSize = 0;
+    int runEnd = i;
+    while ((runEnd < end) && (fieldSize(runEnd) >= 0)) {
+      runSize += fieldSize(runEnd);
+      runEnd = m_schema.at(runEnd).end;
+    }
+
+    if (runSize == 0) {
+      i = runEnd;
+      continue;
+    }
+
+    if (mode != Mode::Size) {
+      line(indent, QString("if (size - pos < %1) {").arg(runSize));
+      line(indent + 1, "return -1;");
+      line(indent, "}");
+
+      qint64 offset = 0;
+      for (int j = i; j < runEnd; j = m_schema.at(j).end) {
+        emitFixedField(mode, j, owner, "pos", offset, indent);
+        offset += fieldSize(j);
+      }
+    }
+
+    line(indent, QString("pos += %1;").arg(runSize));
+
+    i = runEnd;
+  }
+}
+
+void CodeGenerator::emitFixedField(Mode mode, int index, const QString &owner,
+                                   const QString &base, qint64 offset,
+                                   int indent) {
+  const CompiledSchema::Instruction &instr = m_schema.at(index);
+  const QString member = m_members.at(index).isEmpty()
+                             ? QString()
+                             : owner + "." + m_members.at(index);
+
+  if (instr.count <= 1) {
+    emitFixedElement(mode, index, member, base, offset, indent);
+
+    return;
+  }
+
+  const QString i = QString("i%1").arg(m_depth++);
+  line(indent, QString("for (qsizetype %1 = 0; %1 < %2; %1++) {")
+                   .arg(i)
+                   .arg(instr.count));
+  emitFixedElement(mode, index, QString("%1[%2]").arg(member, i),
+                   QString("%1 + %2 * %3").arg(base, i).arg(elementSize(index)),
+                   offset, indent + 1);
+  line(indent, "}");
+  m_depth--;
+}
+
+void CodeGenerator::emitFixedElement(Mode mode, int index,
+                                     const QString &element,
+                                     const QString &base, qint64 offset,
+                                     int indent) {
+  const CompiledSchema::Instruction &instr = m_schema.at(index);
+  const QString pos = offsetExpr(base, offset);
+  const QString at = "data + " + pos;
+  const QString bigEndian = boolLiteral(instr.bigEndian);
+
+  emitStart(mode, index, pos, indent);
+
+  switch (instr.opcode) {
+  case Opcode::Int24:
+  case Opcode::UInt24:
+    if (mode == Mode::Encode) {
+      line(indent, QString("qbinarizer::storeUInt24(%1, static_cast<quint32>"
+                           "(%2), %3);")
+                       .arg(at, element, bigEndian));
+    } else if (instr.opcode == Opcode::Int24) {
+      line(indent, QString("%1 = static_cast<qint32>(qbinarizer::loadUInt24("
+                           "%2, %3) << 8) >> 8;")
+                       .arg(element, at, bigEndian));
+    } else {
+      line(indent, QString("%1 = qbinarizer::loadUInt24(%2, %3);")
+                       .arg(element, at, bigEndian));
+    }
+    break;
+  case Opcode::Int8:
+  case Opcode::UInt8:
+  case Opcode::Int16:
+  case Opcode::UInt16:
+  case Opcode::Int32:
+  case Opcode::UInt32:
+  case Opcode::Int64:
+  case Opcode::UInt64:
+  case Opcode::Float:
+  case Opcode::Double:
+  case Opcode::Unixtime:
+    if (mode == Mode::Encode) {
+      line(indent, QString("qbinarizer::storeValue<%1>(%2, %3, %4);")
+                       .arg(valueType(instr.opcode), at, element, bigEndian));
+    } else {
+      line(indent, QString("%1 = qbinarizer::loadValue<%2>(%3, %4);")
+                       .arg(element, valueType(instr.opcode), at, bigEndian));
+    }
+    break;
+  case Opcode::Const:
+    if (mode == Mode::Encode) {
+      QString bytes;
+      for (const char ch : instr.constData) {
+        const uint byte = static_cast<uchar>(ch);
+        bytes += QString("\\x%1").arg(byte, 2, 16, QChar('0'));
+      }
+
+      line(indent, QString("std::memcpy(%1, \"%2\", %3);")
+                       .arg(at, bytes)
+                       .arg(instr.size));
+    }
+    break;
+  case Opcode::Skip:
+    if (mode == Mode::Encode) {
+      line(indent, QString("std::memset(%1, 0, %2);").arg(at).arg(instr.size));
+    }
+    break;
+  case Opcode::Raw:
+    if (mode == Mode::Encode) {
+      line(indent, QString("std::memcpy(%1, %2.data(), %3);")
+                       .arg(at, element)
+                       .arg(instr.size));
+    } else {
+      line(indent, QString("std::memcpy(%1.data(), %2, %3);")
+                       .arg(element, at)
+                       .arg(instr.size));
+    }
+    break;
+  case Opcode::Crc32:
+  case Opcode::Crc64:
+    emitCrc(mode, index, element, pos, indent);
+    break;
+  case Opcode::Bitfield:
+    emitBitfield(mode, index, element, at, indent);
+    break;
+  case Opcode::Struct: {
+    qint64 childOffset = offset;
+    for (int i = index + 1; i < instr.end; i = m_schema.at(i).end) {
+      emitFixedField(mode, i, element, base, childOffset, indent);
+      childOffset += fieldSize(i);
+    }
+  } break;
+  default:
+    break;
+  }
+}
+
+void CodeGenerator::emitDynamicField(Mode mode, int index,
+                                     const QString &owner, int indent) {
+  const CompiledSchema::Instruction &instr = m_schema.at(index);
+  const QString member = owner + "." + m_members.at(index);
+  const int depth = m_depth++;
+  const QString i = QString("i%1").arg(depth);
+  const QString element = QString("e%1").arg(depth);
+
+  if (instr.countRef == CompiledSchema::NoRef) {
+    // Struct holding counted fields
+    if (instr.count <= 1) {
+      emitStart(mode, index, "pos", indent);
+      emitList(mode, index + 1, instr.end, member, indent);
+    } else {
+      line(indent, QString("for (qsizetype %1 = 0; %1 < %2; %1++) {")
+                       .arg(i)
+                       .arg(instr.count));
+      emitStart(mode, index, "pos", indent + 1);
+      emitList(mode, index + 1, instr.end, QString("%1[%2]").arg(member, i),
+               indent + 1);
+      line(indent, "}");
+    }
+
+    m_depth--;
+    return;
+  }
+
+  // As in StructEncoder/StructDecoder a count below 2 takes one element
+  const QString n = QString("n%1").arg(depth);
+  const qint64 size = elementSize(index);
+  const qint64 minSize = (size >= 0) ? size : minFieldSize(index);
+
+  line(indent, "{");
+  line(indent + 1,
+       QString("const qsizetype %1 = qMax<qsizetype>(static_cast<qsizetype>"
+               "(%2), 1);")
+           .arg(n, m_access.at(instr.countRef)));
+
+  if ((size >= 0) && (mode == Mode::Size)) {
+    line(indent + 1, QString("pos += %1 * %2;").arg(n).arg(size));
+    line(indent, "}");
+
+    m_depth--;
+    return;
+  }
+
+  if ((mode != Mode::Size) && (minSize > 0)) {
+    line(indent + 1,
+         QString("if ((size - pos) / %1 < %2) {").arg(minSize).arg(n));
+    line(indent + 2, "return -1;");
+    line(indent + 1, "}");
+  }
+
+  const QString type = elementType(index);
+  if (mode == Mode::Decode) {
+    line(indent + 1, QString("%1.resize(%2);").arg(member, n));
+  } else {
+    line(indent + 1,
+         QString("static const %1 empty%2{};").arg(type).arg(depth));
+  }
+
+  line(indent + 1, QString("for (qsizetype %1 = 0; %1 < %2; %1++) {")
+                       .arg(i, n));
+  if (mode == Mode::Decode) {
+    line(indent + 2, QString("%1 &%2 = %3[%4];").arg(type, element, member, i));
+  } else {
+    line(indent + 2,
+         QString("const %1 &%2 = (%3 < static_cast<qsizetype>(%4.size())) ? "
+                 "%4[%3] : empty%5;")
+             .arg(type, element, i, member)
+             .arg(depth));
+  }
+
+  if (size >= 0) {
+    emitFixedElement(mode, index, element,
+                     QString("pos + %1 * %2").arg(i).arg(size), 0,
+                     indent + 2);
+  } else {
+    emitStart(mode, index, "pos", indent + 2);
+    emitList(mode, index + 1, instr.end, element, indent + 2);
+  }
+  line(indent + 1, "}");
+
+  if (size >= 0) {
+    line(indent + 1, QString("pos += %1 * %2;").arg(n).arg(size));
+  }
+  line(indent, "}");
+
+  m_depth--;
+}
+
+void CodeGenerator::emitBitfield(Mode mode, int index, const QString &element,
+                                 const QString &at, int indent) {
+  const CompiledSchema::Instruction &instr = m_schema.at(index);
+
+  // Zero padding for the 9-byte access of extractBits/insertBits
+  line(indent, "{");
+  line(indent + 1, QString("char bits[%1] = {};").arg(instr.size + 9));
+  if (mode == Mode::Decode) {
+    line(indent + 1,
+         QString("std::memcpy(bits, %1, %2);").arg(at).arg(instr.size));
+  }
+
+  for (int i = index + 1; i < instr.end; i++) {
+    const CompiledSchema::Instruction &bits = m_schema.at(i);
+    if ((bits.bitOffset < 0) || (bits.size <= 0) || (bits.size > 64)) {
+      continue;
+    }
+
+    const QString member = element + "." + m_members.at(i);
+    const QString args = QString("bits + %1, %2, %3, %4")
+                             .arg(bits.bitOffset)
+                             .arg(bits.bitShift)
+                             .arg(bits.size)
+                             .arg(boolLiteral(bits.reversed));
+    const quint64 mask = (bits.size >= 64) ? ~0ull : (1ull << bits.size) - 1;
+    const QString maskStr = QString("0x%1ull").arg(mask, 0, 16);
+
+    if (mode == Mode::Decode) {
+      if (!bits.isSigned) {
+        line(indent + 1, QString("%1 = qbinarizer::extractBits(%2);")
+                             .arg(member, args));
+      } else if (bits.size >= 64) {
+        line(indent + 1, QString("%1 = static_cast<qint64>(qbinarizer::"
+                                 "extractBits(%2));")
+                             .arg(member, args));
+      } else {
+        const int unused = 64 - bits.size;
+        line(indent + 1, QString("%1 = static_cast<qint64>(qbinarizer::"
+                                 "extractBits(%2) << %3) >> %3;")
+                             .arg(member, args)
+                             .arg(unused));
+      }
+    } else if (bits.isSigned) {
+      line(indent + 1, QString("qbinarizer::insertBits(%1, static_cast<quint64>"
+                               "(%2) & %3);")
+                           .arg(args, member, maskStr));
+    } else if (bits.size >= 64) {
+      line(indent + 1,
+           QString("qbinarizer::insertBits(%1, %2);").arg(args, member));
+    } else {
+      // Values wider than the element are not written, as in StructEncoder
+      line(indent + 1, QString("if (%1 <= %2) {").arg(member, maskStr));
+      line(indent + 2,
+           QString("qbinarizer::insertBits(%1, %2);").arg(args, member));
+      line(indent + 1, "}");
+    }
+  }
+
+  if (mode == Mode::Encode) {
+    line(indent + 1,
+         QString("std::memcpy(%1, bits, %2);").arg(at).arg(instr.size));
+  }
+  line(indent, "}");
+}
+
+void CodeGenerator::emitCrc(Mode mode, int index, const QString &element,
+                            const QString &pos, int indent) {
+  const CompiledSchema::Instruction &instr = m_schema.at(index);
+
+  QString from = QString::number(instr.from);
+  if (instr.parentRef >= 0) {
+    from = QString("(start%1 >= 0) ? start%1 : %2")
+               .arg(instr.parentRef)
+               .arg(instr.from);
+  }
+
+  const QString crc = (instr.opcode == Opcode::Crc32)
+                          ? "qbinarizer::crc32(data + from, %1 - from)"
+                          : "qbinarizer::crc64We(data + from, %1 - from)";
+
+  line(indent, "{");
+  line(indent + 1, QString("const qsizetype from = %1;").arg(from));
+  line(indent + 1, QString("if (from >= %1) {").arg(pos));
+  line(indent + 2, "return -1;");
+  line(indent + 1, "}");
+
+  if (mode == Mode::Encode) {
+    line(indent + 1, QString("qbinarizer::storeValue<%1>(data + %2, %3, %4);")
+                         .arg(valueType(instr.opcode), pos, crc.arg(pos),
+                              boolLiteral(instr.bigEndian)));
+  } else {
+    // The checksum is computed, as StructDecoder delivers it
+    line(indent + 1, QString("%1 = %2;").arg(element, crc.arg(pos)));
+  }
+  line(indent, "}");
+}
+
+void CodeGenerator::emitStart(Mode mode, int index, const QString &pos,
+                              int indent) {
+  if ((mode != Mode::Size) && m_starts.contains(index)) {
+    line(indent, QString("start%1 = %2;").arg(index).arg(pos));
+  }
+}
+
+QString CodeGenerator::memberDeclaration(int index) const {
+  const CompiledSchema::Instruction &instr = m_schema.at(index);
+  const QString type = elementType(index);
+  const QString &name = m_members.at(index);
+
+  if (instr.countRef != CompiledSchema::NoRef) {
+    return QString("std::vector<%1> %2;").arg(type, name);
+  }
+
+  if (instr.count > 1) {
+    return QString("std::array<%1, %2> %3{};").arg(type).arg(instr.count).arg(
+        name);
+  }
+
+  switch (instr.opcode) {
+  case Opcode::Struct:
+  case Opcode::Bitfield:
+    return QString("%1 %2;").arg(type, name);
+  case Opcode::Raw:
+    return QString("%1 %2{};").arg(type, name);
+  default:
+    return QString("%1 %2 = %3;").arg(type, name, defaultValue(index));
+  }
+}
+
+QString CodeGenerator::elementType(int index) const {
+  const CompiledSchema::Instruction &instr = m_schema.at(index);
+
+  switch (instr.opcode) {
+  case Opcode::Struct:
+  case Opcode::Bitfield:
+    return m_types.at(index);
+  case Opcode::Raw:
+    return QString("std::array<quint8, %1>").arg(instr.size);
+  case Opcode::BitfieldElement:
+    return instr.isSigned ? "qint64" : "quint64";
+  default:
+    return valueType(instr.opcode);
+  }
+}
+
+QString CodeGenerator::defaultValue(int index) const {
+  const CompiledSchema::Instruction &instr = m_schema.at(index);
+  if (instr.value.isNull()) {
+    return "0";
+  }
+
+  // Same conversions as StructEncoder applies to missing values
+  switch (instr.opcode) {
+  case Opcode::Float:
+  case Opcode::Double:
+    return QString::number(instr.value.toDouble(), 'g', 17);
+  case Opcode::UInt64:
+    return QString::number(instr.value.toULongLong()) + "ull";
+  case Opcode::BitfieldElement:
+    return instr.isSigned ? QString::number(instr.value.toLongLong()) + "ll"
+                          : QString::number(instr.value.toULongLong()) + "ull";
+  case Opcode::Crc32:
+  case Opcode::Crc64:
+    return "0";
+  default:
+    return QString::number(instr.value.toLongLong()) + "ll";
+  }
+}
+
+qint64 CodeGenerator::elementSize(int index) const {
+  const CompiledSchema::Instruction &instr = m_schema.at(index);
+
+  switch (instr.opcode) {
+  case Opcode::None:
+    return 0;
+  case Opcode::Struct: {
+    qint64 size = 0;
+    for (int i = index + 1; i < instr.end; i = m_schema.at(i).end) {
+      const qint64 childSize = fieldSize(i);
+      if (childSize < 0) {
+        return -1;
+      }
+
+      size += childSize;
+    }
+
+    return size;
+  }
+  default:
+    return instr.size;
+  }
+}
+
+qint64 CodeGenerator::fieldSize(int index) const {
+  const CompiledSchema::Instruction &instr = m_schema.at(index);
+  if (instr.countRef != CompiledSchema::NoRef) {
+    return -1;
+  }
+
+  const qint64 size = elementSize(index);
+  if ((size < 0) || (instr.count <= 1)) {
+    return size;
+  }
+
+  return size * instr.count;
+}
+
+qint64 CodeGenerator::minFieldSize(int index) const {
+  const CompiledSchema::Instruction &instr = m_schema.at(index);
+
+  qint64 size = instr.size;
+  if (instr.opcode == Opcode::None) {
+    size = 0;
+  } else if (instr.opcode == Opcode::Struct) {
+    size = 0;
+    for (int i = index + 1; i < instr.end; i = m_schema.at(i).end) {
+      size += minFieldSize(i);
+    }
+  }
+
+  if ((instr.countRef != CompiledSchema::NoRef) || (instr.count <= 1)) {
+    return size;
+  }
+
+  return size * instr.count;
+}
+
+void CodeGenerator::line(int indent, const QString &text) {
+  if (!text.isEmpty()) {
+    m_out += QString(indent * 2, QChar(' ')) + text;
+  }
+  m_out += '\n';
+}
+
+QString CodeGenerator::valueType(CompiledSchema::Opcode opcode) {
+  switch (opcode) {
+  case Opcode::Int8:
+    return "qint8";
+  case Opcode::UInt8:
+    return "quint8";
+  case Opcode::Int16:
+    return "qint16";
+  case Opcode::UInt16:
+    return "quint16";
+  case Opcode::Int24:
+  case Opcode::Int32:
+    return "qint32";
+  case Opcode::UInt24:
+  case Opcode::UInt32:
+  case Opcode::Crc32:
+    return "quint32";
+  case Opcode::Int64:
+  case Opcode::Unixtime:
+    return "qint64";
+  case Opcode::UInt64:
+  case Opcode::Crc64:
+    return "quint64";
+  case Opcode::Float:
+    return "float";
+  case Opcode::Double:
+    return "double";
+  default:
+    return "qint64";
+  }
+}
+
+bool CodeGenerator::isNumber(CompiledSchema::Opcode opcode) {
+  return (opcode >= Opcode::Int8) && (opcode <= Opcode::Double);
+}
+
+} // namespace qbinarizer
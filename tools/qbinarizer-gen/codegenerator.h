@@ -0,0 +1,131 @@
+#ifndef CODEGENERATOR_H
+#define CODEGENERATOR_H
+
+#include <QByteArray>
+#include <QSet>
+#include <QString>
+#include <QStringList>
+#include <QVariantList>
+
+#include <qbinarizer/CompiledSchema>
+
+namespace qbinarizer {
+
+/**
+ * @brief The CodeGenerator class Turns a field description into a header with
+ * plain structs and inline encode/decode functions over raw byte spans,
+ * wire-compatible with StructEncoder/StructDecoder on the same schema. Runs of
+ * fields with a fixed size are bounds-checked once and accessed at constant
+ * offsets
+ */
+class CodeGenerator {
+public:
+  explicit CodeGenerator(const QVariantList &datafieldList);
+
+  void setSourceName(const QString &sourceName);
+
+  void setTypeName(const QString &typeName);
+
+  /**
+   * @brief setNamespace Namespace of the generated code, none if empty
+   */
+  void setNamespace(const QString &nameSpace);
+
+  /**
+   * @brief setSchemaJson Description embedded in the header, so the same
+   * schema can be compiled for StructEncoder/StructDecoder
+   */
+  void setSchemaJson(const QByteArray &schemaJson);
+
+  /**
+   * @brief generate Header text, empty if the schema uses something the
+   * generated code cannot express, see errorString
+   */
+  QString generate();
+
+  QString errorString() const;
+
+  /**
+   * @brief identifier Field name made a valid C++ identifier
+   */
+  static QString identifier(const QString &name);
+
+  static QString camelCase(const QString &name);
+
+protected:
+  enum class Mode { Size, Encode, Decode };
+
+  void assignNames(int first, int end, const QString &access, bool counted);
+
+  bool checkSchema();
+
+  void emitType(const QString &typeName, int first, int end, int indent);
+
+  void emitFunction(Mode mode);
+
+  void emitList(Mode mode, int first, int end, const QString &owner,
+                int indent);
+
+  void emitFixedField(Mode mode, int index, const QString &owner,
+                      const QString &base, qint64 offset, int indent);
+
+  void emitFixedElement(Mode mode, int index, const QString &element,
+                        const QString &base, qint64 offset, int indent);
+
+  void emitDynamicField(Mode mode, int index, const QString &owner,
+                        int indent);
+
+  void emitBitfield(Mode mode, int index, const QString &element,
+                    const QString &at, int indent);
+
+  void emitCrc(Mode mode, int index, const QString &element,
+               const QString &pos, int indent);
+
+  void emitStart(Mode mode, int index, const QString &pos, int indent);
+
+  QString memberDeclaration(int index) const;
+
+  QString elementType(int index) const;
+
+  QString defaultValue(int index) const;
+
+  /**
+   * @brief elementSize Bytes of one element, -1 if it depends on data
+   */
+  qint64 elementSize(int index) const;
+
+  qint64 fieldSize(int index) const;
+
+  qint64 minFieldSize(int index) const;
+
+  void line(int indent, const QString &text = QString());
+
+  static QString valueType(CompiledSchema::Opcode opcode);
+
+  static bool isNumber(CompiledSchema::Opcode opcode);
+
+private:
+  CompiledSchema m_schema;
+
+  QString m_sourceName;
+  QString m_typeName;
+  QString m_namespace;
+  QByteArray m_schemaJson;
+
+  // Per instruction: struct member, nested type and access path from the
+  // top-level value. The path is empty inside counted fields
+  QStringList m_members;
+  QStringList m_types;
+  QStringList m_access;
+  // Fields whose start offset a crc range begins at
+  QSet<int> m_starts;
+  bool m_dynamic;
+  int m_depth;
+
+  QString m_out;
+  QString m_error;
+};
+
+} // namespace qbinarizer
+
+#endif // CODEGENERATOR_H
@@ -0,0 +1,85 @@
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QFile>
+#include <QFileInfo>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QTextStream>
+
+#include "codegenerator.h"
+
+int main(int argc, char *argv[]) {
+  QCoreApplication app(argc, argv);
+  QCoreApplication::setApplicationName("qbinarizer-gen");
+  QCoreApplication::setApplicationVersion(QBINARIZER_VERSION_STR);
+
+  QCommandLineParser parser;
+  parser.setApplicationDescription(
+      "Generates C++ structs with encode/decode functions from a qbinarizer "
+      "field description");
+  parser.addHelpOption();
+  parser.addVersionOption();
+  parser.addPositionalArgument("schema", "JSON field description");
+
+  const QCommandLineOption outputOption(
+      {"o", "output"}, "Header to write, standard output if not set", "file");
+  const QCommandLineOption typeOption(
+      {"t", "type"}, "Top-level struct name, schema file name by default",
+      "name");
+  const QCommandLineOption namespaceOption(
+      {"n", "namespace"}, "Namespace of the generated code", "name");
+  parser.addOptions({outputOption, typeOption, namespaceOption});
+  parser.process(app);
+
+  QTextStream err(stderr);
+
+  const QStringList args = parser.positionalArguments();
+  if (args.size() != 1) {
+    parser.showHelp(1);
+  }
+
+  QFile schemaFile(args.first());
+  if (!schemaFile.open(QIODevice::ReadOnly)) {
+    err << args.first() << ": " << schemaFile.errorString() << "\n";
+    return 1;
+  }
+
+  QJsonParseError parseError;
+  const QJsonDocument schemaDoc =
+      QJsonDocument::fromJson(schemaFile.readAll(), &parseError);
+  if (!schemaDoc.isArray()) {
+    err << args.first() << ": " << parseError.errorString() << "\n";
+    return 1;
+  }
+
+  const QFileInfo schemaInfo(schemaFile);
+  const QString baseName = schemaInfo.completeBaseName();
+
+  qbinarizer::CodeGenerator generator(schemaDoc.array().toVariantList());
+  generator.setSourceName(schemaInfo.fileName());
+  generator.setTypeName(parser.isSet(typeOption)
+                            ? parser.value(typeOption)
+                            : qbinarizer::CodeGenerator::camelCase(baseName));
+  generator.setNamespace(parser.value(namespaceOption));
+  generator.setSchemaJson(schemaDoc.toJson(QJsonDocument::Compact));
+
+  const QString header = generator.generate();
+  if (header.isEmpty()) {
+    err << args.first() << ": " << generator.errorString() << "\n";
+    return 1;
+  }
+
+  if (!parser.isSet(outputOption)) {
+    QTextStream(stdout) << header;
+    return 0;
+  }
+
+  QFile headerFile(parser.value(outputOption));
+  if (!headerFile.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+    err << headerFile.fileName() << ": " << headerFile.errorString() << "\n";
+    return 1;
+  }
+  headerFile.write(header.toUtf8());
+
+  return 0;
+}